@@ -20,11 +20,13 @@
 #include <lightwave/profiler.hpp>
 #include <lightwave/streaming.hpp>
 #include <lightwave/warp.hpp>
+#include <lightwave/distribution.hpp>
 
 // MARK: - objects
 #include <lightwave/bsdf.hpp>
 #include <lightwave/camera.hpp>
 #include <lightwave/emission.hpp>
+#include <lightwave/guiding.hpp>
 #include <lightwave/image.hpp>
 #include <lightwave/instance.hpp>
 #include <lightwave/integrator.hpp>
@@ -32,8 +34,11 @@
 #include <lightwave/postprocess.hpp>
 #include <lightwave/sampler.hpp>
 #include <lightwave/shape.hpp>
+#include <lightwave/termination.hpp>
+#include <lightwave/transmittance.hpp>
 #include <lightwave/test.hpp>
 #include <lightwave/texture.hpp>
+#include <lightwave/texturecache.hpp>
 
 // MARK: - scene
 #include <lightwave/scene.hpp>
@@ -69,7 +69,7 @@ public:
      * @param wi The incoming direction light comes from, pointing away
      * from the surface, in local coordinates.
      */
-    virtual BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    virtual BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                               const Vector &wi) const {
         NOT_IMPLEMENTED
     }
@@ -83,12 +83,17 @@ public:
      * from the surface, in local coordinates.
      * @param rng A random number generator used to steer the sampling.
      */
-    virtual BsdfSample sample(const Point2 &uv, const Vector &wo,
+    virtual BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                               Sampler &rng) const = 0;
     
     virtual Color getAlbedo(const Intersection &its) const {
         return Color(0.f);
     }
+
+    /// @brief Reports whether the Bsdf only scatters light into discrete
+    /// directions (e.g., perfect mirrors), in which case @ref evaluate is
+    /// always zero and directions can only be found by @ref sample .
+    virtual bool isDelta() const { return false; }
 };
 
 } // namespace lightwave
@@ -75,7 +75,9 @@
 #endif
 
 // Headers
+#include <algorithm>
 #include <chrono>
+#include <limits>
 #include <memory>
 #include <ostream>
 #include <string>
@@ -244,11 +246,37 @@ public:
     float getElapsedTime() const {
         using namespace std::chrono;
         const auto currentTime = high_resolution_clock::now();
-        return duration_cast<milliseconds>(currentTime - m_startTime).count() /
-               1000.f;
+        return duration<float>(currentTime - m_startTime).count();
     }
 };
 
+/**
+ * @brief Runs a benchmark several times and returns the fastest run in
+ * nanoseconds per item, which is the least disturbed by other processes.
+ * @param repetitions How often the benchmark is run.
+ * @param count How many items each run processes.
+ * @param function Runs the benchmark once.
+ * @param prepare Called before every run, without being timed.
+ */
+template <typename F, typename P>
+double measureFastest(int repetitions, size_t count, F &&function,
+                      P &&prepare) {
+    float bestTime = std::numeric_limits<float>::infinity();
+    for (int repetition = 0; repetition < repetitions; repetition++) {
+        prepare();
+        Timer timer;
+        function();
+        bestTime = std::min(bestTime, timer.getElapsedTime());
+    }
+    return bestTime * 1e9 / std::max(count, size_t(1));
+}
+
+/// @copydoc measureFastest
+template <typename F>
+double measureFastest(int repetitions, size_t count, F &&function) {
+    return measureFastest(repetitions, count, function, []() {});
+}
+
 /// @brief Prints a given lightwave object to an output stream, with special
 /// handling for null pointers.
 inline std::ostream &operator<<(std::ostream &os,
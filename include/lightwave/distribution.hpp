@@ -0,0 +1,103 @@
+/**
+ * @file distribution.hpp
+ * @brief Contains data structures to sample from discrete distributions.
+ */
+
+#pragma once
+
+#include <lightwave/math.hpp>
+
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief Samples indices proportional to given weights in constant time, using
+ * Walker's alias method: every index owns a bin of equal size, and the part of
+ * the bin that exceeds the probability of the index is given to another
+ * index (its alias).
+ * @see Vose, "A Linear Algorithm For Generating Random Numbers With a Given
+ * Distribution", which is used for construction.
+ */
+class AliasTable {
+    struct Bin {
+        /// @brief The fraction of the bin that belongs to its own index.
+        float threshold;
+        /// @brief The index that owns the remaining fraction of the bin.
+        int alias;
+        /// @brief The probability of sampling the index of the bin.
+        float probability;
+    };
+
+    std::vector<Bin> m_bins;
+
+public:
+    /// @brief Creates an empty table, from which nothing can be sampled.
+    AliasTable() {}
+
+    /// @brief Creates a table that samples each index with probability
+    /// proportional to its weight. Weights must not be negative.
+    explicit AliasTable(const std::vector<float> &weights)
+        : m_bins(weights.size()) {
+        double total = 0;
+        for (const float weight : weights)
+            total += weight;
+        if (total == 0) {
+            m_bins.clear();
+            return;
+        }
+
+        // split bins into those that are under- and overfull
+        const int n = int(weights.size());
+        std::vector<double> scaled(n);
+        std::vector<int> small, large;
+        for (int i = 0; i < n; i++) {
+            m_bins[i].probability = float(weights[i] / total);
+            scaled[i]             = weights[i] / total * n;
+            (scaled[i] < 1 ? small : large).push_back(i);
+        }
+
+        // fill each underfull bin from an overfull one
+        while (!small.empty() && !large.empty()) {
+            const int under = small.back();
+            small.pop_back();
+            const int over = large.back();
+
+            m_bins[under].threshold = float(scaled[under]);
+            m_bins[under].alias     = over;
+            scaled[over] -= 1 - scaled[under];
+            if (scaled[over] < 1) {
+                large.pop_back();
+                small.push_back(over);
+            }
+        }
+
+        // the remaining bins are full up to rounding errors
+        for (const int i : small) {
+            m_bins[i].threshold = 1;
+            m_bins[i].alias     = i;
+        }
+        for (const int i : large) {
+            m_bins[i].threshold = 1;
+            m_bins[i].alias     = i;
+        }
+    }
+
+    /// @brief Returns whether nothing can be sampled (i.e., the table was
+    /// built without weights, or all weights were zero).
+    bool empty() const { return m_bins.empty(); }
+    /// @brief Returns the number of indices that can be sampled.
+    int size() const { return int(m_bins.size()); }
+
+    /// @brief Returns the probability of sampling the given index.
+    float probability(int index) const { return m_bins[index].probability; }
+
+    /// @brief Maps a uniform random number in [0,1) to an index.
+    int sample(float u) const {
+        const float scaled = u * size();
+        const int bin      = min(int(scaled), size() - 1);
+        return scaled - bin < m_bins[bin].threshold ? bin : m_bins[bin].alias;
+    }
+};
+
+} // namespace lightwave
@@ -42,7 +42,8 @@ public:
      * @param wo The outgoing direction light is emitted in, pointing away from
      * the surface, in local coordinates.
      */
-    virtual EmissionEval evaluate(const Point2 &uv, const Vector &wo) const = 0;
+    virtual EmissionEval evaluate(const TextureCoordinates &uv,
+                                  const Vector &wo) const = 0;
 };
 
 } // namespace lightwave
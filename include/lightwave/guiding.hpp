@@ -0,0 +1,395 @@
+/**
+ * @file guiding.hpp
+ * @brief Contains data structures that learn the distribution of incident
+ * light during rendering, which path guiding integrators sample from.
+ */
+
+#pragma once
+
+#include <lightwave/math.hpp>
+#include <lightwave/parallel.hpp>
+
+#include <array>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief A distribution over directions, represented as a quadtree over the
+ * unit square that the sphere of directions is mapped to (using the area
+ * preserving cylindrical mapping). Every quadrant of a node stores the energy
+ * that has been recorded within it, and quadrants with much energy are
+ * subdivided further by @ref refined .
+ *
+ * Energy is recorded into the leaves concurrently (using atomic additions)
+ * while the structure of the tree stays fixed. Once recording is done, @ref
+ * finalize sums up the energy of the inner nodes, after which the tree can be
+ * sampled.
+ */
+class DirectionalTree {
+    struct Node {
+        /// @brief The energy recorded within each quadrant.
+        std::array<float, 4> sums{ 0, 0, 0, 0 };
+        /// @brief The index of the node subdividing each quadrant, or 0 if the
+        /// quadrant is a leaf (the root is never a child).
+        std::array<uint32_t, 4> children{ 0, 0, 0, 0 };
+
+        float total() const { return sums[0] + sums[1] + sums[2] + sums[3]; }
+        bool isLeaf(int quadrant) const { return children[quadrant] == 0; }
+    };
+
+    static constexpr int MaxDepth = 20;
+    /// @brief The largest float below one.
+    static constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+
+    /// @brief The nodes of the tree, where children always come after their
+    /// parents and the first node is the root.
+    std::vector<Node> m_nodes;
+    /// @brief The total energy of the tree, as computed by @ref finalize .
+    float m_total = 0;
+
+    /// @brief Determines the quadrant that a point lies in, and maps the point
+    /// to the unit square of that quadrant.
+    static int quadrant(Point2 &p) {
+        const int x = p.x() >= 0.5f;
+        const int y = p.y() >= 0.5f;
+        p = Point2(2 * p.x() - x, 2 * p.y() - y);
+        return x + 2 * y;
+    }
+
+public:
+    /// @brief The size of a node in bytes, which is used for bounding the
+    /// memory of trees.
+    static constexpr size_t NodeSize = sizeof(Node);
+
+    /// @brief Creates a tree with a single node, i.e., four quadrants.
+    DirectionalTree() : m_nodes(1) {}
+
+    /// @brief Maps a direction to the unit square (cylindrical mapping).
+    static Point2 toSquare(const Vector &direction) {
+        float phi = std::atan2(direction.y(), direction.x()) * Inv2Pi;
+        if (phi < 0)
+            phi += 1;
+        return Point2(clamp((direction.z() + 1) / 2, 0.f, 1.f),
+                      clamp(phi, 0.f, 1.f));
+    }
+
+    /// @brief Maps a point of the unit square to a direction, the inverse of
+    /// @ref toSquare .
+    static Vector fromSquare(const Point2 &p) {
+        const float cosTheta = 2 * p.x() - 1;
+        const float sinTheta = safe_sqrt(1 - sqr(cosTheta));
+        const float phi      = 2 * Pi * p.y();
+        return Vector(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+    }
+
+    /// @brief Returns the number of nodes of the tree.
+    int numNodes() const { return int(m_nodes.size()); }
+    /// @brief Returns the total energy recorded in the tree, which is only
+    /// available after @ref finalize .
+    float total() const { return m_total; }
+
+    /// @brief Adds energy arriving from the given direction. Can be called
+    /// concurrently from multiple threads.
+    void record(const Vector &direction, float value) {
+        Point2 p = toSquare(direction);
+        uint32_t node = 0;
+        for (;;) {
+            const int q = quadrant(p);
+            if (m_nodes[node].isLeaf(q)) {
+                atomicAdd(m_nodes[node].sums[q], value);
+                return;
+            }
+            node = m_nodes[node].children[q];
+        }
+    }
+
+    /// @brief Sums up the energy of the leaves into their parents, which needs
+    /// to be done after recording and before sampling.
+    void finalize() {
+        for (int node = numNodes() - 1; node >= 0; node--) {
+            for (int q = 0; q < 4; q++) {
+                if (!m_nodes[node].isLeaf(q))
+                    m_nodes[node].sums[q] =
+                        m_nodes[m_nodes[node].children[q]].total();
+            }
+        }
+        m_total = m_nodes[0].total();
+    }
+
+    /// @brief Returns the density of sampling a direction (in solid angle),
+    /// which is proportional to the energy of the leaf the direction lies in.
+    float pdf(const Vector &direction) const {
+        if (m_total <= 0)
+            return 0;
+        Point2 p      = toSquare(direction);
+        float density = Inv4Pi;
+        uint32_t node = 0;
+        for (;;) {
+            const Node &n   = m_nodes[node];
+            const float sum = n.total();
+            const int q     = quadrant(p);
+            if (sum <= 0)
+                return 0;
+            density *= 4 * n.sums[q] / sum;
+            if (n.isLeaf(q) || density == 0)
+                return density;
+            node = n.children[q];
+        }
+    }
+
+    /// @brief Samples a direction proportional to the recorded energy, which
+    /// requires that the total energy is positive.
+    Vector sample(Point2 u) const {
+        Point2 origin(0.f);
+        float size    = 1;
+        uint32_t node = 0;
+        for (;;) {
+            const Node &n = m_nodes[node];
+            // pick the column of the quadrant, then its row
+            const float left = (n.sums[0] + n.sums[2]) / n.total();
+            int x            = 0;
+            if (u.x() < left) {
+                u.x() /= left;
+            } else {
+                x     = 1;
+                u.x() = (u.x() - left) / (1 - left);
+            }
+            const float bottom = n.sums[x] / (n.sums[x] + n.sums[x + 2]);
+            int y              = 0;
+            if (u.y() < bottom) {
+                u.y() /= bottom;
+            } else {
+                y     = 1;
+                u.y() = (u.y() - bottom) / (1 - bottom);
+            }
+            // guard against rounding pushing the numbers out of [0,1)
+            u = Point2(min(u.x(), OneMinusEpsilon),
+                       min(u.y(), OneMinusEpsilon));
+
+            size /= 2;
+            origin = Point2(origin.x() + x * size, origin.y() + y * size);
+            const int q = x + 2 * y;
+            if (n.isLeaf(q))
+                break;
+            node = n.children[q];
+        }
+        return fromSquare(Point2(origin.x() + u.x() * size,
+                                 origin.y() + u.y() * size));
+    }
+
+    /**
+     * @brief Creates an empty tree whose structure adapts to the energy of
+     * this (finalized) tree: every quadrant that holds more than the given
+     * fraction of the total energy is subdivided, and all others are leaves.
+     * Coarse quadrants are subdivided before finer ones, and no more than
+     * @c maxNodes nodes are created.
+     */
+    DirectionalTree refined(float threshold, int maxNodes) const {
+        DirectionalTree result;
+        if (m_total <= 0)
+            return result;
+
+        struct Item {
+            /// @brief The node of the new tree.
+            uint32_t node;
+            /// @brief The corresponding node in this tree, or -1 if the
+            /// region is a leaf in this tree.
+            int previous;
+            /// @brief The energy of the region of the node.
+            float energy;
+            int depth;
+        };
+        // subdivide breadth first, so that running out of nodes still leaves
+        // a tree that is refined evenly
+        std::vector<Item> queue{ { 0, 0, m_total, 1 } };
+        for (size_t i = 0; i < queue.size(); i++) {
+            const Item item = queue[i];
+            if (item.depth >= MaxDepth)
+                continue;
+            for (int q = 0; q < 4; q++) {
+                const Node *previous =
+                    item.previous >= 0 ? &m_nodes[item.previous] : nullptr;
+                const float energy =
+                    previous ? previous->sums[q] : item.energy / 4;
+                if (energy <= threshold * m_total ||
+                    result.numNodes() >= maxNodes)
+                    continue;
+
+                const uint32_t child = result.m_nodes.size();
+                result.m_nodes.emplace_back();
+                result.m_nodes[item.node].children[q] = child;
+                queue.push_back(
+                    { child,
+                      previous && !previous->isLeaf(q)
+                          ? int(previous->children[q])
+                          : -1,
+                      energy,
+                      item.depth + 1 });
+            }
+        }
+        return result;
+    }
+};
+
+/**
+ * @brief Learns the incident radiance throughout a scene as a spatial binary
+ * tree, whose leaves (regions) each hold a @ref DirectionalTree (Müller et al.,
+ * "Practical Path Guiding for Efficient Light-Transport Simulation", 2017).
+ *
+ * Learning happens in passes: while rendering a pass, radiance is recorded
+ * into the building trees and the sampling trees (learned in earlier passes)
+ * are only read, so threads share the structure without locks. @ref refine
+ * then turns the building trees into the new sampling trees, splits regions
+ * that have received many records, and adapts the directional trees to the
+ * learned distribution.
+ *
+ * The memory of the trees is bounded: directional trees have at most @ref
+ * MaxNodesPerTree nodes, and regions are only split as long as the trees of
+ * all regions fit into the given budget.
+ */
+class GuidingField {
+public:
+    struct Region {
+        /// @brief The distribution learned in previous passes, to sample from.
+        DirectionalTree sampling;
+        /// @brief The distribution that is recorded into in the current pass.
+        DirectionalTree building;
+        /// @brief The number of records in the current pass.
+        int64_t numRecords = 0;
+    };
+
+    static constexpr int MaxNodesPerTree = 512;
+
+private:
+    struct Node {
+        /// @brief The children of the node, or -1 if the node is a leaf.
+        std::array<int, 2> children{ -1, -1 };
+        /// @brief The region of a leaf.
+        int region = -1;
+    };
+
+    Bounds m_bounds;
+    std::vector<Node> m_nodes;
+    std::vector<Region> m_regions;
+    int m_maxRegions;
+    /// @brief The number of records (times the square root of the samples per
+    /// pixel of a pass) above which a region is split.
+    float m_spatialThreshold;
+    /// @brief The fraction of the energy above which directional quadrants are
+    /// subdivided.
+    float m_directionalThreshold;
+
+public:
+    /**
+     * @param bounds The region of the scene to learn in (if it is unbounded,
+     * only a single region is used).
+     * @param maxMemory The memory in bytes that the trees may use.
+     */
+    GuidingField(const Bounds &bounds, size_t maxMemory,
+                 float spatialThreshold, float directionalThreshold)
+        : m_bounds(bounds), m_nodes(1), m_regions(1),
+          m_spatialThreshold(spatialThreshold),
+          m_directionalThreshold(directionalThreshold) {
+        m_nodes[0].region = 0;
+        // a region holds two directional trees, and adds two spatial nodes
+        const size_t regionSize = 2 * MaxNodesPerTree *
+                                      DirectionalTree::NodeSize +
+                                  sizeof(Region) + 2 * sizeof(Node);
+        m_maxRegions = std::max(int(maxMemory / regionSize), 1);
+        if (m_bounds.isUnbounded())
+            m_maxRegions = 1;
+    }
+
+    /// @brief Returns the region that a point lies in.
+    Region &lookup(const Point &position) {
+        Point p;
+        for (int dim = 0; dim < 3; dim++) {
+            const float extent = m_bounds.diagonal()[dim];
+            p[dim] = extent > 0 ? clamp((position[dim] - m_bounds.min()[dim]) /
+                                            extent,
+                                        0.f,
+                                        1.f)
+                                : 0.5f;
+        }
+
+        int node = 0;
+        for (int depth = 0; m_nodes[node].region < 0; depth++) {
+            // split the axes in turn
+            const int axis  = depth % 3;
+            const int child = p[axis] >= 0.5f;
+            p[axis]         = 2 * p[axis] - child;
+            node            = m_nodes[node].children[child];
+        }
+        return m_regions[m_nodes[node].region];
+    }
+
+    /// @brief Records radiance arriving at a region from the given direction,
+    /// weighted by the inverse density of having sampled the direction. Can be
+    /// called concurrently from multiple threads.
+    static void record(Region &region, const Vector &direction, float value) {
+        if (!(value >= 0) || !std::isfinite(value))
+            return;
+        // records without energy still count towards splitting regions, so
+        // that regions adapt to where paths go
+        if (value > 0)
+            region.building.record(direction, value);
+        atomicAdd(region.numRecords, int64_t(1));
+    }
+
+    /**
+     * @brief Finishes a pass, after which regions sample the distribution that
+     * has been recorded in it (or keep their previous distribution if nothing
+     * has been recorded).
+     * @param samples The number of samples per pixel of the finished pass,
+     * which determines how many records warrant splitting a region.
+     */
+    void refine(int samples) {
+        for (Region &region : m_regions) {
+            region.building.finalize();
+            if (region.building.total() > 0)
+                region.sampling = region.building;
+        }
+
+        const float threshold = m_spatialThreshold * std::sqrt(float(samples));
+        // children are appended, so they are checked for splits as well
+        for (size_t node = 0; node < m_nodes.size(); node++) {
+            const int index = m_nodes[node].region;
+            if (index < 0 || m_regions[index].numRecords <= threshold ||
+                int(m_regions.size()) >= m_maxRegions)
+                continue;
+
+            // both halves start with the distribution of the region, and
+            // are expected to receive half of its records
+            m_regions[index].numRecords /= 2;
+            m_regions.push_back(m_regions[index]);
+            m_nodes[node].children = { int(m_nodes.size()),
+                                       int(m_nodes.size()) + 1 };
+            m_nodes[node].region   = -1;
+            m_nodes.emplace_back().region = index;
+            m_nodes.emplace_back().region = int(m_regions.size()) - 1;
+        }
+
+        for (Region &region : m_regions) {
+            region.building =
+                region.sampling.refined(m_directionalThreshold, MaxNodesPerTree);
+            region.numRecords = 0;
+        }
+    }
+
+    /// @brief Returns the number of regions.
+    int numRegions() const { return int(m_regions.size()); }
+
+    /// @brief Returns the memory used by the trees in bytes.
+    size_t memoryUsage() const {
+        size_t bytes = m_nodes.size() * sizeof(Node) +
+                       m_regions.size() * sizeof(Region);
+        for (const Region &region : m_regions) {
+            bytes += (region.sampling.numNodes() + region.building.numNodes()) *
+                     DirectionalTree::NodeSize;
+        }
+        return bytes;
+    }
+};
+
+} // namespace lightwave
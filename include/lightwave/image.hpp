@@ -12,6 +12,8 @@
 #include <lightwave/math.hpp>
 #include <lightwave/properties.hpp>
 
+#include <map>
+
 namespace lightwave {
 
 /// @brief An image.
@@ -25,6 +27,10 @@ class Image final : public Object {
     /// @brief The folder the image was loaded from or should be stored to.
     std::filesystem::path m_basePath;
 
+    /// @brief Additional string attributes that are stored in the header of
+    /// saved EXR files (e.g., the number of samples per pixel rendered).
+    std::map<std::string, std::string> m_metadata;
+
     /**
      * @brief Converts a normalized position from [0,0]..[+1,+1] to a pixel
      * index [0,0]..[resolution.x-1, resolution.y-1]. Input positions outside
@@ -67,6 +73,12 @@ public:
         m_basePath = basePath;
     }
 
+    /// @brief Sets a string attribute that will be stored in the header of
+    /// saved EXR files.
+    void setMetadata(const std::string &key, const std::string &value) {
+        m_metadata[key] = value;
+    }
+
     /// @brief Copies the data and resolution from another image, but leaves all
     /// other attributes the same.
     void copy(const Image &image) {
@@ -92,6 +104,13 @@ public:
     /// @brief Set the color of every pixel to the color black.
     void clear() { std::fill(m_data.begin(), m_data.end(), Color()); }
 
+    /**
+     * @brief Returns the next level of a MIP pyramid, which halves the
+     * resolution (down to a single pixel) and averages the pixels that each
+     * pixel covers. These are 2x2 pixels unless the resolution is odd.
+     */
+    ref<Image> downsample() const;
+
     /// @brief Saves the image as an EXR file at a given path.
     void saveAt(const std::filesystem::path &path,
                         float norm = 1.f) const;
@@ -101,6 +101,20 @@ public:
      */
     bool intersect(const Ray &ray, Intersection &its,
                    Sampler &rng) const override;
+    /**
+     * @brief Computes the surface information of a hit within the wrapped
+     * shape that has been deferred, and transforms it to world coordinates.
+     * @note Only the outermost instance defers hits, nested instances compute
+     * their surface information right away.
+     */
+    void computeSurface(const Ray &ray, Intersection &its) const override;
+    /**
+     * @brief Tests whether the instance blocks a ray in world coordinates
+     * before tMax.
+     * @note Alpha masked instances fall back to @ref intersect , as the alpha
+     * mask can only be evaluated for the surface information of a hit.
+     */
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override;
     float transmittance(const Ray &ray, float tMax,
                         Sampler &rng) const override;
     /// @brief Returns the bounding box of the instance in world coordinates.
@@ -114,6 +128,11 @@ public:
      */
     AreaSample sampleArea(Sampler &rng) const override;
     AreaSample sampleArea(const Point &origin, Sampler &rng) const override;
+    /// @brief Returns the surface area of the instance in world coordinates.
+    float getSurfaceArea() const override;
+    /// @brief Returns the normal of the instance in world coordinates if it is
+    /// planar (and its shading normals are not perturbed by a normal map).
+    std::optional<Vector> getPlanarNormal() const override;
 
     bool hasAlpha(Intersection &its, Sampler &rng) const;
     
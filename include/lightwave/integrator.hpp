@@ -8,12 +8,61 @@
 #include <lightwave/color.hpp>
 #include <lightwave/core.hpp>
 #include <lightwave/image.hpp>
+#include <lightwave/iterators.hpp>
 #include <lightwave/math.hpp>
 #include <lightwave/sampler.hpp>
 #include <lightwave/scene.hpp>
 
+#include <vector>
+
 namespace lightwave {
 
+/**
+ * @brief The samples computed for the pixels of a block, summed per pixel.
+ * Integrators add samples through @ref add , and the caller merges the sums
+ * into the image once the whole block is done.
+ */
+class BlockSamples {
+    Bounds2i m_block;
+    /// @brief The sum of the radiance of all samples of each pixel.
+    std::vector<Color> m_sums;
+    /// @brief The sum of the squared luminance of all samples of each pixel,
+    /// from which adaptive sampling estimates the variance.
+    std::vector<float> m_squaredLuminances;
+
+    int index(const Point2i &pixel) const {
+        return (pixel.y() - m_block.min().y()) * m_block.diagonal().x() +
+               pixel.x() - m_block.min().x();
+    }
+
+public:
+    /// @brief Prepares the buffer to receive samples of the given block.
+    void reset(const Bounds2i &block) {
+        m_block = block;
+        m_sums.assign(block.diagonal().product(), Color(0));
+        m_squaredLuminances.assign(block.diagonal().product(), 0);
+    }
+
+    /// @brief The block whose samples this buffer receives.
+    const Bounds2i &block() const { return m_block; }
+
+    /// @brief Adds the radiance of a single sample of a pixel.
+    void add(const Point2i &pixel, const Color &radiance) {
+        const int i = index(pixel);
+        m_sums[i] += radiance;
+        m_squaredLuminances[i] += sqr(radiance.luminance());
+    }
+
+    /// @brief The sum of the radiance of all samples of a pixel.
+    const Color &sum(const Point2i &pixel) const {
+        return m_sums[index(pixel)];
+    }
+    /// @brief The sum of the squared luminance of all samples of a pixel.
+    float squaredLuminance(const Point2i &pixel) const {
+        return m_squaredLuminances[index(pixel)];
+    }
+};
+
 /**
  * @brief Integrators are rendering algorithms that take a scene and produce an
  * image from them (e.g., using path tracing). The term integrator refers to the
@@ -40,11 +89,78 @@ protected:
     /// @brief The scene that should be rendered.
     ref<Scene> m_scene;
 
+    /// @brief The wall-clock time in seconds after which rendering stops, or
+    /// 0 to render the number of samples requested by the sampler.
+    float m_timeBudget;
+
+    /// @brief Whether the sample budget is distributed across the image by
+    /// the error of each region, see @ref executeAdaptive .
+    bool m_adaptive;
+    /// @brief The relative standard error below which a tile of pixels never
+    /// receives more samples, even if budget is left. The default of 0 spends
+    /// the whole budget.
+    float m_adaptiveThreshold;
+    /// @brief The number of samples every pixel receives before its error is
+    /// first estimated.
+    int m_adaptiveMinSamples;
+    /// @brief The number of samples no pixel will exceed, even if the budget
+    /// saved in converged regions would allow it.
+    int m_adaptiveMaxSamples;
+    /// @brief An optional output image (AOV) that receives the number of
+    /// samples taken in each pixel.
+    ref<Image> m_samplesImage;
+
+    /// @brief Whether the image is always rendered in geometrically growing
+    /// passes, which integrators that learn from previous passes rely on.
+    bool m_renderInPasses = false;
+
+    /**
+     * @brief Called after each pass of rendering has finished (and before the
+     * next one starts), with the number of samples per pixel the pass took.
+     * Integrators can override this to learn from the samples of the pass.
+     */
+    virtual void finishPass(int samples) {}
+
+    /**
+     * @brief Renders the image adaptively. All tiles of pixels first receive
+     * @ref m_adaptiveMinSamples samples, from which the relative standard
+     * deviation of every tile is estimated. The sample budget of the sampler
+     * (samples per pixel times number of pixels) is then distributed so that
+     * each tile receives samples in proportion to its deviation, which
+     * minimizes the relative mean squared error of the image. Tiles never
+     * lose samples they already have and receive at most
+     * @ref m_adaptiveMaxSamples per pixel; the budget they cannot take is
+     * spent on the remaining tiles. The allocation is refined over passes
+     * that at most double the samples of a tile, and is recomputed from the
+     * new estimates after each pass. Like in non-adaptive rendering, the
+     * samples are computed by @ref renderBlock . Rendering ends once the
+     * budget is used up or all tiles have reached @ref m_adaptiveThreshold .
+     */
+    void executeAdaptive();
+
+    /// @brief Parses a duration such as "90", "120s", "5min" or "1.5h" into
+    /// seconds.
+    static float parseDuration(const std::string &duration);
+
 public:
     SamplingIntegrator(const Properties &properties) : Integrator(properties) {
         m_sampler = properties.getChild<Sampler>();
         m_image   = properties.getOptionalChild<Image>();
         m_scene   = properties.getChild<Scene>();
+
+        m_timeBudget =
+            parseDuration(properties.get<std::string>("timeBudget", "0"));
+
+        m_adaptive = properties.get<bool>("adaptive", false);
+        m_adaptiveThreshold =
+            properties.get<float>("adaptiveThreshold", 0);
+        m_adaptiveMinSamples = std::min(
+            properties.get<int>("adaptiveMinSamples", 16),
+            m_sampler->samplesPerPixel());
+        m_adaptiveMaxSamples =
+            properties.get<int>("adaptiveMaxSamples",
+                                4 * m_sampler->samplesPerPixel());
+        m_samplesImage = properties.getOptional<Image>("samples");
     }
 
     /// @brief Gets the output image that is populated throughout rendering.
@@ -59,10 +175,25 @@ public:
     /// decisions.
     Sampler *sampler() { return m_sampler.get(); }
 
-    /// @brief Computes all pixels of the image by constructing camera rays for
-    /// them and invoking the @ref Li method.
+    /**
+     * @brief Computes all pixels of the image by constructing camera rays for
+     * them and invoking the @ref Li method. If a time budget is given, passes
+     * of increasing sample counts are rendered until the budget is used up,
+     * and the number of samples per pixel reached is recorded in the metadata
+     * of the image.
+     */
     void execute() override;
 
+    /**
+     * @brief Computes the samples @c spps of every pixel of the block of
+     * @c samples and adds the radiance of each of them to @c samples . By
+     * default, each sample is computed on its own by invoking @ref Li , but
+     * integrators can override this to trace the paths of many samples
+     * together.
+     */
+    virtual void renderBlock(const Range &spps, Sampler &sampler,
+                             BlockSamples &samples);
+
     /**
      * @brief Returns (an estimate of) the incident radiance for a given ray.
      * By default, the integrator will take care of looping over all pixels,
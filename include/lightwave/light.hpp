@@ -10,6 +10,8 @@
 #include <lightwave/emission.hpp>
 #include <lightwave/math.hpp>
 
+#include <optional>
+
 namespace lightwave {
 
 /// @brief The result of sampling a light from a given query point using @ref
@@ -43,6 +45,41 @@ struct DirectLightSample {
     explicit operator bool() const { return !isInvalid(); }
 };
 
+/**
+ * @brief Conservatively bounds where and in which directions a light source
+ * emits, which @ref Scene::sampleLight uses to build a hierarchy over all lights
+ * and to estimate how much each of them contributes to a given point.
+ * @note The directions are bounded by two cones: all surface normals of the
+ * light lie within @c cosThetaO of @c axis , and light is only emitted within
+ * @c cosThetaE of the surface normal it leaves from.
+ */
+struct LightBounds {
+    /// @brief The bounding box of all points that emit light.
+    Bounds bounds;
+    /// @brief An estimate of the total power the light emits (as luminance),
+    /// which only needs to be roughly proportional to the true power.
+    float power;
+    /// @brief The central direction of the surface normals of the light.
+    Vector axis;
+    /// @brief The cosine of the largest angle between @c axis and any surface
+    /// normal of the light (-1 if normals can point anywhere).
+    float cosThetaO;
+    /// @brief The cosine of the largest angle between a surface normal and the
+    /// direction light is emitted in (0 for diffuse emitters).
+    float cosThetaE;
+
+    /// @brief Bounds two lights (or groups of lights) at once.
+    static LightBounds unite(const LightBounds &a, const LightBounds &b);
+
+    /**
+     * @brief Estimates how much light arrives at the given point, i.e., the
+     * power divided by the squared distance, scaled by the cosine of the
+     * smallest angle at which light could leave towards the point.
+     * @note Returns zero only if no light can possibly reach the point.
+     */
+    float importance(const Point &point) const;
+};
+
 /**
  * @brief A light source that can be sampled for direct connections.
  * Some light sources can also be intersected by rays (e.g., area lights or the
@@ -59,8 +96,12 @@ protected:
      */
     float m_samplingWeight;
 
+private:
+    /// @brief The position of this light in the list of lights of its scene.
+    int m_index;
+
 public:
-    Light(const Properties &properties) {
+    Light(const Properties &properties) : m_index(-1) {
         m_samplingWeight = properties.get<float>("weight", 1.f);
     }
 
@@ -72,6 +113,26 @@ public:
      */
     float samplingWeight() const { return m_samplingWeight; }
 
+    /**
+     * @brief The position of this light in the list of lights of its scene,
+     * which lets the scene look up data of a light (e.g., how likely it is
+     * picked) without hashing. Lights that are not part of a scene have an
+     * index of -1.
+     */
+    int index() const { return m_index; }
+
+    /// @brief Assigns the position of this light in the list of lights of its
+    /// scene.
+    void setIndex(int index) {
+        if (m_index >= 0 && m_index != index) {
+            lightwave_throw(
+                "lights can only be part of one scene, %s is used by "
+                "multiple!",
+                indent(this));
+        }
+        m_index = index;
+    }
+
     /**
      * @brief Samples a random point on the light source and computes its
      * emission and probability of sampling.
@@ -85,6 +146,15 @@ public:
     /// @brief Returns whether this light source can be hit by rays (i.e., has
     /// an area that has been placed within the scene).
     virtual bool canBeIntersected() const { return false; }
+
+    /**
+     * @brief Bounds the emission of the light, or returns nothing if it cannot
+     * be bounded (e.g., for lights that are infinitely far away). Lights without
+     * bounds are not part of the light hierarchy, and are instead picked
+     * according to their @ref samplingWeight .
+     * @note The power of the bounds includes the sampling weight of the light.
+     */
+    virtual std::optional<LightBounds> bounds() const { return std::nullopt; }
 };
 
 /**
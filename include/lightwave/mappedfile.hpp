@@ -0,0 +1,75 @@
+/**
+ * @file mappedfile.hpp
+ * @brief Contains the MappedFile class, which provides read-only access to the
+ * contents of a file through memory mapping, and utilities for the files that
+ * cache converted data (e.g., BVHs, texture tiles or volume bricks).
+ */
+
+#pragma once
+
+#include <lightwave/core.hpp>
+
+#include <filesystem>
+#include <functional>
+#include <ostream>
+
+namespace lightwave {
+
+/**
+ * @brief Maps the contents of a file into memory for reading. The mapping is
+ * released when the object is destroyed.
+ */
+class MappedFile {
+    const uint8_t *m_data = nullptr;
+    size_t m_size         = 0;
+#ifdef LW_OS_WINDOWS
+    void *m_file    = nullptr;
+    void *m_mapping = nullptr;
+#endif
+
+public:
+    /// @brief Maps the given file, check @ref isValid to see whether this
+    /// succeeded (e.g., it fails if the file does not exist).
+    MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &)            = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /// @brief Whether the file could be mapped.
+    bool isValid() const { return m_data != nullptr; }
+    /// @brief Returns the contents of the file.
+    const uint8_t *data() const { return m_data; }
+    /// @brief Returns the size of the file in bytes.
+    size_t size() const { return m_size; }
+};
+
+/**
+ * @brief Writes a file under a temporary name first and renames it afterwards,
+ * so that concurrent jobs never read incomplete files. Missing parent
+ * directories are created.
+ * @param write Writes the contents of the file to the given stream.
+ * @return Whether the file has been written.
+ */
+bool writeFileAtomically(const std::filesystem::path &path,
+                         const std::function<void(std::ostream &)> &write);
+
+/**
+ * @brief The directory in which converted data is cached, given by the
+ * LW_BVH_CACHE environment variable, or an empty path if it is not set.
+ */
+std::filesystem::path defaultCacheDirectory();
+
+/**
+ * @brief Returns the path of the file that caches data converted from a source
+ * file (e.g., the tiles of an image). Without a cache directory, the file is
+ * placed next to the source file. Otherwise, it is placed in the cache
+ * directory, and its name is made unique by the hash of the absolute path of
+ * the source file.
+ */
+std::filesystem::path
+convertedFilePath(const std::filesystem::path &source,
+                  const std::string &extension,
+                  const std::filesystem::path &cacheDirectory);
+
+} // namespace lightwave
@@ -815,6 +815,17 @@ struct Ray {
     /// integrators.
     int depth = 0;
 
+    /**
+     * @brief Whether the ray carries the rays through the neighboring pixels
+     * in x and y direction (its ray differentials), which cameras provide to
+     * estimate the footprint of a pixel on the surfaces it hits.
+     */
+    bool hasDifferentials = false;
+    Point dxOrigin;
+    Vector dxDirection;
+    Point dyOrigin;
+    Vector dyDirection;
+
     Ray() {}
     Ray(Point origin, Vector direction, int depth = 0)
         : origin(origin), direction(direction), depth(depth) {}
@@ -822,10 +833,25 @@ struct Ray {
     /// @brief Computes a point on the ray for a given distance @c t .
     Point operator()(float t) const { return origin + t * direction; }
 
-    /// @brief Returns a copy of the ray with normalized direction vector
+    /// @brief Returns a copy of the ray with normalized direction vectors
     /// (useful after applying transforms).
     Ray normalized() const {
-        return Ray(origin, direction.normalized(), depth);
+        Ray result(*this);
+        result.direction = direction.normalized();
+        if (hasDifferentials) {
+            result.dxDirection = dxDirection.normalized();
+            result.dyDirection = dyDirection.normalized();
+        }
+        return result;
+    }
+
+    /// @brief Scales the offsets of the neighboring rays, e.g., to account
+    /// for the smaller footprint of each of multiple samples per pixel.
+    void scaleDifferentials(float scale) {
+        dxOrigin    = origin + (dxOrigin - origin) * scale;
+        dyOrigin    = origin + (dyOrigin - origin) * scale;
+        dxDirection = direction + (dxDirection - direction) * scale;
+        dyDirection = direction + (dyDirection - direction) * scale;
     }
 };
 
@@ -954,18 +980,47 @@ struct Vertex {
     }
 };
 
+/**
+ * @brief Texture coordinates along with their derivatives with respect to the
+ * pixel coordinates of the image, which describe the footprint of a pixel in
+ * texture space that texture lookups can filter over. The derivatives are zero
+ * if the footprint is unknown (e.g., for rays that did not originate from the
+ * camera).
+ */
+struct TextureCoordinates : public Point2 {
+    /// @brief The change of the texture coordinates from one pixel to the next
+    /// in x direction.
+    Vector2 dx;
+    /// @brief The change of the texture coordinates from one pixel to the next
+    /// in y direction.
+    Vector2 dy;
+
+    TextureCoordinates() {}
+    TextureCoordinates(const Point2 &uv) : Point2(uv) {}
+    TextureCoordinates(const Point2 &uv, const Vector2 &dx, const Vector2 &dy)
+        : Point2(uv), dx(dx), dy(dy) {}
+
+    /// @brief Returns whether the footprint of the lookup is known.
+    bool hasFootprint() const { return !dx.isZero() || !dy.isZero(); }
+};
+
 /// @brief A point on a surface along with context about the orientation of the
 /// surface.
 struct SurfaceEvent {
     /// @brief The position of the surface point.
     Point position;
     /// @brief The texture coordinates of the surface for the given position.
-    Point2 uv;
+    TextureCoordinates uv;
 
     Vector shadingNormal;
     Vector geometryNormal;
     Vector tangent;
 
+    /// @brief The derivatives of the position with respect to the texture
+    /// coordinates, or zero if the shape does not provide them.
+    Vector dpdu;
+    Vector dpdv;
+
     /// @brief The probability of sampling the point when doing area sampling,
     /// in area units.
     float pdf;
@@ -990,11 +1045,12 @@ struct Intersection : public SurfaceEvent {
     /// maximum distance when querying intersections.
     float t;
     /**
-     * @brief The probability of having picked the intersected light source
-     * using
-     * @c Scene::sampleLight , or zero if no light source was intersected.
+     * @brief The scene and the origin of the ray that found this intersection,
+     * which are recorded by @c Scene::intersect so that @ref lightProbability
+     * can be computed on demand.
      */
-    float lightProbability;
+    const Scene *scene = nullptr;
+    Point origin;
     /**
      * @brief The background of the scene, only set in case no object was hit
      * and the scene has defined one.
@@ -1010,6 +1066,26 @@ struct Intersection : public SurfaceEvent {
         int primCounter = 0;
     } stats;
 
+    /**
+     * @brief A hit whose surface information has not been computed yet.
+     * Shapes whose surface information is expensive (e.g., triangle meshes)
+     * only record what they need to compute it here, so that it is computed
+     * once for the closest hit (see @ref computeSurface ) instead of for every
+     * hit that is found during traversal.
+     */
+    struct {
+        /// @brief The shape that deferred computing the surface information,
+        /// or null if the surface information is complete.
+        const Shape *shape = nullptr;
+        /// @brief The primitive of the shape that was hit.
+        int primitiveIndex;
+        /// @brief The barycentric coordinates of the hit within the primitive.
+        Vector2 barycentrics;
+        /// @brief The intersection distance in the coordinate system of the
+        /// shape.
+        float t;
+    } deferred;
+
     Intersection(const Vector &wo = Vector(), float t = Infinity)
         : wo(wo), t(t) {}
 
@@ -1019,6 +1095,21 @@ struct Intersection : public SurfaceEvent {
     /// @brief Reports whether an object has been hit.
     explicit operator bool() const { return instance != nullptr; }
 
+    /**
+     * @brief Computes the surface information of a deferred hit (see @ref
+     * deferred ), if any.
+     * @param ray The ray that was passed to the intersect call that found the
+     * hit.
+     */
+    void computeSurface(const Ray &ray);
+
+    /**
+     * @brief Computes the derivatives of the texture coordinates of the hit
+     * (see @ref TextureCoordinates ) from the differentials of the ray, if it
+     * has any. The surface information must already be computed.
+     */
+    void computeDifferentials(const Ray &ray);
+
     /// @brief Evaluates the emission of the underlying instance.
     EmissionEval evaluateEmission() const;
     /// @brief Samples the Bsdf of the underlying surface.
@@ -1026,6 +1117,15 @@ struct Intersection : public SurfaceEvent {
     BsdfEval evaluateBsdf(const Vector &wi) const;
 
     Light *light() const;
+    /**
+     * @brief The probability of having picked the intersected light source
+     * using @c Scene::sampleLight from the origin of the ray, or zero if no
+     * light source was intersected.
+     * @note This is not cached, since only integrators that weight hits of
+     * light sources with multiple importance sampling need it, and the light
+     * hierarchy makes it comparatively expensive to compute.
+     */
+    float lightProbability() const;
 };
 
 template <typename T, int D>
@@ -5,8 +5,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include <lightwave/color.hpp>
 #include <lightwave/logger.hpp>
@@ -19,53 +27,280 @@
 
 namespace lightwave {
 
-static int get_number_of_threads() {
+namespace detail {
+/// @brief The thread count requested via @ref set_number_of_threads , or 0 to
+/// use all available cores.
+inline int requestedNumberOfThreads = 0;
+} // namespace detail
+
+/// @brief The number of threads (including the main thread) that work on
+/// parallel tasks.
+inline int get_number_of_threads() {
 #ifdef SINGLE_THREADED
     return 1;
 #endif
-    return std::thread::hardware_concurrency();
+    if (detail::requestedNumberOfThreads > 0)
+        return detail::requestedNumberOfThreads;
+    return std::max(int(std::thread::hardware_concurrency()), 1);
 }
 
-/// @brief Invokes @c f for each element of the iterator, parallelized across
-/// all available cores.
-template <class ForwardIt, class UnaryFunction>
-void for_each_parallel(ForwardIt first, ForwardIt last, UnaryFunction f) {
-#ifdef SINGLE_THREADED
-    std::for_each(first, last, f);
-    return;
-#endif
+/// @brief Overrides the number of threads used for parallel work. Passing 0
+/// restores the default of using all available cores.
+/// @note Must be called before @ref ThreadPool::global is first used, since
+/// the global pool is never resized.
+inline void set_number_of_threads(int numThreads) {
+    detail::requestedNumberOfThreads = std::max(numThreads, 0);
+}
 
-    std::mutex m_lock;
-
-    const int numThreads = get_number_of_threads();
-    std::vector<std::thread> m_threads;
-    m_threads.reserve(numThreads);
-
-    // build a thread pool
-    for (int i = 0; i < numThreads; i++) {
-        m_threads.emplace_back([&]() {
-            while (true) {
-                m_lock.lock();
-                if (!(first != last)) {
-                    // no more work to do
-                    m_lock.unlock();
-                    break;
-                }
-
-                // grab a work item
-                auto obj = *first;
-                ++first;
-                m_lock.unlock();
-
-                // execute the work item
-                f(obj);
-            }
+/**
+ * @brief A process-wide pool of worker threads that executes tasks submitted
+ * through @ref TaskGroup , @ref parallel_for and @ref for_each_parallel . The
+ * pool is created once and can be used for fine-grained, recursive work (e.g.,
+ * building acceleration structures), since threads waiting for their tasks
+ * help executing pending work instead of blocking.
+ *
+ * Every worker owns a deque of tasks (threads outside of the pool share one
+ * additional deque). Tasks are pushed to and popped from the back of the
+ * deque of the submitting thread, which keeps recursive work local and cache
+ * friendly, while idle threads steal the oldest (and typically largest) tasks
+ * from the front of other deques. Each deque has its own lock, so threads
+ * only contend when they operate on the same deque.
+ */
+class ThreadPool {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    /// @brief One queue per worker, followed by a queue shared by all threads
+    /// that do not belong to the pool.
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+    /// @brief The number of tasks that have been submitted, but not yet
+    /// started.
+    std::atomic<int> m_pending{ 0 };
+    /// @brief The number of workers that are (about to be) waiting for work.
+    std::atomic<int> m_sleeping{ 0 };
+    std::mutex m_sleepMutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+
+    /// @brief The pool the current thread is a worker of, if any.
+    static inline thread_local ThreadPool *s_currentPool = nullptr;
+    /// @brief The index of the queue owned by the current worker thread.
+    static inline thread_local int s_currentQueue = 0;
+
+    /// @brief The queue the current thread pushes to and pops from.
+    int ownQueue() const {
+        return s_currentPool == this ? s_currentQueue : int(m_workers.size());
+    }
+
+    bool popBack(int queue, std::function<void()> &task) {
+        std::lock_guard lock(m_queues[queue]->mutex);
+        auto &tasks = m_queues[queue]->tasks;
+        if (tasks.empty())
+            return false;
+        task = std::move(tasks.back());
+        tasks.pop_back();
+        return true;
+    }
+
+    bool stealFront(int queue, std::function<void()> &task) {
+        std::lock_guard lock(m_queues[queue]->mutex);
+        auto &tasks = m_queues[queue]->tasks;
+        if (tasks.empty())
+            return false;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+        return true;
+    }
+
+    void workerLoop(int index) {
+        s_currentPool  = this;
+        s_currentQueue = index;
+        while (true) {
+            if (runPendingTask())
+                continue;
+
+            std::unique_lock lock(m_sleepMutex);
+            m_sleeping++;
+            m_condition.wait(
+                lock, [this]() { return m_stopping || m_pending > 0; });
+            m_sleeping--;
+            if (m_stopping && m_pending == 0)
+                return;
+        }
+    }
+
+public:
+    /// @brief Spawns a pool in which the given number of threads work on
+    /// tasks, including the thread that waits for them. A pool with a single
+    /// thread therefore has no workers and runs all tasks on the threads
+    /// waiting for them.
+    explicit ThreadPool(int numThreads) {
+        const int numWorkers = std::max(numThreads - 1, 0);
+        for (int i = 0; i <= numWorkers; i++)
+            m_queues.push_back(std::make_unique<Queue>());
+        m_workers.reserve(numWorkers);
+        for (int i = 0; i < numWorkers; i++)
+            m_workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(m_sleepMutex);
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        for (auto &worker : m_workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &)            = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /// @brief The pool shared by all parts of the renderer, which uses
+    /// @ref get_number_of_threads threads.
+    static ThreadPool &global() {
+        static ThreadPool pool{ get_number_of_threads() };
+        return pool;
+    }
+
+    /// @brief The number of threads working on tasks of this pool, i.e., the
+    /// number of workers plus the thread waiting for the tasks.
+    int numThreads() const { return int(m_workers.size()) + 1; }
+
+    /// @brief Enqueues a task to be run by any thread of the pool.
+    void push(std::function<void()> task) {
+        {
+            const int queue = ownQueue();
+            std::lock_guard lock(m_queues[queue]->mutex);
+            m_queues[queue]->tasks.push_back(std::move(task));
+        }
+        m_pending++;
+        if (m_sleeping > 0) {
+            // taking the lock ensures that workers which are about to sleep
+            // do not miss the notification
+            { std::lock_guard lock(m_sleepMutex); }
+            m_condition.notify_one();
+        }
+    }
+
+    /// @brief Runs a single pending task on the calling thread, if one is
+    /// available. Returns whether a task was run.
+    bool runPendingTask() {
+        std::function<void()> task;
+        const int own = ownQueue();
+        bool found    = popBack(own, task);
+        const int numQueues = int(m_queues.size());
+        for (int i = 1; !found && i < numQueues; i++)
+            found = stealFront((own + i) % numQueues, task);
+        if (!found)
+            return false;
+
+        m_pending--;
+        task();
+        return true;
+    }
+
+    /// @brief Blocks until @c done returns true, executing pending tasks of
+    /// the pool in the meantime.
+    template <typename Predicate> void waitUntil(Predicate done) {
+        while (!done()) {
+            if (!runPendingTask())
+                std::this_thread::yield();
+        }
+    }
+};
+
+/**
+ * @brief A set of tasks submitted to a @ref ThreadPool that can be waited on
+ * collectively. Tasks may themselves add further tasks to the group.
+ * @warning Tasks must not throw exceptions.
+ */
+class TaskGroup {
+    ThreadPool &m_pool;
+    /// @brief The number of tasks that have been submitted but not finished.
+    std::atomic<int> m_pending{ 0 };
+
+public:
+    TaskGroup(ThreadPool &pool = ThreadPool::global()) : m_pool(pool) {}
+    ~TaskGroup() { wait(); }
+
+    /// @brief Submits a task to the pool.
+    template <typename F> void run(F &&f) {
+        m_pending++;
+        m_pool.push([this, f = std::forward<F>(f)]() mutable {
+            f();
+            m_pending--;
         });
     }
 
-    // wait until all threads have finished
-    for (auto &thread : m_threads)
-        thread.join();
+    /// @brief Blocks until all tasks of this group have finished, executing
+    /// pending tasks of the pool in the meantime.
+    void wait() {
+        m_pool.waitUntil([this]() { return m_pending == 0; });
+    }
+};
+
+/**
+ * @brief Invokes @c f for each index in [0, count), distributing the indices
+ * across the calling thread and the threads of @c pool . Indices are handed
+ * out through an atomic counter, so no lock is taken per index.
+ * @note The calling thread only works on indices of this loop and then blocks
+ * until the indices still in flight on other threads are done (instead of
+ * picking up unrelated tasks), which keeps the latency low when this is called
+ * from within other tasks.
+ */
+template <typename UnaryFunction>
+void parallel_for(int count, UnaryFunction f,
+                  ThreadPool &pool = ThreadPool::global()) {
+    struct State {
+        UnaryFunction f;
+        int count;
+        std::atomic<int> next{ 0 };
+        std::atomic<int> finished{ 0 };
+
+        State(UnaryFunction f, int count) : f(std::move(f)), count(count) {}
+
+        void work() {
+            int index;
+            while ((index = next++) < count) {
+                f(index);
+                if (++finished == count)
+                    finished.notify_all();
+            }
+        }
+    };
+
+    // the state is shared, since helpers might only start running after this
+    // function has already returned (at which point they find no work left)
+    auto state = std::make_shared<State>(std::move(f), count);
+    const int numHelpers = std::min(pool.numThreads() - 1, count - 1);
+    for (int i = 0; i < numHelpers; i++)
+        pool.push([state]() { state->work(); });
+
+    state->work();
+    // all indices have been handed out, so only those that other threads are
+    // running remain; they finish without our help
+    int finished;
+    while ((finished = state->finished) < count)
+        state->finished.wait(finished);
+}
+
+/// @brief Invokes @c f for each element of the iterator, distributing the
+/// elements across the calling thread and the threads of @c pool . The
+/// elements are collected up front and handed out by index through
+/// @ref parallel_for .
+template <class ForwardIt, class UnaryFunction>
+void for_each_parallel(ForwardIt first, ForwardIt last, UnaryFunction f,
+                       ThreadPool &pool = ThreadPool::global()) {
+    std::vector<std::decay_t<decltype(*first)>> items;
+    for (; first != last; ++first)
+        items.push_back(*first);
+
+    parallel_for(
+        int(items.size()), [&items, &f](int index) { f(items[index]); }, pool);
 }
 
 /// @brief Invokes @c f for each element of the iterator, parallelized across
@@ -115,4 +350,67 @@ inline void atomicAdd(Color &dst, const Color &delta) {
         atomicAdd(dst[channel], delta[channel]);
 }
 
+namespace detail {
+/// @brief The identifier of the next @ref PerThread object.
+inline std::atomic<size_t> nextPerThreadId{ 0 };
+/// @brief The instances of the current thread, indexed by the identifier of
+/// the @ref PerThread object they belong to.
+inline thread_local std::vector<void *> perThreadInstances;
+} // namespace detail
+
+/**
+ * @brief Gives every thread its own instance of @c T , which it can update
+ * without synchronization (e.g., to gather statistics on hot paths). The
+ * instances of all threads are combined through @ref forEach once the threads
+ * are done with them.
+ */
+template <typename T> class PerThread {
+    /// @brief Keeps the instances of different threads on separate cache
+    /// lines.
+    struct alignas(64) Instance {
+        T value{};
+    };
+
+    /// @brief Identifiers are never reused, so threads never find instances
+    /// of destroyed objects.
+    size_t m_id = detail::nextPerThreadId++;
+    mutable std::mutex m_mutex;
+    mutable std::vector<std::unique_ptr<Instance>> m_instances;
+
+    T &create() const {
+        auto &instances = detail::perThreadInstances;
+        if (instances.size() <= m_id)
+            instances.resize(m_id + 1, nullptr);
+
+        std::lock_guard lock(m_mutex);
+        m_instances.push_back(std::make_unique<Instance>());
+        instances[m_id] = &m_instances.back()->value;
+        return m_instances.back()->value;
+    }
+
+public:
+    PerThread() = default;
+    PerThread(const PerThread &)            = delete;
+    PerThread &operator=(const PerThread &) = delete;
+
+    /// @brief Returns the instance of the calling thread, creating it when
+    /// the thread first uses it.
+    T &local() const {
+        const auto &instances = detail::perThreadInstances;
+        if (m_id < instances.size() && instances[m_id])
+            return *static_cast<T *>(instances[m_id]);
+        return create();
+    }
+
+    /// @brief Invokes @c f with the instance of every thread that has used
+    /// this object.
+    /// @warning Must not be called while other threads update their
+    /// instances.
+    template <typename F> void forEach(F &&f) const {
+        std::lock_guard lock(m_mutex);
+        for (const auto &instance : m_instances)
+            f(std::as_const(instance->value));
+    }
+};
+
 } // namespace lightwave
@@ -58,6 +58,10 @@ public:
     /// @brief Finds the closest intersection of the scene for a given ray.
     Intersection intersect(const Ray &ray, Sampler &rng) const;
 
+    /// @brief Tests whether any surface blocks the ray before distance tMax,
+    /// which is cheaper than finding the closest intersection.
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const;
+
     /// @brief Computes what fraction of light makes it through along the ray
     /// until distance tMax.
     float transmittance(const Ray &ray, float tMax, Sampler &rng) const;
@@ -65,8 +69,17 @@ public:
     /// @brief Reports whether at least one light exists that could be sampled.
     bool hasLights() const;
 
-    /// @brief Randomly picks a light from the list of sampleable light sources.
-    LightSample sampleLight(Sampler &rng) const;
+    /**
+     * @brief Randomly picks a light from the list of sampleable light sources,
+     * preferring lights that contribute more to the given point.
+     * @note The probability of picking a light that is hit by a ray is
+     * reported through @ref Intersection::lightProbability , using the origin
+     * of the ray as point.
+     */
+    LightSample sampleLight(const Point &origin, Sampler &rng) const;
+    /// @brief Returns the probability of @ref sampleLight picking the given
+    /// light for the given point.
+    float lightProbability(const Point &origin, const Light *light) const;
     /// @brief Returns the bounding box of the scene geometry.
     Bounds getBoundingBox() const;
 };
@@ -16,6 +16,8 @@
 #include <lightwave/texture.hpp>
 #include <lightwave/transform.hpp>
 
+#include <optional>
+
 namespace lightwave {
 
 /// @brief The result of sampling a random point on a shape's surface via @ref
@@ -46,11 +48,31 @@ public:
     virtual bool intersect(const Ray &ray, Intersection &its,
                            Sampler &rng) const = 0;
 
+    /**
+     * @brief Computes the surface information of a hit for which this shape
+     * only recorded @ref Intersection::deferred in @ref intersect . Callers
+     * use @ref Intersection::computeSurface instead.
+     * @param ray The ray that was passed to intersect.
+     */
+    virtual void computeSurface(const Ray &ray, Intersection &its) const {}
+
+    /**
+     * @brief Tests whether the ray is blocked before distance tMax, e.g., for
+     * shadow rays. Unlike @ref intersect , this may stop at the first hit that
+     * is found (which need not be the closest one), and does not compute any
+     * surface information.
+     */
+    virtual bool occluded(const Ray &ray, float tMax, Sampler &rng) const {
+        Intersection its(-ray.direction, tMax);
+        return intersect(ray, its, rng);
+    }
+
     /**
      * @brief Computes what fraction of light makes it through along the ray
      * until distance tMax.
      * @param rng More complex shapes may require random sampling to determine
      * their transmittance (e.g., heterogeneous volumes with ratio tracking).
+     * @note Random estimates are never negative, but can exceed 1.
      */
     virtual float transmittance(const Ray &ray, float tMax,
                                 Sampler &rng) const {
@@ -82,6 +104,19 @@ public:
         AreaSample sample = sampleArea(rng);
         return sample;
     }
+
+    /// @brief Returns the surface area of the shape, or zero if it is unknown
+    /// (used to estimate the power of area lights).
+    virtual float getSurfaceArea() const { return 0; }
+    /**
+     * @brief Returns the normal that all points on the surface share if the
+     * shape is planar, or nothing if normals could point anywhere. This lets
+     * area lights bound the directions they emit in.
+     * @note The normal must agree with both the geometry and shading normals.
+     */
+    virtual std::optional<Vector> getPlanarNormal() const {
+        return std::nullopt;
+    }
     /**
      * @brief Marks that the shape is part of the scene geometry, i.e., can be
      * hit through @ref Scene::intersect .
@@ -0,0 +1,340 @@
+/**
+ * @file termination.hpp
+ * @brief Contains the policy that path tracers use to decide how long paths
+ * are traced.
+ */
+
+#pragma once
+
+#include <lightwave/color.hpp>
+#include <lightwave/logger.hpp>
+#include <lightwave/math.hpp>
+#include <lightwave/properties.hpp>
+#include <lightwave/sampler.hpp>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief Decides at every vertex of a path whether the path is continued,
+ * terminated early (Russian roulette) or split into several paths. Paths that
+ * survive roulette or are split are reweighted, so that the estimate stays
+ * unbiased. The policy is configured from the properties of the integrator:
+ *
+ * - @c roulette selects the mode: "none" only terminates paths at the maximum
+ *   depth, "throughput" plays Russian roulette with the throughput of the path
+ *   as survival probability, and "adrrs" uses adjoint-driven Russian roulette
+ *   and splitting.
+ * - @c rouletteDepth is the depth of the first vertex at which paths can be
+ *   terminated or split.
+ * - @c maxSplits limits how many paths a vertex can be split into.
+ *
+ * Adjoint-driven Russian roulette and splitting (Vorba and Křivánek, 2016)
+ * compares the expected contribution of a path, i.e., its throughput times an
+ * estimate of the radiance reflected at the vertex, to an estimate of the
+ * pixel it belongs to. Paths that contribute much less than the pixel
+ * estimate are terminated, while paths that contribute much more are split.
+ * The radiance estimate is learned during rendering in a coarse grid over the
+ * scene (@c radianceCacheResolution cells along each axis), and the pixel
+ * estimate is derived from the first vertex of the camera path. Vertices
+ * without any estimate yet fall back to throughput based roulette.
+ *
+ * Paths that are split are continued one after another: @ref decide keeps
+ * the additional paths of a vertex in the @ref Path , and @ref resume picks
+ * them up once the path that is being traced has terminated.
+ *
+ * The average path length is reported after rendering.
+ */
+class PathTermination {
+public:
+    enum class Mode {
+        None,
+        Throughput,
+        Adrrs,
+    };
+
+    /**
+     * @brief The state of a camera path, including all paths that have been
+     * split from it. Integrators obtain it from @ref start and pass it to all
+     * other calls while tracing.
+     */
+    class Path {
+        friend class PathTermination;
+
+        /// @brief A vertex whose reflected radiance will be recorded in the
+        /// radiance cache once the path terminates.
+        struct Vertex {
+            /// @brief The cell of the radiance cache the vertex lies in.
+            int cell;
+            /// @brief The luminance of the path throughput at the vertex.
+            float throughput;
+            /// @brief The luminance of the radiance the camera path had
+            /// accumulated when the vertex was visited.
+            float radiance;
+            /// @brief Compensates for paths that have been split after the
+            /// vertex, whose contributions are not recorded.
+            float scale;
+        };
+
+        /// @brief A path that has been split off at a vertex, and still needs
+        /// to be continued from there.
+        struct Branch {
+            Intersection its;
+            Color throughput;
+            int depth;
+        };
+
+        static constexpr int MaxVertices = 16;
+        std::array<Vertex, MaxVertices> m_vertices;
+        int m_numVertices = 0;
+        /// @brief The estimate of the pixel, or 0 if unknown.
+        float m_pixelEstimate = 0;
+        /// @brief The estimate of the radiance reflected at the last visited
+        /// vertex, or a negative value if unknown.
+        float m_vertexEstimate = -1;
+        /// @brief The number of vertices visited by all paths.
+        int m_length = 0;
+        bool m_isSplit = false;
+        /// @brief The paths that have been split off and are still pending.
+        std::vector<Branch> m_branches;
+    };
+
+private:
+    /// @brief A cell of the radiance cache, which averages the luminance of
+    /// the radiance reflected by all vertices within it.
+    struct Cell {
+        std::atomic<float> sum{ 0 };
+        std::atomic<uint32_t> count{ 0 };
+    };
+
+    /// @brief The smallest probability with which paths survive roulette, to
+    /// keep the weights of surviving paths bounded.
+    static constexpr float MinSurvival = 0.05f;
+
+    Mode m_mode;
+    int m_minDepth;
+    int m_maxSplits;
+    /// @brief The width of the weight window of ADRRS, i.e., the ratio between
+    /// the largest and smallest contribution that paths continue with as is.
+    float m_windowWidth;
+
+    Bounds m_bounds;
+    int m_resolution;
+    /// @brief The cells of the radiance cache, which are updated concurrently
+    /// while rendering.
+    std::unique_ptr<Cell[]> m_cells;
+
+    mutable std::atomic<uint64_t> m_numPaths{ 0 };
+    mutable std::atomic<uint64_t> m_numVertices{ 0 };
+    mutable std::atomic<uint64_t> m_numSplitPaths{ 0 };
+
+    int cellIndex(const Point &position) const {
+        int index = 0;
+        for (int dim = 0; dim < 3; dim++) {
+            const float extent = m_bounds.diagonal()[dim];
+            const float offset =
+                extent > 0 ? (position[dim] - m_bounds.min()[dim]) / extent
+                           : 0;
+            index = index * m_resolution +
+                    clamp(int(offset * m_resolution), 0, m_resolution - 1);
+        }
+        return index;
+    }
+
+    /// @brief The cached reflected radiance of the given cell, or a negative
+    /// value if nothing has been recorded in it yet.
+    float estimate(int cell) const {
+        const uint32_t count = m_cells[cell].count.load(
+            std::memory_order_relaxed);
+        if (count == 0)
+            return -1;
+        return m_cells[cell].sum.load(std::memory_order_relaxed) / count;
+    }
+
+    /// @brief The number of paths that continue from the last visited vertex
+    /// (0 terminates the path), where the throughput is scaled accordingly.
+    int pathCount(Path &path, int depth, Color &throughput,
+                  Sampler &rng) const {
+        if (m_mode == Mode::None || depth < m_minDepth)
+            return 1;
+
+        float survival =
+            min(max(throughput.r(), max(throughput.g(), throughput.b())), 1.f);
+        if (m_mode == Mode::Adrrs && path.m_vertexEstimate >= 0 &&
+            path.m_pixelEstimate > 0) {
+            // the expected contribution relative to the pixel, which the
+            // weight window centers around 1
+            const float ratio = throughput.luminance() *
+                                path.m_vertexEstimate / path.m_pixelEstimate;
+            const float lower = 2 / (1 + m_windowWidth);
+            if (ratio > m_windowWidth * lower) {
+                const int count = min(int(ratio + 0.5f), m_maxSplits);
+                if (count > 1) {
+                    throughput /= float(count);
+                    for (int i = 0; i < path.m_numVertices; i++)
+                        path.m_vertices[i].scale *= float(count);
+                    path.m_isSplit = true;
+                }
+                return count;
+            }
+            survival = ratio < lower ? ratio : 1;
+        }
+
+        if (survival >= 1)
+            return 1;
+        survival = max(survival, MinSurvival);
+        if (rng.next() >= survival)
+            return 0;
+        throughput /= survival;
+        return 1;
+    }
+
+public:
+    /**
+     * @brief Reads the policy from the properties of an integrator.
+     * @param sceneBounds The bounds of the scene, which the radiance cache
+     * covers.
+     */
+    PathTermination(const Properties &properties, const Bounds &sceneBounds) {
+        m_mode        = properties.getEnum<Mode>("roulette",
+                                          Mode::None,
+                                          {
+                                              { "none", Mode::None },
+                                              { "throughput", Mode::Throughput },
+                                              { "adrrs", Mode::Adrrs },
+                                          });
+        m_minDepth    = properties.get<int>("rouletteDepth", 3);
+        m_maxSplits   = properties.get<int>("maxSplits", 4);
+        m_windowWidth = properties.get<float>("splittingWindow", 5);
+        m_resolution  = properties.get<int>("radianceCacheResolution", 16);
+        m_bounds      = sceneBounds;
+
+        if (m_mode == Mode::Adrrs && !m_bounds.isUnbounded() &&
+            m_resolution > 0) {
+            m_cells = std::make_unique<Cell[]>(
+                size_t(m_resolution) * m_resolution * m_resolution);
+        }
+    }
+
+    /// @brief Starts tracking a new camera path.
+    Path start() const { return {}; }
+
+    /**
+     * @brief Tracks a vertex that has been found by the path, which needs to
+     * be called before @ref decide .
+     * @param throughput The throughput of the path at the vertex.
+     * @param result The radiance that has been accumulated by the camera path
+     * so far, including the emission of the vertex.
+     */
+    void visit(Path &path, const Point &position, const Color &throughput,
+               const Color &result) const {
+        path.m_length++;
+        path.m_vertexEstimate = -1;
+        if (!m_cells)
+            return;
+
+        const int cell        = cellIndex(position);
+        path.m_vertexEstimate = estimate(cell);
+        if (path.m_length == 1) {
+            path.m_pixelEstimate =
+                result.luminance() +
+                throughput.luminance() * max(path.m_vertexEstimate, 0.f);
+        }
+
+        const float throughputLuminance = throughput.luminance();
+        if (path.m_numVertices < Path::MaxVertices && throughputLuminance > 0) {
+            path.m_vertices[path.m_numVertices++] = {
+                .cell       = cell,
+                .throughput = throughputLuminance,
+                .radiance   = result.luminance(),
+                .scale      = 1,
+            };
+        }
+    }
+
+    /**
+     * @brief Decides whether the path continues from the last visited vertex
+     * @c its , and scales the throughput accordingly. If the path is split,
+     * the additional paths are kept in @c path until they are picked up by
+     * @ref resume , and all of them continue with the scaled throughput.
+     * @param depth The depth of the vertex (0 for the first hit).
+     * @return Whether the path continues, or has been terminated.
+     */
+    bool decide(Path &path, const Intersection &its, int depth,
+                Color &throughput, Sampler &rng) const {
+        const int count = pathCount(path, depth, throughput, rng);
+        for (int i = 1; i < count; i++)
+            path.m_branches.push_back({ its, throughput, depth });
+        return count > 0;
+    }
+
+    /**
+     * @brief Continues with a path that has been split off, if any, once the
+     * path that was traced before has terminated.
+     * @param scatter Continues a path from the intersection it was split off
+     * at (by sampling the Bsdf), and returns false if that failed, in which
+     * case the next pending path is tried.
+     * @param throughput Set to the throughput of the resumed path.
+     * @param depth Set to the depth of the vertex the resumed path continues
+     * with.
+     * @return Whether a path has been resumed.
+     */
+    template <typename Scatter>
+    bool resume(Path &path, Color &throughput, int &depth,
+                Scatter &&scatter) const {
+        while (!path.m_branches.empty()) {
+            const Path::Branch branch = path.m_branches.back();
+            path.m_branches.pop_back();
+            throughput = branch.throughput;
+            depth      = branch.depth + 1;
+            if (scatter(branch.its))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Records the reflected radiance of the vertices of a path that
+     * has terminated (but not of paths that have been split from it and are
+     * still pending).
+     * @param result The radiance accumulated by the camera path so far.
+     */
+    void terminate(Path &path, const Color &result) const {
+        const float radiance = result.luminance();
+        for (int i = 0; i < path.m_numVertices; i++) {
+            const Path::Vertex &vertex = path.m_vertices[i];
+            const float reflected      = (radiance - vertex.radiance) *
+                                    vertex.scale / vertex.throughput;
+            m_cells[vertex.cell].sum.fetch_add(reflected,
+                                               std::memory_order_relaxed);
+            m_cells[vertex.cell].count.fetch_add(1, std::memory_order_relaxed);
+        }
+        path.m_numVertices = 0;
+    }
+
+    /// @brief Adds the statistics of a camera path that has completely
+    /// terminated (including all paths split from it).
+    void finish(const Path &path) const {
+        m_numPaths.fetch_add(1, std::memory_order_relaxed);
+        m_numVertices.fetch_add(path.m_length, std::memory_order_relaxed);
+        if (path.m_isSplit)
+            m_numSplitPaths.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @brief Logs the average length of all finished camera paths.
+    void report() const {
+        const uint64_t numPaths = m_numPaths.load();
+        if (numPaths == 0)
+            return;
+        logger(EInfo,
+               "average path length: %.2f vertices (%.1f%% of paths split)",
+               double(m_numVertices.load()) / numPaths,
+               100.0 * m_numSplitPaths.load() / numPaths);
+    }
+};
+
+} // namespace lightwave
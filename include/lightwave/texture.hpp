@@ -9,6 +9,7 @@
 #include <lightwave/color.hpp>
 #include <lightwave/core.hpp>
 #include <lightwave/math.hpp>
+#include <lightwave/texturecache.hpp>
 
 namespace lightwave {
 
@@ -19,15 +20,16 @@ public:
     /**
      * @brief Returns the color at a given texture coordinate.
      * For most applications, the input point will lie in the unit square
-     * [0,1)^2, but points outside this domain are also allowed.
+     * [0,1)^2, but points outside this domain are also allowed. Textures may
+     * filter over the footprint of the lookup, if it is known.
      */
-    virtual Color evaluate(const Point2 &uv) const = 0;
+    virtual Color evaluate(const TextureCoordinates &uv) const = 0;
     /**
      * @brief Returns a scalar value at a given texture coordinate.
      * For most applications, the input point will lie in the unit square
      * [0,1)^2, but points outside this domain are also allowed.
      */
-    virtual float scalar(const Point2 &uv) const {
+    virtual float scalar(const TextureCoordinates &uv) const {
         // arbitrary mapping from RGB images to scalar values (typically those
         // will be grayscale anyway and we would ideally have a separate texture
         // interface for scalar values)
@@ -35,6 +37,21 @@ public:
     }
 };
 
+/**
+ * @brief A texture backed by an image. Besides nearest and bilinear lookups in
+ * the image itself, the texture can filter over the footprint of lookups with
+ * a MIP pyramid: "trilinear" filters isotropically by blending bilinear
+ * lookups in the two closest levels, and "ewa" filters anisotropically with an
+ * elliptically weighted average, whose eccentricity is limited by
+ * @c maxAnisotropy . Lookups without footprint (see @ref TextureCoordinates )
+ * fall back to bilinear lookups in the image.
+ *
+ * Images loaded from a file are not decoded up front, but converted to a
+ * @ref TiledImage whose tiles are loaded on demand through the shared
+ * @ref TextureCache . Setting @c cache to false keeps the converted tiles in
+ * memory instead of writing them to a tile file. Images given as child objects
+ * stay in memory, and their MIP pyramid is only built for filters that use it.
+ */
 class ImageTexture : public Texture {
     enum class BorderMode {
         Clamp,
@@ -44,23 +61,48 @@ class ImageTexture : public Texture {
     enum class FilterMode {
         Nearest,
         Bilinear,
+        Trilinear,
+        EWA,
     };
 
-    ref<Image> m_image;
+    /// @brief The tiles of the image if it has been loaded from a file.
+    std::unique_ptr<TiledImage> m_tiles;
     float m_exposure;
     BorderMode m_border;
     FilterMode m_filter;
+    float m_maxAnisotropy;
+
+    /// @brief The MIP pyramid of images given as child object, starting with
+    /// the image itself, where each level halves the resolution of the
+    /// previous one down to a single pixel.
+    std::vector<ref<Image>> m_levels;
+
+    void buildPyramid();
+
+    int levels() const {
+        return m_tiles ? m_tiles->levels() : int(m_levels.size());
+    }
+    Point2i resolution(int level) const;
+    /// @brief Returns a pixel of a level, handling pixels outside the image
+    /// according to the border mode.
+    Color texel(int level, Point2i pixel) const;
+    Color bilinear(int level, const Point2 &uv) const;
+    Color trilinear(const TextureCoordinates &uv) const;
+    Color ewa(const TextureCoordinates &uv) const;
+    /// @brief Filters a single level with an elliptical Gaussian spanned by
+    /// the two axes (in texture coordinates).
+    Color ewa(int level, const Point2 &uv, const Vector2 &axis0,
+              const Vector2 &axis1) const;
 
 public:
     ImageTexture(const Properties &properties);
 
-    Color evaluate(const Point2 &uv) const override;
+    Color evaluate(const TextureCoordinates &uv) const override;
 
     std::string toString() const override;
 
-    const Image* getImage() const {
-        return m_image.get();
-    }
+    /// @brief Returns the resolution of the image.
+    Point2i resolution() const { return resolution(0); }
 };
 
 } // namespace lightwave
@@ -0,0 +1,196 @@
+/**
+ * @file texturecache.hpp
+ * @brief Contains the TextureCache, which loads the tiles of image textures on
+ * demand and keeps the recently used ones in memory.
+ */
+
+#pragma once
+
+#include <lightwave/color.hpp>
+#include <lightwave/core.hpp>
+#include <lightwave/math.hpp>
+
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace lightwave {
+
+/**
+ * @brief An image that is stored as square tiles of all levels of its MIP
+ * pyramid, which are loaded on demand through the @ref TextureCache .
+ *
+ * The image is converted to this format once and stored in a tile file with
+ * the extension ".tiles" (or ".linear.tiles" for images in linear space), see
+ * @ref convertedFilePath for where it is placed. Only the header of the tile
+ * file is read whenever the image is opened again. If the tile file cannot (or
+ * must not) be written, the converted tiles are kept in memory.
+ */
+class TiledImage {
+public:
+    /// @brief The number of pixels along each edge of a tile.
+    static constexpr int TileSize = 64;
+    static constexpr int TilePixels = TileSize * TileSize;
+
+    /// @brief Opens the tile file of an image, converting the image first if
+    /// there is no tile file yet or it is outdated. Without @c storeTiles ,
+    /// the image is always converted and kept in memory.
+    TiledImage(const std::filesystem::path &path, bool isLinearSpace,
+               bool storeTiles = true);
+    ~TiledImage();
+
+    TiledImage(const TiledImage &)            = delete;
+    TiledImage &operator=(const TiledImage &) = delete;
+
+    /// @brief Returns the number of levels of the MIP pyramid.
+    int levels() const { return int(m_levels.size()); }
+    /// @brief Returns the resolution of a level of the MIP pyramid.
+    const Point2i &resolution(int level) const {
+        return m_levels[level].resolution;
+    }
+
+    /**
+     * @brief Returns the color of a pixel of a level of the MIP pyramid,
+     * loading its tile if it is not in the cache yet.
+     * @warning Pixel coordinates outside the level result in undefined
+     * behavior!
+     */
+    Color texel(int level, const Point2i &pixel) const;
+
+    const std::filesystem::path &path() const { return m_path; }
+
+private:
+    friend class TextureCache;
+
+    /// @brief The header of a tile file, which is followed by a @ref Level
+    /// for each level of the MIP pyramid and then the tiles of all levels.
+    struct TileHeader {
+        char magic[8];
+        uint32_t version;
+        int32_t tileSize;
+        int32_t levelCount;
+        /// @brief The size of the image that has been converted.
+        uint64_t sourceSize;
+        /// @brief The modification time of the image that has been converted,
+        /// which tells whether the tile file is outdated.
+        int64_t sourceTime;
+    };
+
+    struct Level {
+        Point2i resolution;
+        /// @brief The number of tiles along each axis.
+        Point2i tiles;
+        /// @brief The offset of the first tile in the tile file, after which
+        /// tiles are stored row by row.
+        uint64_t offset;
+    };
+
+    static constexpr char TileMagic[8] = "lw-tile";
+    /// @brief Increment this whenever the file format changes, which
+    /// invalidates all existing tile files.
+    static constexpr uint32_t TileVersion = 1;
+
+    std::filesystem::path m_path;
+    /// @brief Identifies the tiles of this image in the cache. Identifiers are
+    /// never reused, so stale tiles of destroyed images are never returned.
+    uint32_t m_id;
+    std::vector<Level> m_levels;
+
+    /// @brief The tile file, unless it could not be written.
+    mutable std::ifstream m_file;
+    mutable std::mutex m_fileMutex;
+    /// @brief The converted tile file if it could not be written.
+    std::vector<uint8_t> m_buffer;
+
+    static std::vector<uint8_t> convert(const std::filesystem::path &path,
+                                        bool isLinearSpace,
+                                        uint64_t sourceSize,
+                                        int64_t sourceTime);
+    /// @brief Reads the header and levels of a tile file.
+    /// @return Whether the tile file is valid and has been converted from the
+    /// given image.
+    bool open(std::istream &stream, uint64_t size, uint64_t sourceSize,
+              int64_t sourceTime);
+    /// @brief Reads the pixels of a tile from the tile file.
+    void readTile(int level, int tile, Color *pixels) const;
+};
+
+/**
+ * @brief Keeps the tiles of @ref TiledImage s in memory once they have been
+ * used, and evicts the least recently used tiles once the memory they occupy
+ * exceeds the budget (see @ref setBudget ).
+ *
+ * Each thread additionally remembers the tiles it used last, which spares it
+ * locking the cache for most lookups. @ref report logs how many lookups found
+ * their tile in memory and how much memory the tiles occupy.
+ */
+class TextureCache {
+public:
+    using Tile = std::array<Color, TiledImage::TilePixels>;
+
+    /// @brief Counts the lookups of a single thread. Only that thread updates
+    /// the counters, while @ref report reads them.
+    struct alignas(64) LookupCounters {
+        std::atomic<uint64_t> lookups{ 0 };
+        /// @brief The lookups answered by the tiles the thread remembers.
+        std::atomic<uint64_t> hits{ 0 };
+    };
+
+private:
+    struct Entry {
+        std::shared_ptr<const Tile> tile;
+        std::list<uint64_t>::iterator lru;
+    };
+
+    std::mutex m_mutex;
+    std::unordered_map<uint64_t, Entry> m_tiles;
+    /// @brief The keys of all tiles in memory, most recently used first.
+    std::list<uint64_t> m_lru;
+    size_t m_budget = size_t(512) << 20;
+    size_t m_residentBytes = 0;
+    size_t m_peakBytes     = 0;
+    /// @brief The lookups that found their tile in memory, but not among the
+    /// tiles their thread remembers.
+    uint64_t m_hits = 0;
+    /// @brief The counters of all threads that have looked up tiles.
+    std::vector<std::shared_ptr<const LookupCounters>> m_threadCounters;
+
+    std::atomic<uint32_t> m_nextId{ 0 };
+    std::atomic<uint64_t> m_loads{ 0 };
+
+    void evict();
+
+public:
+    /// @brief The cache shared by all image textures.
+    static TextureCache &global() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    /// @brief Sets the amount of memory in bytes that tiles may occupy.
+    void setBudget(size_t bytes);
+
+    /// @brief Returns a new identifier for the tiles of an image.
+    uint32_t allocateId() { return m_nextId++; }
+
+    /// @brief Returns the counters through which a thread reports its
+    /// lookups, which @ref report includes from then on.
+    std::shared_ptr<LookupCounters> registerThread();
+
+    /// @brief Returns a tile of an image, loading it if it is not in memory.
+    std::shared_ptr<const Tile> tile(const TiledImage &image, int level,
+                                     int index);
+
+    /// @brief Evicts all tiles of an image (e.g., when it is destroyed).
+    void release(const TiledImage &image);
+
+    /// @brief Logs the hit rate of the cache and how much memory the tiles
+    /// occupy, if any tiles have been used.
+    void report();
+};
+
+} // namespace lightwave
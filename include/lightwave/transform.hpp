@@ -52,6 +52,12 @@ public:
         Ray result(ray);
         result.origin    = apply(ray.origin);
         result.direction = apply(ray.direction);
+        if (ray.hasDifferentials) {
+            result.dxOrigin    = apply(ray.dxOrigin);
+            result.dxDirection = apply(ray.dxDirection);
+            result.dyOrigin    = apply(ray.dyOrigin);
+            result.dyDirection = apply(ray.dyDirection);
+        }
         return result;
     }
 
@@ -75,6 +81,12 @@ public:
         Ray result(ray);
         result.origin    = inverse(ray.origin);
         result.direction = inverse(ray.direction);
+        if (ray.hasDifferentials) {
+            result.dxOrigin    = inverse(ray.dxOrigin);
+            result.dxDirection = inverse(ray.dxDirection);
+            result.dyOrigin    = inverse(ray.dyOrigin);
+            result.dyDirection = inverse(ray.dyDirection);
+        }
         return result;
     }
 
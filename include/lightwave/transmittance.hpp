@@ -0,0 +1,212 @@
+/**
+ * @file transmittance.hpp
+ * @brief Contains the estimators that volumes use to compute the transmittance
+ * of shadow rays.
+ */
+
+#pragma once
+
+#include <lightwave/logger.hpp>
+#include <lightwave/math.hpp>
+#include <lightwave/parallel.hpp>
+#include <lightwave/properties.hpp>
+#include <lightwave/sampler.hpp>
+
+namespace lightwave {
+
+/// @brief A segment of a ray through a volume, together with bounds of the
+/// extinction coefficient within it.
+struct VolumeSegment {
+    float tMin;
+    float tMax;
+    /// @brief An upper bound of the extinction coefficient in the segment.
+    float majorant;
+    /// @brief A lower bound of the extinction coefficient in the segment.
+    float minorant;
+};
+
+/**
+ * @brief Estimates the transmittance along a ray through a volume from
+ * tentative collisions, which are sampled with the majorants of the segments
+ * that the volume divides the ray into. Volumes read the estimator from their
+ * properties:
+ *
+ * - @c transmittance selects the estimator: "ratio" for ratio tracking,
+ *   "residual" for residual ratio tracking, and "nextflight" for the
+ *   next-flight estimator.
+ * - @c controlDensity is the density that residual ratio tracking accounts for
+ *   analytically. By default, the control is the minorant of each segment.
+ *
+ * Ratio tracking weights the estimate at every tentative collision by the
+ * probability of the collision being null. Residual ratio tracking (Novák et
+ * al., 2014) integrates the control extinction analytically, and only samples
+ * collisions for the residual between the extinction and the control. The
+ * next-flight estimator (Cramer, 1978) adds up the probability of the next
+ * flight leaving the volume without collision after every tentative collision.
+ * All estimators play Russian roulette once their weight drops below 0.1.
+ *
+ * When @ref report is called, the estimator logs the mean and variance of its
+ * estimates across all shadow rays, and how many density lookups they needed.
+ * All estimators are unbiased, so differences in variance between them come
+ * from the estimators alone.
+ */
+class TransmittanceEstimator {
+public:
+    enum class Mode {
+        Ratio,
+        ResidualRatio,
+        NextFlight,
+    };
+
+private:
+    Mode m_mode;
+    /// @brief The control extinction of residual ratio tracking, or a
+    /// negative value to use the minorant of each segment.
+    float m_control;
+
+    struct Statistics {
+        uint64_t numEstimates = 0;
+        uint64_t numLookups   = 0;
+        double sum            = 0;
+        double sumOfSquares   = 0;
+    };
+    /// @brief Gathered per thread, since shadow rays of all threads pass
+    /// through the same estimator.
+    PerThread<Statistics> m_statistics;
+
+    /// @brief Plays Russian roulette with the weight of a path through the
+    /// volume once it is small. Weights never become negative: the sampling
+    /// rate bounds the residual |extinction - control| from above, so every
+    /// collision scales the weight by a factor in [0, 2].
+    /// @return Whether the path survives.
+    static bool survive(float &weight, Sampler &rng) {
+        if (weight >= 0.1f)
+            return true;
+        const float q = std::max(0.05f, 1.f - weight);
+        if (rng.next() < q) {
+            weight = 0;
+            return false;
+        }
+        weight /= 1 - q;
+        return true;
+    }
+
+public:
+    /**
+     * @brief Reads the estimator from the properties of a volume.
+     * @param defaultMode The estimator to use if none is given.
+     * @param extinctionScale The factor that converts the density given by
+     * @c controlDensity into an extinction coefficient.
+     */
+    TransmittanceEstimator(const Properties &properties, Mode defaultMode,
+                           float extinctionScale) {
+        m_mode    = properties.getEnum<Mode>("transmittance",
+                                          defaultMode,
+                                          {
+                                              { "ratio", Mode::Ratio },
+                                              { "residual", Mode::ResidualRatio },
+                                              { "nextflight", Mode::NextFlight },
+                                          });
+        m_control = properties.get<float>("controlDensity", -1);
+        if (m_control >= 0)
+            m_control *= extinctionScale;
+    }
+
+    /**
+     * @brief Estimates the transmittance along a ray.
+     * @param traverse Calls its argument with the @ref VolumeSegment s along
+     * the ray in order, until the argument returns false.
+     * @param extinction Returns the extinction coefficient at a distance along
+     * the ray.
+     */
+    template <typename Traverse, typename Extinction>
+    float estimate(Traverse &&traverse, Extinction &&extinction,
+                   Sampler &rng) const {
+        // the optical depth (with respect to the majorants) along the ray
+        float totalDepth = 0;
+        if (m_mode == Mode::NextFlight) {
+            traverse([&](const VolumeSegment &segment) {
+                totalDepth += segment.majorant * (segment.tMax - segment.tMin);
+                return true;
+            });
+        }
+
+        float weight = 1;
+        // the sum of the next-flight estimator, which starts with the
+        // probability of not colliding at all
+        float sum = std::exp(-totalDepth);
+        float depth = 0;
+        float tau = -std::log(1.f - rng.next());
+        uint64_t lookups = 0;
+        traverse([&](const VolumeSegment &segment) {
+            float control = 0, rate = segment.majorant;
+            if (m_mode == Mode::ResidualRatio) {
+                control = m_control >= 0 ? m_control : segment.minorant;
+                rate = std::max(segment.majorant - control,
+                                control - segment.minorant);
+                weight *= std::exp(-control * (segment.tMax - segment.tMin));
+            }
+
+            float t = segment.tMin;
+            while (rate > 0) {
+                if (tau >= rate * (segment.tMax - t)) {
+                    tau -= rate * (segment.tMax - t);
+                    break;
+                }
+                t += tau / rate;
+                lookups++;
+                weight *= 1.f - (extinction(t) - control) / rate;
+                if (m_mode == Mode::NextFlight) {
+                    sum += weight *
+                           std::exp(depth + rate * (t - segment.tMin) -
+                                    totalDepth);
+                }
+                if (!survive(weight, rng))
+                    return false;
+                tau = -std::log(1.f - rng.next());
+            }
+            depth += rate * (segment.tMax - segment.tMin);
+            return true;
+        });
+
+        // the weights are non-negative by construction (see @ref survive), so
+        // this only guards against rounding errors
+        const float result =
+            std::max(m_mode == Mode::NextFlight ? sum : weight, 0.f);
+        Statistics &statistics = m_statistics.local();
+        statistics.numEstimates++;
+        statistics.numLookups += lookups;
+        statistics.sum += result;
+        statistics.sumOfSquares += double(result) * result;
+        return result;
+    }
+
+    /// @brief Logs the statistics of all estimates so far.
+    /// @param name Identifies the volume in the log.
+    void report(const std::string &name) const {
+        Statistics total;
+        m_statistics.forEach([&](const Statistics &statistics) {
+            total.numEstimates += statistics.numEstimates;
+            total.numLookups += statistics.numLookups;
+            total.sum += statistics.sum;
+            total.sumOfSquares += statistics.sumOfSquares;
+        });
+        const uint64_t numEstimates = total.numEstimates;
+        if (numEstimates == 0)
+            return;
+        const double mean = total.sum / numEstimates;
+        logger(EInfo,
+               "%s transmittance (%s): %d shadow rays, mean %.4f, variance "
+               "%.4f, %.2f density lookups per ray",
+               name,
+               m_mode == Mode::Ratio           ? "ratio tracking"
+               : m_mode == Mode::ResidualRatio ? "residual ratio tracking"
+                                               : "next flight",
+               numEstimates,
+               mean,
+               total.sumOfSquares / numEstimates - mean * mean,
+               double(total.numLookups) / numEstimates);
+    }
+};
+
+} // namespace lightwave
@@ -10,7 +10,7 @@ public:
         m_reflectance = properties.get<Texture>("reflectance");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {
         // the probability of a light sample picking exactly the direction `wi'
         // that results from reflecting `wo' is zero, hence we can just ignore
@@ -18,7 +18,7 @@ public:
         return BsdfEval::invalid();
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         // NOT_IMPLEMENTED
         Vector wi    = Vector(-wo.x(), -wo.y(), wo.z());
@@ -34,6 +34,8 @@ public:
             indent(m_reflectance));
     }
 
+    bool isDelta() const override { return true; }
+
     Color getAlbedo(const Intersection &its) const override {
         return m_reflectance->evaluate(its.uv);
     }
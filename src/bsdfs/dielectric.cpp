@@ -15,7 +15,7 @@ public:
         m_transmittance = properties.get<Texture>("transmittance");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {
         // the probability of a light sample picking exactly the direction `wi'
         // that results from reflecting or refracting `wo' is zero, hence we can
@@ -23,7 +23,7 @@ public:
         return BsdfEval::invalid();
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         // NOT_IMPLEMENTED
         float cosTheta_o = Frame::cosTheta(wo);
@@ -52,6 +52,8 @@ public:
         }
     }
 
+    bool isDelta() const override { return true; }
+
     Color getAlbedo(const Intersection &its) const override {
         return m_transmittance->evaluate(its.uv);
     }
@@ -10,7 +10,7 @@ public:
         m_albedo = properties.get<Texture>("albedo");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {
         if (!Frame::sameHemisphere(wi, wo))
             return BsdfEval::invalid();
@@ -18,7 +18,7 @@ public:
                          Frame::cosTheta(wi), abs(wi.z()) * InvPi };
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         // uniform
         // Vector wi = squareToUniformHemisphere(rng.next2D());
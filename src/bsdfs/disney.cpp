@@ -272,7 +272,7 @@ public:
         m_eta = properties.get<float>("eta", 1.5f);
     }
 
-    Combination combine(const Point2 &uv, const Vector &wo) const {
+    Combination combine(const TextureCoordinates &uv, const Vector &wo) const {
         const auto baseColor = m_baseColor? m_baseColor->evaluate(uv) : Color::white();
         const auto roughness = m_roughness? m_roughness->scalar(uv) : 0.f;
         const auto subsurface = m_subsurface? m_subsurface->scalar(uv) : 0.f;
@@ -321,7 +321,7 @@ public:
         };
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {
         const auto specularTrans = m_specularTrans? m_specularTrans->scalar(uv) : 0.f;
         const auto metallic = m_metallic? m_metallic->scalar(uv) : 0.f;
@@ -363,7 +363,7 @@ public:
         return BsdfEval { f_disney, pdf };
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         const auto specularTrans = m_specularTrans? m_specularTrans->scalar(uv) : 0.f;
         const auto metallic = m_metallic? m_metallic->scalar(uv) : 0.f;
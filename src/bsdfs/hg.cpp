@@ -12,14 +12,14 @@ public:
         m_albedo = properties.get<Color>("albedo");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {
         float g2 = m_g * m_g;
         float pdf =  Inv4Pi * (1.f - g2) / pow(1.f + g2 + 2.f * m_g * wi.dot(wo), 1.5f);
         return BsdfEval{ m_albedo * pdf, pdf};
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         float u = rng.next(), v = rng.next();
         float phi = 2.f * Pi * u;
@@ -84,7 +84,7 @@ class Principled : public Bsdf {
         MetallicLobe metallic;
     };
 
-    Combination combine(const Point2 &uv, const Vector &wo) const {
+    Combination combine(const TextureCoordinates &uv, const Vector &wo) const {
         const auto baseColor = m_baseColor->evaluate(uv);
         const auto alpha     = max(float(1e-3), sqr(m_roughness->scalar(uv)));
         const auto specular  = m_specular->scalar(uv);
@@ -119,7 +119,7 @@ public:
         m_specular  = properties.get<Texture>("specular");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {
         PROFILE("Principled")
 
@@ -133,7 +133,7 @@ public:
         // combine their results
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         PROFILE("Principled")
 
@@ -126,7 +126,7 @@ class PrincipledClearcoat : public Bsdf {
         ClearcoatLobe clearcoat;
     };
 
-    Combination combine(const Point2 &uv, const Vector &wo) const {
+    Combination combine(const TextureCoordinates &uv, const Vector &wo) const {
         const auto baseColor = m_baseColor->evaluate(uv);
         const auto alpha     = max(float(1e-3), sqr(m_roughness->scalar(uv)));
         const auto specular  = m_specular->scalar(uv);
@@ -173,7 +173,7 @@ public:
         m_clearcoatGloss = properties.get<Texture>("clearcoatGloss");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {
         PROFILE("Principled")
 
@@ -190,7 +190,7 @@ public:
                  combination.clearcoat.evaluate(wo, wi).pdf * combination.clearcoatSelectionProb };
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         PROFILE("PrincipledClearCoat")
 
@@ -14,7 +14,7 @@ public:
         m_roughness   = properties.get<Texture>("roughness");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {
         // Using the squared roughness parameter results in a more gradual
         // transition from specular to rough. For numerical stability, we avoid
@@ -36,7 +36,7 @@ public:
         // * the microfacet normal can be computed from `wi' and `wo'
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         const auto alpha = max(float(1e-3), sqr(m_roughness->scalar(uv)));
 
@@ -18,7 +18,7 @@ public:
         m_roughness     = properties.get<Texture>("roughness");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+    BsdfEval evaluate(const TextureCoordinates &uv, const Vector &wo,
                       const Vector &wi) const override {      
         const auto alpha = max(float(1e-3), sqr(m_roughness->scalar(uv)));
                         
@@ -59,7 +59,7 @@ public:
         return BsdfEval{ value, pdf };
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
+    BsdfSample sample(const TextureCoordinates &uv, const Vector &wo,
                       Sampler &rng) const override {
         const auto alpha = max(float(1e-3), sqr(m_roughness->scalar(uv)));
         float eta = m_ior->scalar(uv);
@@ -51,6 +51,13 @@ public:
         Vector z   = Vector(0.0, 0.0, 1.0);
         Vector dir = z + normalized.x() * s_x + normalized.y() * s_y;
         Ray r      = Ray(Point(0.f), dir.normalized());
+
+        // the rays through the neighboring pixels
+        r.hasDifferentials = true;
+        r.dxOrigin = r.dyOrigin = r.origin;
+        r.dxDirection = dir + 2.f / m_resolution.x() * s_x;
+        r.dyDirection = dir + 2.f / m_resolution.y() * s_y;
+
         r          = m_transform->apply(r);
         return CameraSample{ r.normalized(), Color(1.0) };
     }
@@ -60,6 +60,23 @@ public:
             dir = (pFocus - origin).normalized();
         }
         Ray r(origin, dir);
+
+        // the rays through the neighboring pixels, which pass through the
+        // same point on the lens
+        r.hasDifferentials = true;
+        const Vector dirX  = z + (normalized.x() + 2.f / m_resolution.x()) * s_x +
+                            normalized.y() * s_y;
+        const Vector dirY  = z + normalized.x() * s_x +
+                            (normalized.y() + 2.f / m_resolution.y()) * s_y;
+        r.dxOrigin = r.dyOrigin = origin;
+        if (m_lensRadius > 0) {
+            r.dxDirection = dirX * (m_focalDistance / dirX.z()) - Vector(origin);
+            r.dyDirection = dirY * (m_focalDistance / dirY.z()) - Vector(origin);
+        } else {
+            r.dxDirection = dirX;
+            r.dyDirection = dirY;
+        }
+
         r = m_transform->apply(r);
         return CameraSample{ r.normalized(), throughput };
     }
@@ -12,7 +12,12 @@ CameraSample Camera::sample(const Point2i &pixel, Sampler &rng) const {
     const auto normalized =
         2 * pixelPlusRandomOffset / m_resolution.cast<float>() - Vector2(1);
     // generate the sample using the normalized sample function
-    const auto cameraSample = sample(normalized, rng);
+    auto cameraSample = sample(normalized, rng);
+    // each of the samples of a pixel only covers a fraction of it
+    if (cameraSample.ray.hasDifferentials && rng.samplesPerPixel() > 1) {
+        cameraSample.ray.scaleDifferentials(
+            1 / std::sqrt(float(rng.samplesPerPixel())));
+    }
     assert_normalized(cameraSample.ray.direction, {
         logger(EError,
                "  your Camera::sample() implementation returned a "
@@ -1,5 +1,6 @@
 #include <lightwave/core.hpp>
 #include <lightwave/image.hpp>
+#include <lightwave/parallel.hpp>
 #include <lightwave/registry.hpp>
 
 #include <stb_image.h>
@@ -55,6 +56,27 @@ void Image::loadImage(const std::filesystem::path &path, bool isLinearSpace) {
     }
 }
 
+ref<Image> Image::downsample() const {
+    const Point2i res(std::max(1, m_resolution.x() / 2),
+                      std::max(1, m_resolution.y() / 2));
+    auto result = std::make_shared<Image>(res);
+    parallel_for(res.y(), [&](int y) {
+        const int y0 = y * m_resolution.y() / res.y();
+        const int y1 = ((y + 1) * m_resolution.y() + res.y() - 1) / res.y();
+        for (int x = 0; x < res.x(); x++) {
+            const int x0 = x * m_resolution.x() / res.x();
+            const int x1 =
+                ((x + 1) * m_resolution.x() + res.x() - 1) / res.x();
+            Color sum(0.f);
+            for (int sy = y0; sy < y1; sy++)
+                for (int sx = x0; sx < x1; sx++)
+                    sum += (*this)(Point2i(sx, sy));
+            result->get(Point2i(x, y)) = sum / float((x1 - x0) * (y1 - y0));
+        }
+    });
+    return result;
+}
+
 void Image::saveAt(const std::filesystem::path &path, float norm) const {
     if (resolution().isZero()) {
         logger(EWarn, "cannot save empty image %s!", path);
@@ -79,6 +101,14 @@ void Image::saveAt(const std::filesystem::path &path, float norm) const {
         .value = reinterpret_cast<unsigned char *>(log.data()),
         .size  = int(log.size()),
     });
+    for (const auto &[key, value] : m_metadata) {
+        EXRAttribute &attribute = customAttributes.emplace_back();
+        std::snprintf(attribute.name, sizeof(attribute.name), "%s", key.c_str());
+        std::snprintf(attribute.type, sizeof(attribute.type), "string");
+        attribute.value =
+            reinterpret_cast<unsigned char *>(const_cast<char *>(value.data()));
+        attribute.size = int(value.size());
+    }
 
     // MARK: Create EXR header
 
@@ -11,6 +11,8 @@ void Instance::transformFrame(SurfaceEvent &surf, const Vector &wo) const {
     surf.geometryNormal =
         m_transform->applyNormal(surf.geometryNormal).normalized();
     surf.tangent = m_transform->apply(surf.tangent).normalized();
+    surf.dpdu    = m_transform->apply(surf.dpdu);
+    surf.dpdv    = m_transform->apply(surf.dpdv);
     if (m_normal) {
         Vector local_normal = (m_normal->evaluate(surf.uv)).data();
         Vector normal =
@@ -62,46 +64,79 @@ bool Instance::hasAlpha(Intersection &its, Sampler &rng) const {
 
 bool Instance::intersect(const Ray &worldRay, Intersection &its,
                          Sampler &rng) const {
-    if (!m_transform) {
-        // fast path, if no transform is needed
-        const Ray localRay        = worldRay;
-        const bool wasIntersected = m_shape->intersect(localRay, its, rng);
-        if (wasIntersected) {
-            if (hasAlpha(its, rng)) return false;
-            its.instance = this;
-            validateIntersection(its);
-        }
-        return wasIntersected;
-    }
-
-    const float previousT = its.t;
-    Ray localRay;
+    // the previous hit is kept if the wrapped shape is not hit. otherwise, the
+    // instance and deferred shape tell what the wrapped shape has hit
+    const float previousT            = its.t;
+    const Instance *previousInstance = its.instance;
+    const auto previousDeferred      = its.deferred;
+    its.instance                     = nullptr;
+    its.deferred.shape               = nullptr;
 
     // hints:
     // * transform the ray (do not forget to normalize!)
     // * how does its.t need to change?
-    localRay = m_transform->inverse(worldRay);
-    float len = localRay.direction.length();
-    localRay  = localRay.normalized();
-    its.t *= len;
+    Ray localRay = worldRay;
+    float len    = 1;
+    if (m_transform) {
+        localRay = m_transform->inverse(worldRay);
+        len      = localRay.direction.length();
+        localRay = localRay.normalized();
+        its.t *= len;
+    }
 
-    const bool wasIntersected = m_shape->intersect(localRay, its, rng);
+    bool wasIntersected = m_shape->intersect(localRay, its, rng);
     if (wasIntersected) {
-        if (hasAlpha(its, rng)) {
-            its.t = previousT;
-            return false;
-        }
-        its.instance = this;
-        validateIntersection(its);
-        // hint: how does its.t need to change?
+        // alpha masking needs the texture coordinates, and nested instances
+        // cannot defer since only one instance is recorded
+        if (m_alpha || its.instance)
+            its.computeSurface(localRay);
+        wasIntersected = !hasAlpha(its, rng);
+    }
+    if (!wasIntersected) {
+        its.t        = previousT;
+        its.instance = previousInstance;
+        its.deferred = previousDeferred;
+        return false;
+    }
 
+    its.instance = this;
+    validateIntersection(its);
+    if (m_transform) {
+        // hint: how does its.t need to change?
         its.t /= len;
-        transformFrame(its, -localRay.direction);
-    } else {
-        its.t = previousT;
+        if (!its.deferred.shape)
+            transformFrame(its, -localRay.direction);
+    }
+    return true;
+}
+
+void Instance::computeSurface(const Ray &worldRay, Intersection &its) const {
+    if (!m_transform) {
+        its.deferred.shape->computeSurface(worldRay, its);
+        return;
     }
 
-    return wasIntersected;
+    // the same local ray as during intersection
+    const Ray localRay = m_transform->inverse(worldRay).normalized();
+    its.deferred.shape->computeSurface(localRay, its);
+    transformFrame(its, -localRay.direction);
+}
+
+bool Instance::occluded(const Ray &worldRay, float tMax, Sampler &rng) const {
+    if (m_alpha) {
+        Intersection its(-worldRay.direction, tMax);
+        return intersect(worldRay, its, rng);
+    }
+
+    if (!m_transform) {
+        // fast path, if no transform is needed
+        return m_shape->occluded(worldRay, tMax, rng);
+    }
+
+    Ray localRay    = m_transform->inverse(worldRay);
+    const float len = localRay.direction.length();
+    localRay        = localRay.normalized();
+    return m_shape->occluded(localRay, tMax * len, rng);
 }
 
 float Instance::transmittance(const Ray &worldRay, float tMax,
@@ -168,6 +203,26 @@ AreaSample Instance::sampleArea(const Point& origin, Sampler &rng) const {
     return sample;
 }
 
+float Instance::getSurfaceArea() const {
+    const float area = m_shape->getSurfaceArea();
+    if (!m_transform)
+        return area;
+
+    // like the area pdf, this assumes that the transform scales uniformly
+    const float scale = m_transform->apply(Vector(1, 0, 0)).length();
+    return area * scale * scale;
+}
+
+std::optional<Vector> Instance::getPlanarNormal() const {
+    if (m_normal)
+        return std::nullopt;
+
+    const std::optional<Vector> normal = m_shape->getPlanarNormal();
+    if (!normal || !m_transform)
+        return normal;
+    return m_transform->applyNormal(*normal).normalized();
+}
+
 } // namespace lightwave
 
 REGISTER_CLASS(Instance, "instance", "default")
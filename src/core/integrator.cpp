@@ -10,50 +10,80 @@
 
 namespace lightwave {
 
+float SamplingIntegrator::parseDuration(const std::string &duration) {
+    size_t unitStart;
+    float value;
+    try {
+        value = std::stof(duration, &unitStart);
+    } catch (...) {
+        lightwave_throw("invalid duration \"%s\"", duration);
+    }
+
+    const std::string unit = duration.substr(unitStart);
+    if (unit == "" || unit == "s")
+        return value;
+    if (unit == "min")
+        return 60 * value;
+    if (unit == "h")
+        return 3600 * value;
+    lightwave_throw("invalid unit \"%s\" in duration \"%s\" (expected s, "
+                    "min or h)",
+                    unit,
+                    duration);
+}
+
+void SamplingIntegrator::renderBlock(const Range &spps, Sampler &sampler,
+                                     BlockSamples &samples) {
+    for (auto pixel : samples.block()) {
+        for (auto sample : spps) {
+            sampler.seed(pixel, sample);
+            auto cameraSample = m_scene->camera()->sample(pixel, sampler);
+            samples.add(pixel,
+                        cameraSample.weight * Li(cameraSample.ray, sampler));
+        }
+    }
+}
+
 void SamplingIntegrator::execute() {
     if (!m_image) {
         lightwave_throw(
             "<integrator /> needs an <image /> child to render into!");
     }
 
+    if (m_adaptive) {
+        executeAdaptive();
+        return;
+    }
+
     const Vector2i resolution = m_scene->camera()->resolution();
     m_image->initialize(resolution);
 
+    const bool hasTimeBudget = m_timeBudget > 0;
     Streaming stream{ *m_image };
-    ProgressReporter progress{ resolution.product() *
-                               long(m_sampler->samplesPerPixel()) };
+    ProgressReporter progress{ hasTimeBudget
+                                   ? 0
+                                   : resolution.product() *
+                                         long(m_sampler->samplesPerPixel()) };
     float norm = 0;
 
-    const bool renderProgressively =
-        resolution.product() * long(m_sampler->samplesPerPixel()) > 100000000l;
-
-    for (auto spps :
-         GeometricallyChunkedRange(m_sampler->samplesPerPixel(), 1024)) {
-        if (!renderProgressively)
-            spps = Range(0, m_sampler->samplesPerPixel());
-
+    const auto renderPass = [&](const Range &spps) {
         norm = 1.0f / float(*spps.end());
 
         for_each_parallel(
             BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
                 auto sampler = m_sampler->clone();
-                for (auto pixel : block) {
-                    Color sum;
-                    for (auto sample : spps) {
-                        sampler->seed(pixel, sample);
-                        auto cameraSample =
-                            m_scene->camera()->sample(pixel, *sampler);
-                        sum += cameraSample.weight *
-                               Li(cameraSample.ray, *sampler);
-                    }
-                    m_image->get(pixel) += sum;
-                }
+                BlockSamples samples;
+                samples.reset(block);
+                renderBlock(spps, *sampler, samples);
+                for (auto pixel : block)
+                    m_image->get(pixel) += samples.sum(pixel);
 
                 progress += block.diagonal().product() *
                             long(*spps.end() - *spps.begin());
                 stream.normalize(norm);
                 stream.updateBlock(block);
             });
+        finishPass(spps.count());
 
         logger(EInfo,
                "finished %d spp (%d this iteration) after %.2f seconds",
@@ -61,10 +91,46 @@ void SamplingIntegrator::execute() {
                spps.count(),
                progress.getElapsedTime());
 
+        m_image->setMetadata("spp", std::to_string(*spps.end()));
         m_image->save(norm);
+    };
 
-        if (!renderProgressively)
-            break;
+    if (hasTimeBudget) {
+        // keep rendering geometrically growing passes (ignoring the sample
+        // count of the sampler), but shrink them so that each is expected to
+        // finish before the deadline
+        int samples = 0;
+        while (true) {
+            int count = std::min(samples + 1, 1024);
+            if (samples > 0) {
+                const float elapsed       = progress.getElapsedTime();
+                const float timePerSample = elapsed / samples;
+                count = int(std::min(float(count),
+                                     (m_timeBudget - elapsed) / timePerSample));
+            }
+            if (count < 1)
+                break;
+
+            progress.update(0, resolution.product() * long(count));
+            renderPass(Range(samples, samples + count));
+            samples += count;
+        }
+        logger(EInfo,
+               "reached %d spp within the time budget of %.0f seconds",
+               samples,
+               m_timeBudget);
+    } else {
+        const bool renderProgressively =
+            m_renderInPasses ||
+            resolution.product() * long(m_sampler->samplesPerPixel()) >
+                100000000l;
+        if (renderProgressively) {
+            for (auto spps : GeometricallyChunkedRange(
+                     m_sampler->samplesPerPixel(), 1024))
+                renderPass(spps);
+        } else {
+            renderPass(Range(0, m_sampler->samplesPerPixel()));
+        }
     }
 
     // normalize the image such that the data inside the image is correct
@@ -73,4 +139,217 @@ void SamplingIntegrator::execute() {
     progress.finish();
 }
 
+void SamplingIntegrator::executeAdaptive() {
+    // convergence is decided per tile instead of per pixel, which avoids
+    // terminating pixels whose few samples happen to agree by chance
+    constexpr int TileSize = 8;
+
+    const Vector2i resolution = m_scene->camera()->resolution();
+    m_image->initialize(resolution);
+
+    const long budget =
+        resolution.product() * long(m_sampler->samplesPerPixel());
+    const int maxSamples =
+        std::max(m_adaptiveMaxSamples, m_sampler->samplesPerPixel());
+    const Vector2i numTiles{ (resolution.x() + TileSize - 1) / TileSize,
+                             (resolution.y() + TileSize - 1) / TileSize };
+    const auto tilePixels = [&](int tile) {
+        const Point2i min{ (tile % numTiles.x()) * TileSize,
+                           (tile / numTiles.x()) * TileSize };
+        return Bounds2i(min,
+                        Point2i(std::min(min.x() + TileSize, resolution.x()),
+                                std::min(min.y() + TileSize, resolution.y())));
+    };
+
+    // the image holds the mean of each pixel throughout rendering, and the
+    // second moment of its luminance is tracked alongside it
+    std::vector<float> secondMoment(resolution.product(), 0);
+    std::vector<int> tileSamples(numTiles.product(), 0);
+    // the number of samples each tile takes in the current pass
+    std::vector<int> passSamples(numTiles.product(), m_adaptiveMinSamples);
+    // the relative standard deviation of single samples in each tile
+    std::vector<float> tileDeviations(numTiles.product(), 0);
+
+    const auto estimateDeviation = [&](int tile) {
+        const Bounds2i pixels = tilePixels(tile);
+        const int n           = tileSamples[tile];
+        float sum             = 0;
+        for (auto pixel : pixels) {
+            const float mean = m_image->get(pixel).luminance();
+            const float variance =
+                std::max(secondMoment[pixel.y() * resolution.x() + pixel.x()] /
+                                 n -
+                             sqr(mean),
+                         0.f) *
+                n / std::max(n - 1, 1);
+            // the offset keeps dark pixels from dominating (like in the
+            // relative MSE metric)
+            sum += variance / (sqr(mean) + 1e-2f);
+        }
+        return sqrt(sum / pixels.diagonal().product());
+    };
+
+    // the relative MSE of a tile is its squared deviation divided by its
+    // sample count, and the budget minimizes the total of all tiles when
+    // every tile takes samples in proportion to its deviation
+    const auto samplesFor = [&](int tile, float scale) {
+        float samples = scale * tileDeviations[tile];
+        if (m_adaptiveThreshold > 0) {
+            samples = std::min(
+                samples, sqr(tileDeviations[tile] / m_adaptiveThreshold));
+        }
+        return std::clamp(int(std::min(std::ceil(samples), 1e9f)),
+                          tileSamples[tile],
+                          maxSamples);
+    };
+    const auto budgetFor = [&](float scale) {
+        long total = 0;
+        for (int tile = 0; tile < numTiles.product(); tile++) {
+            total += long(tilePixels(tile).diagonal().product()) *
+                     samplesFor(tile, scale);
+        }
+        return total;
+    };
+
+    Streaming stream{ *m_image };
+    ProgressReporter progress{ budget };
+    long samplesTaken = 0;
+
+    while (true) {
+        // the spiral runs over the grid of tiles, so that blocks consist of
+        // whole tiles and every tile is rendered by exactly one block
+        for_each_parallel(
+            BlockSpiral(numTiles, Vector2i(64 / TileSize)),
+            [&](auto blockTiles) {
+                // blocks are rendered as a whole while all of their tiles
+                // take the same samples, so that integrators can share work
+                // between their pixels, and tile by tile otherwise
+                std::vector<int> tiles;
+                for (auto tile : blockTiles)
+                    tiles.push_back(tile.y() * numTiles.x() + tile.x());
+                const Bounds2i block(tilePixels(tiles.front()).min(),
+                                     tilePixels(tiles.back()).max());
+                const bool isUniform =
+                    std::all_of(tiles.begin(), tiles.end(), [&](int tile) {
+                        return tileSamples[tile] == tileSamples[tiles[0]] &&
+                               passSamples[tile] == passSamples[tiles[0]];
+                    });
+
+                auto sampler = m_sampler->clone();
+                BlockSamples samples;
+                long blockSamples = 0;
+                const auto render = [&](const Bounds2i &region, int tile) {
+                    const int first = tileSamples[tile];
+                    const Range spps(first, first + passSamples[tile]);
+                    samples.reset(region);
+                    renderBlock(spps, *sampler, samples);
+
+                    for (auto pixel : region) {
+                        Color &mean = m_image->get(pixel);
+                        mean = (mean * float(first) + samples.sum(pixel)) /
+                               float(*spps.end());
+                        secondMoment[pixel.y() * resolution.x() + pixel.x()] +=
+                            samples.squaredLuminance(pixel);
+                    }
+                    blockSamples +=
+                        long(region.diagonal().product()) * spps.count();
+                };
+
+                if (isUniform) {
+                    if (passSamples[tiles[0]] > 0)
+                        render(block, tiles[0]);
+                } else {
+                    for (const int tile : tiles) {
+                        if (passSamples[tile] > 0)
+                            render(tilePixels(tile), tile);
+                    }
+                }
+
+                progress += blockSamples;
+                stream.updateBlock(block);
+            });
+
+        // advance the sample counts and estimate the deviations of all tiles
+        // that were sampled
+        long passTotal   = 0;
+        int sampledTiles = 0;
+        for (int tile = 0; tile < numTiles.product(); tile++) {
+            if (passSamples[tile] == 0)
+                continue;
+            passTotal += long(tilePixels(tile).diagonal().product()) *
+                         passSamples[tile];
+            sampledTiles++;
+            tileSamples[tile] += passSamples[tile];
+            tileDeviations[tile] = estimateDeviation(tile);
+        }
+        samplesTaken += passTotal;
+        finishPass(std::max(int(passTotal / resolution.product()), 1));
+
+        logger(EInfo,
+               "finished adaptive pass of %.1f spp in %d tiles after %.2f "
+               "seconds (%.1f%% of the budget used)",
+               double(passTotal) / resolution.product(),
+               sampledTiles,
+               progress.getElapsedTime(),
+               100.0 * samplesTaken / budget);
+
+        m_image->setMetadata(
+            "spp",
+            tfm::format("%.1f", double(samplesTaken) / resolution.product()));
+        m_image->save();
+
+        if (m_timeBudget > 0 && progress.getElapsedTime() >= m_timeBudget) {
+            logger(EInfo, "time budget exceeded, stopping adaptive sampling");
+            break;
+        }
+
+        // find the scale at which the samples of all tiles use up the budget,
+        // starting from one at which every noisy tile takes the maximum
+        float scale = 0;
+        for (const float deviation : tileDeviations) {
+            if (deviation > 0)
+                scale = std::max(scale, maxSamples / deviation);
+        }
+        if (budgetFor(scale) > budget) {
+            float low = 0, high = scale;
+            for (int iteration = 0; iteration < 32; iteration++) {
+                const float mid = (low + high) / 2;
+                (budgetFor(mid) > budget ? high : low) = mid;
+            }
+            scale = low;
+        }
+
+        // the sample counts of tiles at most double per pass, since their
+        // errors are only estimates, and tiles that would only take a few
+        // more samples are left alone to avoid passes with little work
+        bool isDone = true;
+        for (int tile = 0; tile < numTiles.product(); tile++) {
+            const int n     = tileSamples[tile];
+            const int count =
+                std::min({ samplesFor(tile, scale) - n, n, 1024 });
+            passSamples[tile] = count >= std::max(n / 8, 1) ? count : 0;
+            if (passSamples[tile] > 0)
+                isDone = false;
+        }
+        if (isDone)
+            break;
+    }
+
+    logger(EInfo,
+           "adaptive sampling took %.1f spp on average (%.1f%% of the budget)",
+           double(samplesTaken) / resolution.product(),
+           100.0 * samplesTaken / budget);
+
+    if (m_samplesImage) {
+        m_samplesImage->initialize(resolution);
+        for (int tile = 0; tile < numTiles.product(); tile++) {
+            for (auto pixel : tilePixels(tile))
+                m_samplesImage->get(pixel) = Color(float(tileSamples[tile]));
+        }
+        m_samplesImage->save();
+    }
+
+    progress.finish();
+}
+
 } // namespace lightwave
@@ -0,0 +1,111 @@
+#include <lightwave/core.hpp>
+#include <lightwave/properties.hpp>
+#include <lightwave/light.hpp>
+
+namespace lightwave {
+
+namespace {
+
+/// @brief Computes @code cos(max(0, a - b)) @endcode from the sines and
+/// cosines of two angles in [0, pi].
+inline float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB)
+        return 1;
+    return cosA * cosB + sinA * sinB;
+}
+
+/// @brief Computes @code sin(max(0, a - b)) @endcode from the sines and
+/// cosines of two angles in [0, pi].
+inline float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB)
+        return 0;
+    return sinA * cosB - cosA * sinB;
+}
+
+/// @brief Rotates a vector by an angle around a normalized axis (Rodrigues'
+/// rotation formula).
+inline Vector rotate(const Vector &v, const Vector &axis, float angle) {
+    const float cosAngle = cos(angle);
+    const float sinAngle = sin(angle);
+    return v * cosAngle + axis.cross(v) * sinAngle +
+           axis * axis.dot(v) * (1 - cosAngle);
+}
+
+} // namespace
+
+LightBounds LightBounds::unite(const LightBounds &a, const LightBounds &b) {
+    // lights that emit nothing do not widen the bounds
+    if (a.power == 0)
+        return b;
+    if (b.power == 0)
+        return a;
+
+    LightBounds result;
+    result.bounds = a.bounds;
+    result.bounds.extend(b.bounds);
+    result.power     = a.power + b.power;
+    result.cosThetaE = min(a.cosThetaE, b.cosThetaE);
+
+    // find the smallest cone that contains both normal cones
+    const float thetaA = safe_acos(a.cosThetaO);
+    const float thetaB = safe_acos(b.cosThetaO);
+    const float thetaD = safe_acos(a.axis.dot(b.axis));
+    if (min(thetaD + thetaB, Pi) <= thetaA) {
+        result.axis      = a.axis;
+        result.cosThetaO = a.cosThetaO;
+        return result;
+    }
+    if (min(thetaD + thetaA, Pi) <= thetaB) {
+        result.axis      = b.axis;
+        result.cosThetaO = b.cosThetaO;
+        return result;
+    }
+
+    const float thetaO = (thetaA + thetaD + thetaB) / 2;
+    const Vector rotationAxis = a.axis.cross(b.axis);
+    if (thetaO >= Pi || rotationAxis.lengthSquared() == 0) {
+        result.axis      = a.axis;
+        result.cosThetaO = -1;
+        return result;
+    }
+    result.axis = rotate(a.axis, rotationAxis.normalized(), thetaO - thetaA)
+                      .normalized();
+    result.cosThetaO = cos(thetaO);
+    return result;
+}
+
+float LightBounds::importance(const Point &point) const {
+    const Point center = bounds.center();
+    const Vector toPoint = point - center;
+    // avoid the importance growing without bounds for points within the light
+    const float radius2   = bounds.diagonal().lengthSquared() / 4;
+    const float distance2 = max(toPoint.lengthSquared(), max(radius2, Epsilon));
+
+    // the angle between the axis and the direction towards the point
+    const float cosThetaW =
+        toPoint.isZero() ? 1 : toPoint.normalized().dot(axis);
+    const float sinThetaW = safe_sqrt(1 - sqr(cosThetaW));
+
+    // the angle the bounding box subtends from the point (as seen through its
+    // bounding sphere)
+    float cosThetaB = -1;
+    if (toPoint.lengthSquared() > radius2)
+        cosThetaB = safe_sqrt(1 - radius2 / toPoint.lengthSquared());
+    const float sinThetaB = safe_sqrt(1 - sqr(cosThetaB));
+
+    // the smallest angle between the point and any direction the light emits
+    // towards: max(0, thetaW - thetaO - thetaB)
+    const float sinThetaO = safe_sqrt(1 - sqr(cosThetaO));
+    const float cosThetaX =
+        cosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    const float sinThetaX =
+        sinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    const float cosThetaP =
+        cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= cosThetaE)
+        return 0;
+
+    return power * cosThetaP / distance2;
+}
+
+} // namespace lightwave
@@ -2,7 +2,9 @@
 #include <lightwave/core.hpp>
 #include <lightwave/logger.hpp>
 #include <lightwave/parallel.hpp>
+#include <lightwave/properties.hpp>
 #include <lightwave/registry.hpp>
+#include <lightwave/texturecache.hpp>
 
 #include "../cmake/git_version.h"
 
@@ -41,10 +43,6 @@ int runUnitTests(int argc, const char *argv[]) {
 
 int main(int argc, const char *argv[]) {
     logger(EInfo, "welcome to lightwave, git hash %s", kGitHash);
-    logger(EInfo,
-           "running on %s with %d threads",
-           get_hostname(),
-           get_number_of_threads());
     logger(EInfo, "running with arguments");
     for (int i = 0; i < argc; i++)
         logger(EInfo, "  '%s'", argv[i]);
@@ -74,16 +72,21 @@ int main(int argc, const char *argv[]) {
 #endif
 
     try {
-        if (argc <= 1) {
-            logger(EInfo, "running unit tests since no scene path was given");
-            return runUnitTests(argc, argv);
-        }
-
         // MARK: Parse arguments
         std::vector<std::filesystem::path> sceneFiles;
+        // the arguments passed on to the unit tests (i.e., all but our own)
+        std::vector<const char *> testArguments{ argv[0] };
         for (int i = 1; i < argc; i++) {
             std::string arg = argv[i];
-            if (arg.starts_with("-D")) {
+            if (arg.starts_with("--threads=")) {
+                // override the number of threads (must happen before the
+                // thread pool is first used)
+                set_number_of_threads(parse_string<int>(arg.substr(10)));
+            } else if (arg.starts_with("--texture-budget=")) {
+                // memory in MiB that the tiles of image textures may occupy
+                TextureCache::global().setBudget(
+                    size_t(parse_string<int>(arg.substr(17))) << 20);
+            } else if (arg.starts_with("-D")) {
                 // define variable
                 int j = 2;
                 while (arg[j] != '=' && arg[j] != ' ')
@@ -96,12 +99,25 @@ int main(int argc, const char *argv[]) {
                 logger(
                     EDebug, "setting variable '%s' to '%s'", variable, value);
                 sceneVariables.emplace(variable, value);
+            } else if (arg.starts_with("-")) {
+                testArguments.push_back(argv[i]);
             } else {
                 // scene file
                 sceneFiles.push_back(arg);
             }
         }
 
+        logger(EInfo,
+               "running on %s with %d threads",
+               get_hostname(),
+               get_number_of_threads());
+
+        if (sceneFiles.empty()) {
+            logger(EInfo, "running unit tests since no scene path was given");
+            return runUnitTests(int(testArguments.size()),
+                                testArguments.data());
+        }
+
         for (const auto &scenePath : sceneFiles) {
             logger.linebreak();
             SceneParser parser{ scenePath };
@@ -111,6 +127,7 @@ int main(int argc, const char *argv[]) {
                     logger.linebreak();
                     logger(EInfo, "running %s", executable);
                     executable->execute();
+                    TextureCache::global().report();
                 }
             }
         }
@@ -0,0 +1,144 @@
+#include <lightwave/hash.hpp>
+#include <lightwave/mappedfile.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#ifdef LW_OS_WINDOWS
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lightwave {
+
+#ifdef LW_OS_WINDOWS
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    HANDLE file = CreateFileW(path.c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    m_file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        return;
+
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+        return;
+
+    m_data = static_cast<const uint8_t *>(
+        MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data)
+        m_size = size_t(size.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *data =
+            mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            m_data = static_cast<const uint8_t *>(data);
+            m_size = size_t(info.st_size);
+        }
+    }
+    // the mapping remains valid after the file has been closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data)
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+}
+
+#endif
+
+bool writeFileAtomically(const std::filesystem::path &path,
+                         const std::function<void(std::ostream &)> &write) {
+    std::error_code error;
+    if (path.has_parent_path())
+        std::filesystem::create_directories(path.parent_path(), error);
+
+    const std::filesystem::path temporaryPath =
+        path.string() +
+        tfm::format(
+            ".%016x.tmp",
+            uint64_t(hash::fnv1a(
+                uint64_t(
+                    std::hash<std::thread::id>{}(std::this_thread::get_id())),
+                uint64_t(std::chrono::steady_clock::now()
+                             .time_since_epoch()
+                             .count()))));
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        if (file)
+            write(file);
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
+
+std::filesystem::path defaultCacheDirectory() {
+    const char *directory = std::getenv("LW_BVH_CACHE");
+    return directory ? std::filesystem::path(directory)
+                     : std::filesystem::path();
+}
+
+std::filesystem::path
+convertedFilePath(const std::filesystem::path &source,
+                  const std::string &extension,
+                  const std::filesystem::path &cacheDirectory) {
+    if (cacheDirectory.empty())
+        return source.string() + extension;
+
+    std::error_code error;
+    std::filesystem::path absolute = std::filesystem::absolute(source, error);
+    if (error)
+        absolute = source;
+    const std::string name = absolute.lexically_normal().string();
+    return cacheDirectory /
+           tfm::format("%016x-%s%s",
+                       uint64_t(hash::fnv1a().update(name.data(), name.size())),
+                       source.filename().string(),
+                       extension);
+}
+
+} // namespace lightwave
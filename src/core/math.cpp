@@ -199,6 +199,59 @@ BsdfEval Intersection::evaluateBsdf(const Vector &wi) const {
         uv, shadingFrame().toLocal(wo), shadingFrame().toLocal(wi));
 }
 
+void Intersection::computeSurface(const Ray &ray) {
+    if (!deferred.shape)
+        return;
+
+    if (instance) {
+        // the instance needs to transform the surface information it
+        // deferred into world space
+        instance->computeSurface(ray, *this);
+    } else {
+        deferred.shape->computeSurface(ray, *this);
+    }
+    deferred.shape = nullptr;
+}
+
+void Intersection::computeDifferentials(const Ray &ray) {
+    uv.dx = uv.dy = Vector2(0);
+    if (!ray.hasDifferentials)
+        return;
+
+    // intersect the neighboring rays with the tangent plane of the hit
+    const Vector &n = geometryNormal;
+    const float d   = n.dot(Vector(position));
+    const float tx =
+        (d - n.dot(Vector(ray.dxOrigin))) / n.dot(ray.dxDirection);
+    const float ty =
+        (d - n.dot(Vector(ray.dyOrigin))) / n.dot(ray.dyDirection);
+    if (!std::isfinite(tx) || !std::isfinite(ty))
+        return;
+    const Vector dpdx = ray.dxOrigin + tx * ray.dxDirection - position;
+    const Vector dpdy = ray.dyOrigin + ty * ray.dyDirection - position;
+
+    // solve dpdx = dudx * dpdu + dvdx * dpdv (and likewise for y) in the
+    // least squares sense
+    const float ata00 = dpdu.dot(dpdu);
+    const float ata01 = dpdu.dot(dpdv);
+    const float ata11 = dpdv.dot(dpdv);
+    const float invDet = 1 / (ata00 * ata11 - ata01 * ata01);
+    if (!std::isfinite(invDet))
+        return;
+    const auto solve = [&](const Vector &dp) {
+        const float b0 = dpdu.dot(dp);
+        const float b1 = dpdv.dot(dp);
+        return Vector2((ata11 * b0 - ata01 * b1) * invDet,
+                       (ata00 * b1 - ata01 * b0) * invDet);
+    };
+    const Vector2 dx = solve(dpdx);
+    const Vector2 dy = solve(dpdy);
+    if (!std::isfinite(dx) || !std::isfinite(dy))
+        return;
+    uv.dx = dx;
+    uv.dy = dy;
+}
+
 Light *Intersection::light() const {
     if (!instance)
         return background;
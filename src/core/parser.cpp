@@ -1,4 +1,3 @@
-#include <ctpl_stl.h>
 #include <lightwave/properties.hpp>
 #include <lightwave/registry.hpp>
 #include <lightwave/transform.hpp>
@@ -11,12 +10,52 @@
 
 #include "parser.hpp"
 
-ctpl::thread_pool pool(2 * std::thread::hardware_concurrency());
-
 namespace lightwave {
 
 std::map<std::string, std::string> sceneVariables;
 
+/**
+ * @brief An object that will be constructed once all objects it depends on
+ * are available. Construction tasks are only submitted to the thread pool
+ * once they are ready to run, so that they never block a worker while waiting
+ * for other objects.
+ */
+struct SceneParser::PendingObject {
+    std::promise<ref<Object>> promise;
+    std::shared_future<ref<Object>> future = promise.get_future().share();
+
+    /// @brief Marks the object as finished (after the promise has been
+    /// fulfilled) and runs all continuations.
+    void finish() {
+        std::vector<std::function<void()>> continuations;
+        {
+            std::lock_guard lock(m_mutex);
+            m_finished = true;
+            continuations.swap(m_continuations);
+        }
+        for (auto &continuation : continuations)
+            continuation();
+    }
+
+    /// @brief Runs @c f once the object is finished, or immediately if it
+    /// already is.
+    void then(std::function<void()> f) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_finished) {
+                m_continuations.push_back(std::move(f));
+                return;
+            }
+        }
+        f();
+    }
+
+private:
+    std::mutex m_mutex;
+    bool m_finished = false;
+    std::vector<std::function<void()>> m_continuations;
+};
+
 struct SceneParser::Node
     : public std::enable_shared_from_this<SceneParser::Node> {
     ref<Node> parent;
@@ -31,7 +70,7 @@ struct SceneParser::Node
 
     virtual void enter() {}
     virtual void attribute(const std::string &name, const std::string &value) {}
-    virtual void addChild(const std::shared_future<ref<Object>> &object,
+    virtual void addChild(const ref<PendingObject> &object,
                           const std::string &name) {
         lightwave_throw("children are not supported by this node");
     }
@@ -41,8 +80,8 @@ struct SceneParser::Node
 };
 
 struct SceneParser::RootNode : public SceneParser::Node {
-    std::map<std::string, std::shared_future<ref<Object>>> namedObjects;
-    std::vector<std::shared_future<ref<Object>>> objectFutures;
+    std::map<std::string, ref<PendingObject>> namedObjects;
+    std::vector<ref<PendingObject>> objectFutures;
     std::filesystem::path filepath;
     SceneParser &sceneParser;
 
@@ -51,11 +90,11 @@ struct SceneParser::RootNode : public SceneParser::Node {
         : Node(nullptr), filepath(filepath), sceneParser(sceneParser) {}
 
     void nameObject(const std::string &name,
-                    const std::shared_future<ref<Object>> &object) {
+                    const ref<PendingObject> &object) {
         namedObjects[name] = object;
     }
 
-    const std::shared_future<ref<Object>> &lookup(const std::string &name) {
+    const ref<PendingObject> &lookup(const std::string &name) {
         auto it = namedObjects.find(name);
         if (it == namedObjects.end()) {
             lightwave_throw("could not find an object named \"%s\"", name);
@@ -67,14 +106,19 @@ struct SceneParser::RootNode : public SceneParser::Node {
 
     RootNode &getRoot() override { return *this; }
 
-    void addChild(const std::shared_future<ref<Object>> &object,
+    void addChild(const ref<PendingObject> &object,
                   const std::string &name) override {
         objectFutures.push_back(object);
     }
 
     void close() override {
         for (const auto &object : objectFutures) {
-            sceneParser.m_objects.push_back(object.get());
+            // help constructing objects instead of idling while we wait
+            ThreadPool::global().waitUntil([&]() {
+                return object->future.wait_for(std::chrono::seconds(0)) ==
+                       std::future_status::ready;
+            });
+            sceneParser.m_objects.push_back(object->future.get());
         }
 
         // Do not add our objects again in case this RootNode is re-used.
@@ -90,7 +134,7 @@ struct SceneParser::ObjectNode : public SceneParser::Node {
     std::string id;
     Properties properties;
 
-    std::vector<std::pair<std::string, std::shared_future<ref<Object>>>>
+    std::vector<std::pair<std::string, ref<PendingObject>>>
         childFutures;
 
     ref<Transform> transform;
@@ -118,45 +162,65 @@ struct SceneParser::ObjectNode : public SceneParser::Node {
         }
     }
 
-    void addChild(const std::shared_future<ref<Object>> &object,
+    void addChild(const ref<PendingObject> &object,
                   const std::string &childName) override {
         childFutures.push_back(std::make_pair(childName, object));
     }
 
     void close() override {
-        ProgressReporter &progress = getRoot().sceneParser.m_progress;
+        SceneParser &sceneParser   = getRoot().sceneParser;
+        ProgressReporter &progress = sceneParser.m_progress;
         progress.update(0, 1);
 
-        auto self = shared_from_this();
-        std::shared_future<ref<Object>> object =
-            pool.push([this, self, &progress](int) {
-                // wait for all child objects to be constructed and add them to
-                // properties
+        auto self   = shared_from_this();
+        auto object = std::make_shared<PendingObject>();
+        const auto construct = [this, self, object, &progress]() {
+            try {
+                // add all (already constructed) child objects to properties
                 for (const auto &child : childFutures) {
                     if (child.first == "") {
                         const bool needsQuery = id == "";
-                        properties.addChild(child.second.get(), needsQuery);
+                        properties.addChild(child.second->future.get(),
+                                            needsQuery);
                     } else {
-                        properties.set<Object>(child.first, child.second.get());
+                        properties.set<Object>(child.first,
+                                               child.second->future.get());
                     }
                 }
 
                 // construct final object
                 try {
-                    auto object = transform
+                    auto result = transform
                                       ? transform
                                       : Registry::create(tag, type, properties);
                     if (id != "")
-                        object->setId(id);
+                        result->setId(id);
                     progress += 1;
-                    return object;
+                    object->promise.set_value(result);
                 } catch (...) {
                     lightwave_throw_nested("defined in %s:%d:%d",
                                            location.filename,
                                            location.line,
                                            location.column);
                 }
-            });
+            } catch (...) {
+                object->promise.set_exception(std::current_exception());
+            }
+            object->finish();
+        };
+
+        // submit the construction once all children are finished (the extra
+        // count prevents submitting it while continuations are registered)
+        auto remaining = std::make_shared<std::atomic<int>>(
+            int(childFutures.size()) + 1);
+        const auto childFinished = [remaining, construct, &sceneParser]() {
+            if (--*remaining == 0)
+                sceneParser.m_tasks.run(construct);
+        };
+        for (const auto &child : childFutures)
+            child.second->then(childFinished);
+        childFinished();
+
         if (id != "") {
             getRoot().nameObject(id, object);
         }
@@ -228,7 +292,7 @@ struct SceneParser::IncludeNode : public SceneParser::Node {
         }
     }
 
-    void addChild(const std::shared_future<ref<Object>> &object,
+    void addChild(const ref<PendingObject> &object,
                   const std::string &name) override {
         parent->addChild(object, name);
     }
@@ -460,8 +524,9 @@ void SceneParser::close() {
 }
 
 void SceneParser::stop() {
-    pool.clear_queue();
-    pool.stop(true);
+    // objects that are still waiting for children will never be constructed,
+    // but those that have been submitted need to finish before we unwind
+    m_tasks.wait();
 }
 
 SceneParser::SceneParser(const std::filesystem::path &path)
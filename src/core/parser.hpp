@@ -1,6 +1,7 @@
 #pragma once
 
 #include <lightwave/core.hpp>
+#include <lightwave/parallel.hpp>
 
 #include "xml.hpp"
 
@@ -23,10 +24,15 @@ protected:
     struct DefaultNode;
     struct ReferenceNode;
     struct TransformNode;
+    struct PendingObject;
 
     std::stack<ref<Node>> m_stack;
     std::vector<ref<Object>> m_objects;
     ProgressReporter m_progress;
+    /// @brief The construction tasks of all objects in the scene. Declared
+    /// last, so that it waits for running tasks before anything else is
+    /// destroyed.
+    TaskGroup m_tasks;
 
     std::string resolveVariables(const std::string &value);
 
@@ -1,5 +1,6 @@
 #include <lightwave/camera.hpp>
 #include <lightwave/core.hpp>
+#include <lightwave/distribution.hpp>
 #include <lightwave/instance.hpp>
 #include <lightwave/integrator.hpp>
 #include <lightwave/light.hpp>
@@ -7,89 +8,300 @@
 #include <lightwave/registry.hpp>
 #include <lightwave/shape.hpp>
 
-#include <unordered_map>
-
 namespace lightwave {
 
 class Scene::LightSampling {
-    struct DistributionElement {
-        const Light *light;
-        float probability;
-        float cdf;
+public:
+    /// @brief How lights are picked for a given point.
+    enum class Strategy {
+        /// @brief Traverses a hierarchy over the bounds of all lights, which
+        /// estimates how much each light contributes to the point.
+        Hierarchy,
+        /// @brief Picks lights proportional to their sampling weight,
+        /// regardless of the point.
+        Weight,
+    };
+
+private:
+    /// @brief A node of the light hierarchy. The first child of an inner node
+    /// directly follows it, while the second child is referenced explicitly.
+    struct Node {
+        LightBounds bounds{};
+        /// @brief The light of a leaf node, or null for inner nodes.
+        const Light *light = nullptr;
+        /// @brief The index of the second child of inner nodes.
+        int secondChild = -1;
+        /// @brief The index of the parent node, or -1 for the root.
+        int parent = -1;
     };
 
     /// @brief References to all lights, to maintain memory ownership.
     std::vector<ref<Light>> m_lights;
-    /// @brief A fast lookup table to query how likely a light is to be sampled.
-    std::unordered_map<const Light *, float> m_probabilities;
-    /// @brief The distribution used for sampling.
-    std::vector<DistributionElement> m_distribution;
+    /// @brief The lights that are not part of the hierarchy.
+    std::vector<const Light *> m_unboundedLights;
+    /// @brief The distribution used for sampling from @c m_unboundedLights .
+    AliasTable m_distribution;
+    /// @brief How likely each light is to be sampled from @c m_distribution ,
+    /// indexed by @ref Light::index .
+    std::vector<float> m_probabilities;
+    /// @brief The light hierarchy, with the root at index 0.
+    std::vector<Node> m_nodes;
+    /// @brief The leaf node of each light in the hierarchy (or -1), indexed by
+    /// @ref Light::index .
+    std::vector<int> m_leaves;
+    /// @brief The probability of picking a light from the hierarchy instead of
+    /// from @c m_distribution .
+    float m_hierarchyProbability;
+
+    /// @brief The cost of a node of the hierarchy, which prefers splits into
+    /// groups of lights that are small, weak and emit into few directions.
+    static float cost(const LightBounds &bounds, float regularization) {
+        const float thetaO = safe_acos(bounds.cosThetaO);
+        const float thetaE = safe_acos(bounds.cosThetaE);
+        const float thetaW = min(thetaO + thetaE, Pi);
+        const float sinO   = safe_sqrt(1 - sqr(bounds.cosThetaO));
+        // the solid angle covered by the directions the lights emit in,
+        // weighted by the cosine falloff towards the border of the cone
+        const float orientation =
+            2 * Pi * (1 - bounds.cosThetaO) +
+            Pi / 2 *
+                (2 * thetaW * sinO - cos(thetaO - 2 * thetaW) -
+                 2 * thetaO * sinO + bounds.cosThetaO);
+        const Vector d = bounds.bounds.diagonal();
+        const float surfaceArea =
+            2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+        return bounds.power * orientation * surfaceArea * regularization;
+    }
+
+    using BoundedLight = std::pair<const Light *, LightBounds>;
+
+    /// @brief Recursively builds the hierarchy over the given lights, and
+    /// returns the index of the created node.
+    int build(std::vector<BoundedLight> &lights, int begin, int end,
+              int parent) {
+        const int index = int(m_nodes.size());
+        m_nodes.push_back(Node{ .parent = parent });
+
+        if (end - begin == 1) {
+            m_nodes[index].bounds = lights[begin].second;
+            m_nodes[index].light  = lights[begin].first;
+            m_leaves[lights[begin].first->index()] = index;
+            return index;
+        }
+
+        Bounds bounds, centroidBounds;
+        for (int i = begin; i < end; i++) {
+            bounds.extend(lights[i].second.bounds);
+            centroidBounds.extend(lights[i].second.bounds.center());
+        }
+
+        // binned split along each axis, with splits across long axes of the
+        // bounds being cheaper
+        constexpr int NumBins = 12;
+        const auto binOf      = [&](const BoundedLight &light, int axis) {
+            const float offset =
+                (light.second.bounds.center()[axis] -
+                 centroidBounds.min()[axis]) /
+                (centroidBounds.max()[axis] - centroidBounds.min()[axis]);
+            return min(int(offset * NumBins), NumBins - 1);
+        };
+
+        float bestCost = Infinity;
+        int bestAxis = -1, bestBin = -1;
+        const Vector diagonal = bounds.diagonal();
+        for (int axis = 0; axis < 3; axis++) {
+            if (centroidBounds.max()[axis] <= centroidBounds.min()[axis])
+                continue;
+
+            LightBounds bins[NumBins] = {};
+            for (int i = begin; i < end; i++) {
+                LightBounds &bin = bins[binOf(lights[i], axis)];
+                bin = LightBounds::unite(bin, lights[i].second);
+            }
+
+            const float regularization =
+                diagonal.maxComponent() / max(diagonal[axis], Epsilon);
+            for (int split = 1; split < NumBins; split++) {
+                LightBounds below = {}, above = {};
+                for (int bin = 0; bin < split; bin++)
+                    below = LightBounds::unite(below, bins[bin]);
+                for (int bin = split; bin < NumBins; bin++)
+                    above = LightBounds::unite(above, bins[bin]);
+                if (below.power == 0 || above.power == 0)
+                    continue;
+
+                const float splitCost = cost(below, regularization) +
+                                        cost(above, regularization);
+                if (splitCost < bestCost) {
+                    bestCost = splitCost;
+                    bestAxis = axis;
+                    bestBin  = split;
+                }
+            }
+        }
+
+        int mid;
+        if (bestAxis >= 0) {
+            mid = int(std::partition(lights.begin() + begin,
+                                     lights.begin() + end,
+                                     [&](const BoundedLight &light) {
+                                         return binOf(light, bestAxis) <
+                                                bestBin;
+                                     }) -
+                      lights.begin());
+        } else {
+            // all lights share the same centroid, so there is nothing to
+            // gain from any particular split
+            mid = (begin + end) / 2;
+        }
+
+        const int firstChild  = build(lights, begin, mid, index);
+        const int secondChild = build(lights, mid, end, index);
+        m_nodes[index].secondChild = secondChild;
+        m_nodes[index].bounds      = LightBounds::unite(
+            m_nodes[firstChild].bounds, m_nodes[secondChild].bounds);
+        return index;
+    }
+
+    /// @brief The probability of descending into the first child of an inner
+    /// node, or a negative value if no light of the node reaches the point.
+    float firstChildProbability(int index, const Point &origin) const {
+        const float first  = m_nodes[index + 1].bounds.importance(origin);
+        const float second =
+            m_nodes[m_nodes[index].secondChild].bounds.importance(origin);
+        if (first + second == 0)
+            return -1;
+        return first / (first + second);
+    }
 
 public:
-    LightSampling(const std::vector<ref<Light>> &lights) : m_lights(lights) {
-        float cummulativeWeight = 0;
+    LightSampling(const std::vector<ref<Light>> &lights, Strategy strategy)
+        : m_lights(lights), m_probabilities(lights.size(), 0),
+          m_leaves(lights.size(), -1) {
+        std::vector<float> weights;
+        std::vector<BoundedLight> boundedLights;
+
+        for (size_t i = 0; i < lights.size(); i++) {
+            const auto &light = lights[i];
+            light->setIndex(int(i));
 
-        for (const auto &light : lights) {
             const float weight = light->samplingWeight();
             if (weight == 0) {
                 // this light does not want to be sampled, so do not add
-                // it to the distribution and set its probability to 0
-                m_probabilities.insert(std::make_pair(light.get(), 0));
+                // it to the distribution and leave its probability at 0
                 continue;
             }
 
-            cummulativeWeight += weight;
-            m_distribution.emplace_back(
-                DistributionElement{ light.get(), weight, cummulativeWeight });
+            if (strategy == Strategy::Hierarchy) {
+                const std::optional<LightBounds> bounds = light->bounds();
+                if (bounds && bounds->power > 0) {
+                    boundedLights.emplace_back(light.get(), *bounds);
+                    continue;
+                }
+            }
+
+            m_unboundedLights.push_back(light.get());
+            weights.push_back(weight);
+        }
+
+        if (!boundedLights.empty()) {
+            m_nodes.reserve(2 * boundedLights.size() - 1);
+            build(boundedLights, 0, int(boundedLights.size()), -1);
         }
 
-        // normalize the distribution so that probability and cdf are in the
-        // range [0,1]
-        for (auto &element : m_distribution) {
-            element.probability /= cummulativeWeight;
-            element.cdf /= cummulativeWeight;
+        // the hierarchy is picked as often as any single light outside of it
+        m_hierarchyProbability =
+            m_nodes.empty() ? 0 : 1.f / (1 + m_unboundedLights.size());
 
-            // add light to lookup table so that the probability can be queried
-            // efficiently
-            m_probabilities[element.light] = element.probability;
+        // the probabilities account for picking the hierarchy instead
+        m_distribution = AliasTable(weights);
+        for (int i = 0; i < m_distribution.size(); i++) {
+            m_probabilities[m_unboundedLights[i]->index()] =
+                m_distribution.probability(i) * (1 - m_hierarchyProbability);
         }
     }
 
     bool hasLights() const { return !m_lights.empty(); }
 
-    LightSample sample(Sampler &rng) const {
+    LightSample sample(const Point &origin, Sampler &rng) const {
+        float u = rng.next();
+        if (u < m_hierarchyProbability) {
+            u /= m_hierarchyProbability;
+
+            float probability = m_hierarchyProbability;
+            int index         = 0;
+            while (!m_nodes[index].light) {
+                const float first = firstChildProbability(index, origin);
+                if (first < 0)
+                    return LightSample::invalid();
+                if (u < first) {
+                    u /= first;
+                    probability *= first;
+                    index = index + 1;
+                } else {
+                    u = min((u - first) / (1 - first),
+                            std::nextafter(1.f, 0.f));
+                    probability *= 1 - first;
+                    index = m_nodes[index].secondChild;
+                }
+            }
+
+            // a single light needs to be checked on its own
+            if (m_nodes[index].bounds.importance(origin) == 0)
+                return LightSample::invalid();
+            return {
+                .light       = m_nodes[index].light,
+                .probability = probability,
+            };
+        }
+
         if (m_distribution.empty())
             return LightSample::invalid();
-        const auto cdf     = rng.next();
-        const auto element = std::upper_bound(
-            m_distribution.begin(),
-            m_distribution.end(),
-            cdf,
-            [](float value, const DistributionElement &element) {
-                return value < element.cdf;
-            });
+        const int index = m_distribution.sample(
+            (u - m_hierarchyProbability) / (1 - m_hierarchyProbability));
+        const Light *light = m_unboundedLights[index];
         return {
-            .light       = element->light,
-            .probability = element->probability,
+            .light       = light,
+            .probability = m_probabilities[light->index()],
         };
     }
 
-    float probability(const Light *light) const {
-        if (light == nullptr)
+    float probability(const Point &origin, const Light *light) const {
+        if (light == nullptr || light->index() < 0 ||
+            light->index() >= int(m_lights.size()))
             return 0;
 
-        const auto it = m_probabilities.find(light);
-        if (it == m_probabilities.end())
+        int index = m_leaves[light->index()];
+        if (index < 0)
+            return m_probabilities[light->index()];
+        if (m_nodes[index].bounds.importance(origin) == 0)
             return 0;
-        return it->second;
+
+        float probability = m_hierarchyProbability;
+        while (m_nodes[index].parent >= 0) {
+            const int parent  = m_nodes[index].parent;
+            const float first = firstChildProbability(parent, origin);
+            if (first < 0)
+                return 0;
+            probability *= index == parent + 1 ? first : 1 - first;
+            index = parent;
+        }
+        return probability;
     }
 };
 
 Scene::Scene(const Properties &properties) {
     m_camera     = properties.getChild<Camera>();
     m_background = properties.getOptionalChild<BackgroundLight>();
-    m_lightSampling =
-        std::make_shared<LightSampling>(properties.getChildren<Light>());
+    m_lightSampling = std::make_shared<LightSampling>(
+        properties.getChildren<Light>(),
+        properties.getEnum<LightSampling::Strategy>(
+            "lightSampling",
+            LightSampling::Strategy::Hierarchy,
+            {
+                { "hierarchy", LightSampling::Strategy::Hierarchy },
+                { "weight", LightSampling::Strategy::Weight },
+            }));
 
     const std::vector<ref<Shape>> entities = properties.getChildren<Shape>();
     if (entities.size() == 1) {
@@ -116,30 +328,50 @@ Intersection Scene::intersect(const Ray &ray, Sampler &rng) const {
     PROFILE("Intersect")
 
     Intersection its(-ray.direction);
-    m_shape->intersect(ray, its, rng);
+    if (m_shape->intersect(ray, its, rng)) {
+        its.computeSurface(ray);
+        its.computeDifferentials(ray);
+    }
     if (!its) {
         its.background = m_background.get();
     }
-    its.lightProbability = m_lightSampling->probability(its.light());
+    its.scene  = this;
+    its.origin = ray.origin;
     return its;
 }
 
+bool Scene::occluded(const Ray &ray, float tMax, Sampler &rng) const {
+    PROFILE("Occluded")
+    return m_shape->occluded(ray, tMax * (1 - Epsilon), rng);
+}
+
 float Scene::transmittance(const Ray &ray, float tMax, Sampler &rng) const {
     PROFILE("Transmittance")
     float transmittance =
         m_shape->transmittance(ray, tMax * (1 - Epsilon), rng);
-    assert_condition(transmittance >= 0 && transmittance <= 1, {
+    // unbiased estimators of the transmittance can exceed 1
+    assert_condition(transmittance >= 0, {
         logger(EError,
-               "transmittance should be between 0 and 1. "
+               "transmittance should not be negative. "
                "Computed transmittance: %f",
                transmittance);
     }) return transmittance;
 }
 
-LightSample Scene::sampleLight(Sampler &rng) const {
+LightSample Scene::sampleLight(const Point &origin, Sampler &rng) const {
     PROFILE("Pick light")
 
-    return m_lightSampling->sample(rng);
+    return m_lightSampling->sample(origin, rng);
+}
+
+float Scene::lightProbability(const Point &origin, const Light *light) const {
+    return m_lightSampling->probability(origin, light);
+}
+
+float Intersection::lightProbability() const {
+    if (!scene)
+        return 0;
+    return scene->lightProbability(origin, light());
 }
 
 bool Scene::hasLights() const { return m_lightSampling->hasLights(); }
@@ -0,0 +1,312 @@
+#include <lightwave/image.hpp>
+#include <lightwave/logger.hpp>
+#include <lightwave/mappedfile.hpp>
+#include <lightwave/texturecache.hpp>
+
+#include <cstring>
+#include <sstream>
+
+namespace lightwave {
+
+namespace {
+
+uint64_t tileKey(uint32_t id, int level, int index) {
+    return uint64_t(id) << 32 | uint64_t(level) << 24 | uint64_t(index);
+}
+
+/// @brief Increments a counter that only the calling thread writes, which
+/// does not need an atomic read-modify-write.
+void increment(std::atomic<uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+}
+
+/// @brief The tiles a thread has used last, indexed by the lowest bits of
+/// their tile index.
+struct RecentTiles {
+    static constexpr int Size = 8;
+    std::array<uint64_t, Size> keys;
+    std::array<std::shared_ptr<const TextureCache::Tile>, Size> tiles;
+    std::shared_ptr<TextureCache::LookupCounters> counters;
+
+    RecentTiles() : counters(TextureCache::global().registerThread()) {
+        keys.fill(~uint64_t(0));
+    }
+};
+
+thread_local RecentTiles recentTiles;
+
+} // namespace
+
+TiledImage::TiledImage(const std::filesystem::path &path, bool isLinearSpace,
+                       bool storeTiles)
+    : m_path(path), m_id(TextureCache::global().allocateId()) {
+    std::error_code error;
+    const uint64_t sourceSize = std::filesystem::file_size(path, error);
+    if (error) {
+        lightwave_throw("could not load image %s", path.string());
+    }
+    const int64_t sourceTime =
+        std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+    const std::filesystem::path tilePath =
+        convertedFilePath(path,
+                          isLinearSpace ? ".linear.tiles" : ".tiles",
+                          defaultCacheDirectory());
+    if (storeTiles) {
+        m_file.open(tilePath, std::ios::binary);
+        if (m_file.is_open()) {
+            const uint64_t size = std::filesystem::file_size(tilePath, error);
+            if (!error && open(m_file, size, sourceSize, sourceTime))
+                return;
+            m_file.close();
+        }
+    }
+
+    logger(EInfo, "converting texture %s to tiles", path.string());
+    m_buffer = convert(path, isLinearSpace, sourceSize, sourceTime);
+    if (storeTiles) {
+        const bool written =
+            writeFileAtomically(tilePath, [&](std::ostream &file) {
+                file.write(reinterpret_cast<const char *>(m_buffer.data()),
+                           m_buffer.size());
+            });
+        if (written) {
+            m_file.open(tilePath, std::ios::binary);
+            if (m_file.is_open() &&
+                open(m_file, m_buffer.size(), sourceSize, sourceTime)) {
+                m_buffer = {};
+                return;
+            }
+            m_file.close();
+        } else {
+            logger(EWarn,
+                   "could not write tile file %s, keeping the texture in "
+                   "memory",
+                   tilePath.string());
+        }
+    }
+
+    std::istringstream stream(
+        std::string(reinterpret_cast<const char *>(m_buffer.data()),
+                    m_buffer.size()));
+    if (!open(stream, m_buffer.size(), sourceSize, sourceTime)) {
+        lightwave_throw("could not convert texture %s", path.string());
+    }
+}
+
+TiledImage::~TiledImage() { TextureCache::global().release(*this); }
+
+std::vector<uint8_t> TiledImage::convert(const std::filesystem::path &path,
+                                         bool isLinearSpace,
+                                         uint64_t sourceSize,
+                                         int64_t sourceTime) {
+    std::vector<ref<Image>> pyramid{ std::make_shared<Image>(path,
+                                                             isLinearSpace) };
+    while (pyramid.back()->resolution() != Point2i(1))
+        pyramid.push_back(pyramid.back()->downsample());
+
+    TileHeader header;
+    std::memcpy(header.magic, TileMagic, sizeof(TileMagic));
+    header.version    = TileVersion;
+    header.tileSize   = TileSize;
+    header.levelCount = int32_t(pyramid.size());
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+
+    std::vector<Level> levels;
+    uint64_t offset = sizeof(header) + pyramid.size() * sizeof(Level);
+    for (const auto &image : pyramid) {
+        Level level;
+        level.resolution = image->resolution();
+        level.tiles      = Point2i(
+            (level.resolution.x() + TileSize - 1) / TileSize,
+            (level.resolution.y() + TileSize - 1) / TileSize);
+        level.offset     = offset;
+        offset += uint64_t(level.tiles.x()) * level.tiles.y() * TilePixels *
+                  sizeof(Color);
+        levels.push_back(level);
+    }
+
+    std::vector<uint8_t> result(offset);
+    std::memcpy(result.data(), &header, sizeof(header));
+    std::memcpy(result.data() + sizeof(header),
+                levels.data(),
+                levels.size() * sizeof(Level));
+    for (size_t l = 0; l < pyramid.size(); l++) {
+        const Image &image = *pyramid[l];
+        const Level &level = levels[l];
+        Color *tiles = reinterpret_cast<Color *>(result.data() + level.offset);
+        for (int ty = 0; ty < level.tiles.y(); ty++) {
+            for (int tx = 0; tx < level.tiles.x(); tx++) {
+                // pixels beyond the image repeat its last row and column
+                for (int y = 0; y < TileSize; y++) {
+                    for (int x = 0; x < TileSize; x++) {
+                        const Point2i pixel(
+                            std::min(tx * TileSize + x,
+                                     level.resolution.x() - 1),
+                            std::min(ty * TileSize + y,
+                                     level.resolution.y() - 1));
+                        tiles[y * TileSize + x] = image(pixel);
+                    }
+                }
+                tiles += TilePixels;
+            }
+        }
+    }
+    return result;
+}
+
+bool TiledImage::open(std::istream &stream, uint64_t size,
+                      uint64_t sourceSize, int64_t sourceTime) {
+    TileHeader header;
+    if (!stream.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+    if (std::memcmp(header.magic, TileMagic, sizeof(TileMagic)) != 0 ||
+        header.version != TileVersion || header.tileSize != TileSize ||
+        header.sourceSize != sourceSize || header.sourceTime != sourceTime ||
+        header.levelCount <= 0 || header.levelCount > 32)
+        return false;
+
+    m_levels.resize(header.levelCount);
+    if (!stream.read(reinterpret_cast<char *>(m_levels.data()),
+                     m_levels.size() * sizeof(Level)))
+        return false;
+    // the levels need to tile the file exactly, so that reading any tile of
+    // a truncated or garbled file fails here rather than during rendering
+    uint64_t offset = sizeof(header) + m_levels.size() * sizeof(Level);
+    for (const Level &level : m_levels) {
+        if (level.resolution.x() <= 0 || level.resolution.y() <= 0 ||
+            level.offset != offset)
+            return false;
+        offset += uint64_t(level.tiles.x()) * level.tiles.y() * TilePixels *
+                  sizeof(Color);
+    }
+    return offset == size;
+}
+
+void TiledImage::readTile(int level, int tile, Color *pixels) const {
+    const uint64_t offset =
+        m_levels[level].offset + uint64_t(tile) * TilePixels * sizeof(Color);
+    if (!m_buffer.empty()) {
+        std::memcpy(pixels, m_buffer.data() + offset, TilePixels * sizeof(Color));
+        return;
+    }
+
+    std::lock_guard lock(m_fileMutex);
+    m_file.seekg(offset);
+    if (!m_file.read(reinterpret_cast<char *>(pixels),
+                     TilePixels * sizeof(Color))) {
+        lightwave_throw("could not read tile file of %s", m_path.string());
+    }
+}
+
+Color TiledImage::texel(int level, const Point2i &pixel) const {
+    const Level &l  = m_levels[level];
+    const int index = (pixel.y() / TileSize) * l.tiles.x() + pixel.x() / TileSize;
+    const uint64_t key = tileKey(m_id, level, index);
+
+    RecentTiles &recent = recentTiles;
+    const int slot      = index % RecentTiles::Size;
+    increment(recent.counters->lookups);
+    if (recent.keys[slot] == key) {
+        increment(recent.counters->hits);
+    } else {
+        recent.tiles[slot] = TextureCache::global().tile(*this, level, index);
+        recent.keys[slot]  = key;
+    }
+    return (*recent.tiles[slot])[(pixel.y() % TileSize) * TileSize +
+                                 pixel.x() % TileSize];
+}
+
+void TextureCache::setBudget(size_t bytes) {
+    std::lock_guard lock(m_mutex);
+    m_budget = bytes;
+    evict();
+}
+
+void TextureCache::evict() {
+    // the most recently used tile is kept even if it exceeds the budget on
+    // its own
+    while (m_residentBytes > m_budget && m_lru.size() > 1) {
+        m_tiles.erase(m_lru.back());
+        m_lru.pop_back();
+        m_residentBytes -= sizeof(Tile);
+    }
+}
+
+std::shared_ptr<TextureCache::LookupCounters> TextureCache::registerThread() {
+    auto counters = std::make_shared<LookupCounters>();
+    std::lock_guard lock(m_mutex);
+    m_threadCounters.push_back(counters);
+    return counters;
+}
+
+std::shared_ptr<const TextureCache::Tile>
+TextureCache::tile(const TiledImage &image, int level, int index) {
+    const uint64_t key = tileKey(image.m_id, level, index);
+    {
+        std::lock_guard lock(m_mutex);
+        auto it = m_tiles.find(key);
+        if (it != m_tiles.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+            m_hits++;
+            return it->second.tile;
+        }
+    }
+
+    // tiles are loaded without holding the lock, so that other threads can
+    // keep using the cache in the meantime
+    auto tile = std::make_shared<Tile>();
+    image.readTile(level, index, tile->data());
+    m_loads.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard lock(m_mutex);
+    auto [it, inserted] = m_tiles.try_emplace(key);
+    if (!inserted) {
+        // another thread has loaded the same tile in the meantime
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+        return it->second.tile;
+    }
+    m_lru.push_front(key);
+    it->second = Entry{ tile, m_lru.begin() };
+    m_residentBytes += sizeof(Tile);
+    m_peakBytes = std::max(m_peakBytes, m_residentBytes);
+    evict();
+    return tile;
+}
+
+void TextureCache::release(const TiledImage &image) {
+    std::lock_guard lock(m_mutex);
+    for (auto it = m_lru.begin(); it != m_lru.end();) {
+        if (*it >> 32 == image.m_id) {
+            m_tiles.erase(*it);
+            it = m_lru.erase(it);
+            m_residentBytes -= sizeof(Tile);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void TextureCache::report() {
+    std::lock_guard lock(m_mutex);
+    uint64_t lookups = 0, hits = m_hits;
+    for (const auto &counters : m_threadCounters) {
+        lookups += counters->lookups.load(std::memory_order_relaxed);
+        hits += counters->hits.load(std::memory_order_relaxed);
+    }
+    if (lookups == 0)
+        return;
+    logger(EInfo,
+           "texture cache: %.2f%% of %d lookups hit, %d tiles loaded, %.1f "
+           "MiB resident (peak %.1f MiB, budget %.1f MiB)",
+           100.0 * hits / lookups,
+           lookups,
+           m_loads.load(),
+           m_residentBytes / 1048576.0,
+           m_peakBytes / 1048576.0,
+           m_budget / 1048576.0);
+}
+
+} // namespace lightwave
@@ -10,7 +10,8 @@ public:
         m_emission = properties.get<Texture>("emission");
     }
 
-    EmissionEval evaluate(const Point2 &uv, const Vector &wo) const override {
+    EmissionEval evaluate(const TextureCoordinates &uv,
+                          const Vector &wo) const override {
         if (Vector(0.0f, 0.f, 1.f).dot(wo) < 0)
             return EmissionEval::invalid();
         return EmissionEval{ m_emission.get()->evaluate(uv), Inv2Pi };
@@ -2,10 +2,299 @@
 
 namespace lightwave {
 
+/**
+ * @brief Generates the random numbers of a light sample from a seed, so that
+ * the same light sample can be regenerated at any shading point. This lets
+ * reservoirs store light samples in primary sample space, where reusing them
+ * for another shading point does not change their density.
+ */
+class SeededSampler : public Sampler {
+    uint64_t m_state;
+
+public:
+    SeededSampler() : m_state(0) {}
+
+    void seed(int index) override {
+        m_state = hash::fnv1a(uint32_t(index));
+    }
+    void seed(const Point2i &pixel, int sampleIndex) override {
+        m_state = hash::fnv1a(pixel.x(), pixel.y(), sampleIndex);
+    }
+
+    /// @brief SplitMix64, which produces good random numbers even for
+    /// sequences of seeds.
+    float next() override {
+        uint64_t z = (m_state += 0x9E3779B97F4A7C15);
+        z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z          = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        z ^= z >> 31;
+        return float(z >> 40) * 0x1p-24f;
+    }
+
+    ref<Sampler> clone() const override {
+        return std::make_shared<SeededSampler>(*this);
+    }
+
+    std::string toString() const override { return "SeededSampler[]"; }
+};
+
 class DirectIntegrator : public SamplingIntegrator {
+    /// @brief A light sample that has been selected from a stream of
+    /// candidates, with probability proportional to their weights (weighted
+    /// reservoir sampling).
+    struct Reservoir {
+        /// @brief The seed of the selected light sample.
+        uint32_t seed = 0;
+        /// @brief The sum of the weights of all candidates.
+        float weightSum = 0;
+        /// @brief The number of candidates.
+        float count = 0;
+        /// @brief The target function of the selected light sample.
+        float target = 0;
+        /// @brief The contribution weight of the selected light sample, which
+        /// plays the role of its inverse density.
+        float weight = 0;
+
+        void update(uint32_t candidate, float candidateWeight,
+                    float candidateTarget, float u) {
+            if (!(candidateWeight > 0))
+                return;
+            weightSum += candidateWeight;
+            if (u * weightSum < candidateWeight) {
+                seed   = candidate;
+                target = candidateTarget;
+            }
+        }
+    };
+
+    /// @brief The unshadowed contribution of a light sample at a shading
+    /// point.
+    struct Candidate {
+        Vector wi;
+        float distance;
+        /// @brief The contribution divided by the density of the light sample.
+        Color contribution;
+
+        /// @brief The target function that candidates are resampled with.
+        float target() const { return max(contribution.luminance(), 0.f); }
+    };
+
+    /// @brief The number of candidates each reservoir is built from, or 1 to
+    /// sample lights without resampling.
+    int m_candidates;
+    /// @brief The number of neighboring pixels whose reservoirs are reused.
+    int m_spatialReuse;
+    /// @brief The radius in pixels in which neighbors are picked.
+    float m_reuseRadius;
+
+    /// @brief Regenerates the light sample of a seed at a shading point.
+    Candidate regenerate(const Intersection &its, uint32_t seed) const {
+        SeededSampler sampler;
+        sampler.seed(int(seed));
+        const LightSample lightSample =
+            m_scene->sampleLight(its.position, sampler);
+        if (!lightSample)
+            return { Vector(), 0, Color(0.f) };
+        const DirectLightSample direct =
+            lightSample.light->sampleDirect(its.position, sampler);
+        if (direct.isInvalid())
+            return { Vector(), 0, Color(0.f) };
+        return { direct.wi,
+                 direct.distance,
+                 direct.weight * its.evaluateBsdf(direct.wi).value /
+                     lightSample.probability };
+    }
+
+    /// @brief Resamples one of @ref m_candidates light samples proportional
+    /// to their unshadowed contribution.
+    Reservoir sampleCandidates(const Intersection &its, Sampler &rng) const {
+        // derive the seeds of all candidates from a single random number
+        const uint32_t base = uint32_t(rng.next() * 0x1p24f);
+        Reservoir reservoir;
+        for (int i = 0; i < m_candidates; i++) {
+            const uint32_t seed = uint32_t(hash::fnv1a(base, i));
+            const float target  = regenerate(its, seed).target();
+            // the candidates are uniformly distributed in primary sample
+            // space, hence their weight is just the target function
+            reservoir.update(seed, target, target, rng.next());
+        }
+        reservoir.count = float(m_candidates);
+        if (reservoir.target > 0)
+            reservoir.weight =
+                reservoir.weightSum / (reservoir.count * reservoir.target);
+        return reservoir;
+    }
+
+    /// @brief Estimates the direct light of the selected light sample, which
+    /// requires a single shadow ray.
+    Color shade(const Intersection &its, const Reservoir &reservoir,
+                Sampler &rng) const {
+        if (reservoir.weight == 0)
+            return Color(0.f);
+        const Candidate candidate = regenerate(its, reservoir.seed);
+        const Ray shadowRay{ its.position, candidate.wi };
+        if (m_scene->occluded(shadowRay, candidate.distance, rng))
+            return Color(0.f);
+        return candidate.contribution * reservoir.weight;
+    }
+
+    /// @brief Adds the emission of the surface and the emission found by
+    /// sampling its Bsdf.
+    Color emission(const Intersection &its, Sampler &rng) const {
+        Color c = its.evaluateEmission().value;
+        BsdfSample bsdfSample = its.sampleBsdf(rng);
+        if (bsdfSample.isInvalid())
+            return c;
+        Ray newRay{ its.position, bsdfSample.wi };
+        Intersection nextIts = m_scene->intersect(newRay, rng);
+        c += nextIts.evaluateEmission().value * bsdfSample.weight;
+        return c;
+    }
+
+    /// @brief What is known about the camera sample of a pixel while
+    /// rendering a block with spatial reuse.
+    struct PixelState {
+        Intersection its;
+        Color weight;
+        /// @brief The radiance found without light sampling.
+        Color radiance;
+        Reservoir reservoir;
+    };
+
+    static int indexIn(const Bounds2i &block, const Point2i &pixel) {
+        return (pixel.y() - block.min().y()) * block.diagonal().x() +
+               pixel.x() - block.min().x();
+    }
+
+    /**
+     * @brief Combines the reservoir of a pixel with those of randomly picked
+     * neighbors that have similar geometry. Light samples of neighbors are
+     * reweighted by their target function at the pixel, and the result is
+     * normalized by the number of candidates that could have produced the
+     * selected sample, which keeps the estimate unbiased.
+     */
+    Reservoir reuse(const Bounds2i &block, const Point2i &pixel,
+                    const std::vector<PixelState> &states,
+                    Sampler &rng) const {
+        const PixelState &center = states[indexIn(block, pixel)];
+        std::vector<const PixelState *> sources{ &center };
+        Reservoir result;
+
+        const auto add = [&](const Reservoir &reservoir) {
+            const float target =
+                reservoir.weight > 0
+                    ? regenerate(center.its, reservoir.seed).target()
+                    : 0;
+            result.update(reservoir.seed,
+                          target * reservoir.weight * reservoir.count,
+                          target,
+                          rng.next());
+            result.count += reservoir.count;
+        };
+
+        add(center.reservoir);
+        for (int i = 0; i < m_spatialReuse; i++) {
+            const Point2 offset = squareToUniformDiskConcentric(rng.next2D());
+            const Point2i neighbor{
+                clamp(pixel.x() + int(std::round(m_reuseRadius * offset.x())),
+                      block.min().x(),
+                      block.max().x() - 1),
+                clamp(pixel.y() + int(std::round(m_reuseRadius * offset.y())),
+                      block.min().y(),
+                      block.max().y() - 1),
+            };
+            const PixelState &state = states[indexIn(block, neighbor)];
+            // neighbors on other surfaces would mostly contribute samples that
+            // do not matter here
+            if (&state == &center || !state.its ||
+                state.its.shadingNormal.dot(center.its.shadingNormal) < 0.9f ||
+                abs(state.its.t - center.its.t) > 0.1f * center.its.t)
+                continue;
+            add(state.reservoir);
+            sources.push_back(&state);
+        }
+
+        if (result.target <= 0)
+            return {};
+        float normalization = 0;
+        for (const PixelState *source : sources) {
+            if (regenerate(source->its, result.seed).target() > 0)
+                normalization += source->reservoir.count;
+        }
+        result.weight = result.weightSum / (normalization * result.target);
+        return result;
+    }
+
+    /// @brief Whether reservoirs are resampled at all, as opposed to taking a
+    /// single light sample.
+    bool usesResampling() const {
+        return m_scene->hasLights() && (m_candidates > 1 || m_spatialReuse > 0);
+    }
+
 public:
     DirectIntegrator(const Properties &properties)
-        : SamplingIntegrator(properties) {}
+        : SamplingIntegrator(properties) {
+        m_candidates   = std::max(properties.get<int>("candidates", 1), 1);
+        m_spatialReuse = properties.get<int>("spatialReuse", 0);
+        m_reuseRadius  = properties.get<float>("reuseRadius", 10);
+    }
+
+    /**
+     * @brief Renders blocks in three phases if reservoirs are reused between
+     * pixels: all pixels of the block first resample their own candidates,
+     * then combine their reservoir with those of neighboring pixels in the
+     * same block, and only then trace a shadow ray for their selected light
+     * sample.
+     */
+    void renderBlock(const Range &spps, Sampler &sampler,
+                     BlockSamples &samples) override {
+        if (m_spatialReuse == 0 || !m_scene->hasLights()) {
+            SamplingIntegrator::renderBlock(spps, sampler, samples);
+            return;
+        }
+
+        const Bounds2i &block = samples.block();
+        const int numPixels = block.diagonal().product();
+        std::vector<PixelState> states(numPixels);
+        std::vector<Reservoir> reused(numPixels);
+        SeededSampler rng;
+
+        for (auto sample : spps) {
+            for (auto pixel : block) {
+                PixelState &state = states[indexIn(block, pixel)];
+                sampler.seed(pixel, sample);
+                const auto cameraSample =
+                    m_scene->camera()->sample(pixel, sampler);
+                state.weight = cameraSample.weight;
+                state.its    = m_scene->intersect(cameraSample.ray, sampler);
+                if (!state.its) {
+                    state.radiance  = state.its.evaluateEmission().value;
+                    state.reservoir = {};
+                    continue;
+                }
+                state.reservoir = sampleCandidates(state.its, sampler);
+                state.radiance  = emission(state.its, sampler);
+            }
+
+            for (auto pixel : block) {
+                const PixelState &state = states[indexIn(block, pixel)];
+                if (!state.its)
+                    continue;
+                rng.seed(pixel, sample);
+                reused[indexIn(block, pixel)] =
+                    reuse(block, pixel, states, rng);
+            }
+
+            for (auto pixel : block) {
+                const int index         = indexIn(block, pixel);
+                const PixelState &state = states[index];
+                Color radiance          = state.radiance;
+                if (state.its)
+                    radiance += shade(state.its, reused[index], rng);
+                samples.add(pixel, state.weight * radiance);
+            }
+        }
+    }
 
     Color Li(const Ray &ray, Sampler &rng) override {
         Intersection its = m_scene->intersect(ray, rng);
@@ -13,17 +302,22 @@ public:
         if (!its)
             return its.evaluateEmission().value;
 
+        if (usesResampling()) {
+            const Reservoir reservoir = sampleCandidates(its, rng);
+            return emission(its, rng) + shade(its, reservoir, rng);
+        }
+
         Color c(0.f);
         if (m_scene->hasLights()) {
-            LightSample lightSample = m_scene->sampleLight(rng);
+            LightSample lightSample = m_scene->sampleLight(its.position, rng);
             if (lightSample) {
                 const Light *light = lightSample.light;
                 DirectLightSample dSample =
                     light->sampleDirect(its.position, rng);
                 if (!dSample.isInvalid()) {
                     Ray shadowRay{ its.position, dSample.wi };
-                    Intersection shadowIts = m_scene->intersect(shadowRay, rng);
-                    if (shadowIts.t >= dSample.distance) {
+                    if (!m_scene->occluded(
+                            shadowRay, dSample.distance, rng)) {
                         c += dSample.weight *
                              its.evaluateBsdf(dSample.wi).value /
                              lightSample.probability;
@@ -32,15 +326,7 @@ public:
             }
         }
 
-        c += its.evaluateEmission().value;
-        BsdfSample bsdfSample = its.sampleBsdf(rng);
-        if (bsdfSample.isInvalid())
-            return c;
-        Ray newRay{ its.position, bsdfSample.wi };
-        Intersection nextIts = m_scene->intersect(newRay, rng);
-        c += nextIts.evaluateEmission().value * bsdfSample.weight;
-
-        return c;
+        return c + emission(its, rng);
     }
 
     /// @brief An optional textual representation of this class, which can be
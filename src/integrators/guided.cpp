@@ -0,0 +1,265 @@
+#include <lightwave.hpp>
+
+namespace lightwave {
+
+/**
+ * @brief A path tracer that learns the incident radiance throughout the scene
+ * while rendering (see @ref GuidingField ), and samples directions from the
+ * learned distribution in addition to the Bsdf. The image is rendered in
+ * geometrically growing passes, each of which samples what has been learned
+ * in the passes before it. Which of the two distributions a direction is
+ * sampled from is decided randomly (one-sample multiple importance sampling
+ * with the balance heuristic), and light sources are additionally found by
+ * next event estimation as in pathtracer_mis.
+ */
+class GuidedIntegrator : public SamplingIntegrator {
+    /// @brief A vertex of a path, whose incident radiance along the sampled
+    /// direction is recorded once the path has terminated.
+    struct Vertex {
+        GuidingField::Region *region;
+        Vector wi;
+        /// @brief The throughput of the path after scattering at the vertex.
+        Color throughput;
+        /// @brief The density with which @c wi has been sampled.
+        float pdf;
+        /// @brief The radiance arriving at the vertex from @c wi .
+        Color radiance;
+
+        /// @brief Adds radiance that the path has found after the vertex,
+        /// given in terms of the pixel (i.e., weighted by the throughput of
+        /// the path).
+        void add(const Color &contribution) {
+            for (int channel = 0; channel < Color::NumComponents; channel++) {
+                if (throughput[channel] > 0)
+                    radiance[channel] +=
+                        contribution[channel] / throughput[channel];
+            }
+        }
+    };
+
+    /// @brief A sampled direction to continue a path in.
+    struct ScatterSample {
+        Vector wi;
+        Color weight;
+        /// @brief The density of sampling @c wi from the combination of both
+        /// distributions, or zero if @c wi has been sampled from a discrete
+        /// lobe of the Bsdf.
+        float pdf;
+    };
+
+    static constexpr int MaxVertices = 16;
+
+    int m_depth;
+    /// @brief The probability of sampling the Bsdf instead of the learned
+    /// distribution.
+    float m_bsdfFraction;
+    GuidingField m_field;
+
+    /// @brief The probability of sampling the learned distribution at an
+    /// intersection, which is zero if nothing has been learned yet or the
+    /// Bsdf only scatters into discrete directions.
+    float guidingProbability(const Intersection &its,
+                             const GuidingField::Region &region) const {
+        if (region.sampling.total() <= 0 || !its.instance->bsdf() ||
+            its.instance->bsdf()->isDelta())
+            return 0;
+        return 1 - m_bsdfFraction;
+    }
+
+    /// @brief The density of sampling a direction from the combination of the
+    /// Bsdf and the learned distribution.
+    static float scatterPdf(const GuidingField::Region &region,
+                            float guiding, const Vector &wi, float bsdfPdf) {
+        if (guiding == 0)
+            return bsdfPdf;
+        return guiding * region.sampling.pdf(wi) + (1 - guiding) * bsdfPdf;
+    }
+
+    static ScatterSample scatter(const Intersection &its,
+                                 const GuidingField::Region &region,
+                                 float guiding, Sampler &rng) {
+        if (rng.next() < guiding) {
+            const Vector wi     = region.sampling.sample(rng.next2D());
+            const BsdfEval bsdf = its.evaluateBsdf(wi);
+            if (bsdf.isInvalid())
+                return { wi, Color(0), 0 };
+            const float pdf = scatterPdf(region, guiding, wi, bsdf.pdf);
+            return { wi, bsdf.value / pdf, pdf };
+        }
+
+        const BsdfSample bsdfSample = its.sampleBsdf(rng);
+        if (bsdfSample.isInvalid() || guiding == 0) {
+            const bool isDelta =
+                its.instance->bsdf() && its.instance->bsdf()->isDelta();
+            return { bsdfSample.wi,
+                     bsdfSample.weight,
+                     isDelta ? 0 : bsdfSample.pdf };
+        }
+
+        const BsdfEval bsdf = its.evaluateBsdf(bsdfSample.wi);
+        if (bsdf.pdf == 0) {
+            // a discrete lobe, which the learned distribution never samples
+            return { bsdfSample.wi, bsdfSample.weight / (1 - guiding), 0 };
+        }
+        const float pdf = scatterPdf(region, guiding, bsdfSample.wi, bsdf.pdf);
+        return { bsdfSample.wi, bsdf.value / pdf, pdf };
+    }
+
+    /// @brief Estimates the light arriving at the intersection directly from
+    /// a randomly picked light source (next event estimation).
+    Color sampleLight(const Intersection &its,
+                      const GuidingField::Region &region, float guiding,
+                      Sampler &rng) const {
+        const LightSample lightSample =
+            m_scene->sampleLight(its.position, rng);
+        if (!lightSample)
+            return Color(0.f);
+
+        const Light *light = lightSample.light;
+        const DirectLightSample direct = light->sampleDirect(its.position, rng);
+        if (direct.isInvalid())
+            return Color(0.f);
+
+        const BsdfEval bsdf = its.evaluateBsdf(direct.wi);
+        if (bsdf.isInvalid())
+            return Color(0.f);
+        float weight = 1;
+        if (light->canBeIntersected()) {
+            const float lightPdf = direct.pdf * lightSample.probability;
+            weight = lightPdf / (lightPdf + scatterPdf(region,
+                                                       guiding,
+                                                       direct.wi,
+                                                       bsdf.pdf));
+        }
+
+        const Ray shadowRay{ its.position, direct.wi };
+        const float trans =
+            m_scene->transmittance(shadowRay, direct.distance, rng);
+        if (trans <= 0.f)
+            return Color(0.f);
+        return weight * trans * bsdf.value * direct.weight /
+               lightSample.probability;
+    }
+
+protected:
+    void finishPass(int samples) override {
+        m_field.refine(samples);
+        logger(EInfo,
+               "guiding: %d regions using %.1f MiB",
+               m_field.numRegions(),
+               m_field.memoryUsage() / 1048576.0);
+    }
+
+public:
+    GuidedIntegrator(const Properties &properties)
+        : SamplingIntegrator(properties),
+          m_field(m_scene->getBoundingBox(),
+                  size_t(properties.get<float>("guidingMemory", 128) *
+                         1048576),
+                  properties.get<float>("spatialThreshold", 12000),
+                  properties.get<float>("directionalThreshold", 0.01f)) {
+        m_depth        = properties.get<int>("depth", 2);
+        m_bsdfFraction = properties.get<float>("bsdfFraction", 0.5f);
+        if (m_bsdfFraction <= 0 || m_bsdfFraction > 1)
+            lightwave_throw("bsdfFraction must lie in (0, 1]");
+        m_renderInPasses = true;
+    }
+
+    Color Li(const Ray &cameraRay, Sampler &rng) override {
+        std::array<Vertex, MaxVertices> vertices;
+        int numVertices = 0;
+        // adds radiance found by the path to all vertices it passed through
+        const auto addToVertices = [&](const Color &contribution, int count) {
+            for (int i = 0; i < count; i++)
+                vertices[i].add(contribution);
+        };
+
+        Ray ray = cameraRay;
+        Color throughput(1.f);
+        Color result(0.f);
+        float pdf = 0;
+        // whether the vertex the ray was sampled from is recorded
+        bool isRecorded = false;
+        for (int depth = 0; depth < m_depth; depth++) {
+            const Intersection its = m_scene->intersect(ray, rng);
+            const EmissionEval emission = its.evaluateEmission();
+
+            if (!its || emission) {
+                float weight = 1;
+                if (depth > 0 && pdf > 0) {
+                    // the density with which light sampling finds the emission
+                    float lightPdf = 0;
+                    if (its) {
+                        const float cosTheta =
+                            abs(its.shadingNormal.dot(ray.direction));
+                        lightPdf = its.pdf * its.lightProbability() * its.t *
+                                   its.t / std::max(cosTheta, Epsilon);
+                    } else if (its.background) {
+                        lightPdf = emission.pdf * its.lightProbability();
+                    }
+                    weight = pdf / (pdf + lightPdf);
+                }
+
+                const Color value = throughput * emission.value;
+                result += weight * value;
+                // the vertex the emission was sampled from learns about all of
+                // it, regardless of how much next event estimation finds
+                if (isRecorded) {
+                    addToVertices(weight * value, numVertices - 1);
+                    vertices[numVertices - 1].add(value);
+                } else {
+                    addToVertices(weight * value, numVertices);
+                }
+            }
+            if (!its || depth == m_depth - 1)
+                break;
+
+            GuidingField::Region &region = m_field.lookup(its.position);
+            const float guiding = guidingProbability(its, region);
+            if (m_scene->hasLights()) {
+                const Color direct =
+                    throughput * sampleLight(its, region, guiding, rng);
+                result += direct;
+                addToVertices(direct, numVertices);
+            }
+
+            const ScatterSample sample = scatter(its, region, guiding, rng);
+            if (sample.weight == Color(0))
+                break;
+            throughput *= sample.weight;
+            ray = Ray(its.position, sample.wi);
+            pdf = sample.pdf;
+
+            isRecorded = numVertices < MaxVertices && pdf > 0;
+            if (isRecorded) {
+                vertices[numVertices++] = {
+                    .region     = &region,
+                    .wi         = sample.wi,
+                    .throughput = throughput,
+                    .pdf        = pdf,
+                    .radiance   = Color(0.f),
+                };
+            }
+        }
+
+        for (int i = 0; i < numVertices; i++) {
+            GuidingField::record(*vertices[i].region,
+                                 vertices[i].wi,
+                                 vertices[i].radiance.luminance() /
+                                     vertices[i].pdf);
+        }
+        return result;
+    }
+
+    std::string toString() const override {
+        return tfm::format("GuidedIntegrator[\n"
+                           "  sampler = %s,\n"
+                           "  image = %s,\n"
+                           "]",
+                           indent(m_sampler), indent(m_image));
+    }
+};
+
+} // namespace lightwave
+
+REGISTER_INTEGRATOR(GuidedIntegrator, "guided")
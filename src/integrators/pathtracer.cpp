@@ -5,51 +5,84 @@ namespace lightwave {
 class pathTracerIntegrator : public SamplingIntegrator {
     int m_depth;
     bool m_nee;
+    PathTermination m_termination;
+
+    /// @brief Continues a path from the given intersection by sampling the
+    /// Bsdf, and returns false if sampling failed.
+    static bool scatter(const Intersection &its, Ray &ray, Color &throughput,
+                        Sampler &rng) {
+        BsdfSample bsdfSample = its.sampleBsdf(rng);
+        if (bsdfSample.isInvalid()) return false;
+        throughput *= bsdfSample.weight;
+        ray = Ray(its.position, bsdfSample.wi);
+        return true;
+    }
 
 public:
     pathTracerIntegrator(const Properties &properties)
-        : SamplingIntegrator(properties) {
+        : SamplingIntegrator(properties),
+          m_termination(properties, m_scene->getBoundingBox()) {
         m_depth = properties.get<int>("depth", 2);
         m_nee   = properties.get<bool>("nee", true);
     }
 
+    void execute() override {
+        SamplingIntegrator::execute();
+        m_termination.report();
+    }
+
     Color Li(const Ray &ray, Sampler &rng) override {
+        PathTermination::Path path = m_termination.start();
+
         Ray _ray = ray;
         Color throughput(1.f);
         Color c(0.f);
-        for (int path_len = 0; path_len < m_depth; path_len++) {
-            Intersection its = m_scene->intersect(_ray, rng);
-            if (!its) {
-                c += throughput * its.evaluateEmission().value;
-                break;
-            }
+        int path_len = 0;
+        for (;;) {
+            for (; path_len < m_depth; path_len++) {
+                Intersection its = m_scene->intersect(_ray, rng);
+                if (!its) {
+                    c += throughput * its.evaluateEmission().value;
+                    break;
+                }
 
-            c += its.evaluateEmission().value * throughput;
+                c += its.evaluateEmission().value * throughput;
+                m_termination.visit(path, its.position, throughput, c);
 
-            if (path_len == m_depth - 1)
-                break;
+                if (path_len == m_depth - 1)
+                    break;
 
-            if (m_nee && m_scene-> hasLights()) {
-                LightSample lightSample = m_scene->sampleLight(rng);             
-                if (lightSample) {
-                    const Light *light = lightSample.light;
-                    if (!light->canBeIntersected()) {
-                        DirectLightSample dSample = light->sampleDirect(its.position, rng);
-
-                        Ray shadowRay{ its.position, dSample.wi };
-                        float trans = m_scene->transmittance(
-                            shadowRay, dSample.distance, rng);
-                        if (trans > 0.f)
-                            c += trans * throughput * its.evaluateBsdf(dSample.wi).value * dSample.weight / lightSample.probability;
+                if (m_nee && m_scene-> hasLights()) {
+                    LightSample lightSample = m_scene->sampleLight(its.position, rng);             
+                    if (lightSample) {
+                        const Light *light = lightSample.light;
+                        if (!light->canBeIntersected()) {
+                            DirectLightSample dSample = light->sampleDirect(its.position, rng);
+
+                            Ray shadowRay{ its.position, dSample.wi };
+                            float trans = m_scene->transmittance(
+                                shadowRay, dSample.distance, rng);
+                            if (trans > 0.f)
+                                c += trans * throughput * its.evaluateBsdf(dSample.wi).value * dSample.weight / lightSample.probability;
+                        }
                     }
                 }
+
+                if (!m_termination.decide(path, its, path_len, throughput,
+                                          rng) ||
+                    !scatter(its, _ray, throughput, rng))
+                    break;
             }
+            m_termination.terminate(path, c);
 
-            BsdfSample bsdfSample = its.sampleBsdf(rng);
-            if (bsdfSample.isInvalid()) break;
-            throughput *= bsdfSample.weight;
-            _ray = Ray(its.position, bsdfSample.wi);
+            const bool resumed = m_termination.resume(
+                path, throughput, path_len, [&](const Intersection &its) {
+                    return scatter(its, _ray, throughput, rng);
+                });
+            if (!resumed)
+                break;
         }
+        m_termination.finish(path);
         return c;
     }
 
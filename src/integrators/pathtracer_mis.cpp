@@ -3,152 +3,184 @@
 namespace lightwave {
 
 class pathTracerMISIntegrator : public SamplingIntegrator {
+    /// @brief How light sources are found by paths.
+    enum class Strategy {
+        /// @brief Combines light and Bsdf sampling using multiple importance
+        /// sampling (balance heuristic).
+        Mis,
+        /// @brief Only finds light sources through next event estimation
+        /// (except for emission directly visible to the camera).
+        Nee,
+        /// @brief Only finds light sources by hitting them via Bsdf sampling.
+        Bsdf,
+    };
+
     int m_depth;
-    std::string m_strategy;
+    Strategy m_strategy;
+    PathTermination m_termination;
+    /// @brief The instantiation of @ref trace for the selected strategy.
+    Color (pathTracerMISIntegrator::*m_trace)(const Ray &, Sampler &) const;
+
+    /// @brief The weight of emission that has been hit by a Bsdf sample with
+    /// density @c bsdfPdf , where @c lightPdf is the density with which light
+    /// sampling would have found the same point.
+    template <Strategy S>
+    static float hitWeight(float bsdfPdf, float lightPdf) {
+        if constexpr (S == Strategy::Mis)
+            return bsdfPdf / (bsdfPdf + lightPdf);
+        if constexpr (S == Strategy::Nee)
+            return 0;
+        return 1;
+    }
 
-public:
-    pathTracerMISIntegrator(const Properties &properties)
-        : SamplingIntegrator(properties) {
-        m_depth = properties.get<int>("depth", 2);
-        m_strategy = properties.get<std::string>("strategy", "mis");
+    /// @brief Continues a path from the given intersection by sampling the
+    /// Bsdf, and returns false if sampling failed.
+    static bool scatter(const Intersection &its, Ray &ray, Color &throughput,
+                        float &bsdfPdf, Sampler &rng) {
+        const BsdfSample bsdfSample = its.sampleBsdf(rng);
+        if (bsdfSample.isInvalid())
+            return false;
+        throughput *= bsdfSample.weight;
+        ray     = Ray(its.position, bsdfSample.wi);
+        bsdfPdf = bsdfSample.pdf;
+        return true;
     }
 
-    Color Li(const Ray &ray, Sampler &rng) override {
-        if (m_strategy == "mis") {
-            Ray _ray = ray;
-            Color throughput(1.f);
-            Color c(0.f);
-            float pre_bsdf = 0.f;
-            for (int path_len = 0; path_len < m_depth; path_len++) {
-                Intersection its = m_scene->intersect(_ray, rng);
-
-                // hit background
+    template <Strategy S> Color trace(const Ray &cameraRay, Sampler &rng) const {
+        PathTermination::Path path = m_termination.start();
+
+        Ray ray = cameraRay;
+        Color throughput(1.f);
+        Color result(0.f);
+        float bsdfPdf = 0;
+        int depth     = 0;
+        for (;;) {
+            for (; depth < m_depth; depth++) {
+                const Intersection its = m_scene->intersect(ray, rng);
+                const EmissionEval emission = its.evaluateEmission();
+
                 if (!its) {
+                    // hit background
                     if (its.background) {
-                        if (path_len == 0) {
-                            c += throughput * its.evaluateEmission().value;
-                        } else {
-                            float pdf_light = its.evaluateEmission().pdf * its.lightProbability;
-                            float mis_bsdf = pre_bsdf / (pre_bsdf + pdf_light);
-                            c += throughput * its.evaluateEmission().value * mis_bsdf;
+                        float weight = 1;
+                        if (depth > 0 && S != Strategy::Bsdf) {
+                            weight = hitWeight<S>(
+                                bsdfPdf, emission.pdf * its.lightProbability());
                         }
+                        result += weight * throughput * emission.value;
                     }
                     break;
                 }
-            
-                // hit light source
-                if (its.evaluateEmission()) {
-                    if (path_len == 0) {
-                        c += its.evaluateEmission().value * throughput;
-                    } else {
-                        float cosTheta = std::abs(its.shadingNormal.dot(-_ray.direction));
-                        float pdf_light = its.pdf * its.lightProbability * its.t * its.t / std::max(cosTheta, Epsilon);
-                        float mis_bsdf = pre_bsdf / (pre_bsdf + pdf_light);
-                        c += mis_bsdf * throughput * its.evaluateEmission().value;
-                    }
-                }
 
-                if (path_len == m_depth - 1)
-                    break;
-
-                if (m_scene->hasLights()) {
-                    LightSample lightSample = m_scene->sampleLight(rng);             
-                    if (lightSample) {
-                        const Light *light = lightSample.light;
-                        DirectLightSample dSample = light->sampleDirect(its.position, rng);
-                        if (!dSample.isInvalid()) {
-                            Ray shadowRay{ its.position, dSample.wi };
-
-                            float pdf_light = dSample.pdf * lightSample.probability;
-                            float pdf_bsdf = its.evaluateBsdf(dSample.wi).pdf;
-                            float light_mis = light->canBeIntersected() ? pdf_light / (pdf_light + pdf_bsdf) : 1.f;
-
-                            float trans = m_scene->transmittance(
-                                shadowRay, dSample.distance, rng);
-                            if (trans > 0.f)
-                                c += light_mis * trans * throughput * its.evaluateBsdf(dSample.wi).value * dSample.weight / lightSample.probability;
+                // hit light source
+                if (emission) {
+                    float weight = 1;
+                    if (depth > 0) {
+                        float lightPdf = 0;
+                        if constexpr (S == Strategy::Mis) {
+                            const float cosTheta =
+                                abs(its.shadingNormal.dot(ray.direction));
+                            lightPdf = its.pdf * its.lightProbability() *
+                                       its.t * its.t /
+                                       std::max(cosTheta, Epsilon);
                         }
+                        weight = hitWeight<S>(bsdfPdf, lightPdf);
                     }
+                    result += weight * throughput * emission.value;
                 }
+                m_termination.visit(path, its.position, throughput, result);
 
-                BsdfSample bsdfSample = its.sampleBsdf(rng);
-                if (bsdfSample.isInvalid()) break;
-                throughput *= bsdfSample.weight;
-                _ray = Ray(its.position, bsdfSample.wi);
-                pre_bsdf = bsdfSample.pdf;
-            }
-            return c;
-        } else if (m_strategy == "nee") {
-            Ray _ray = ray;
-            Color throughput(1.f);
-            Color c(0.f);
-            for (int path_len = 0; path_len < m_depth; path_len++) {
-                Intersection its = m_scene->intersect(_ray, rng);
-                if (!its) {
-                    if (its.background) {
-                        if (path_len == 0) {
-                            c += throughput * its.evaluateEmission().value;
-                        }
-                    }
+                if (depth == m_depth - 1)
                     break;
-                }
 
-                if (its.evaluateEmission()) {
-                    if (path_len == 0) {
-                        c += its.evaluateEmission().value * throughput;
+                if constexpr (S != Strategy::Bsdf) {
+                    if (m_scene->hasLights()) {
+                        result += throughput * sampleLight<S>(its, rng);
                     }
                 }
 
-                if (path_len == m_depth - 1)
+                if (!m_termination.decide(path, its, depth, throughput, rng) ||
+                    !scatter(its, ray, throughput, bsdfPdf, rng))
                     break;
+            }
+            m_termination.terminate(path, result);
+
+            // continue with a path that has been split off, if any
+            const bool resumed = m_termination.resume(
+                path, throughput, depth, [&](const Intersection &its) {
+                    return scatter(its, ray, throughput, bsdfPdf, rng);
+                });
+            if (!resumed)
+                break;
+        }
+        m_termination.finish(path);
+        return result;
+    }
 
-                if (m_scene->hasLights()) {
-                    LightSample lightSample = m_scene->sampleLight(rng);             
-                    if (lightSample) {
-                        const Light *light = lightSample.light;
-                        DirectLightSample dSample = light->sampleDirect(its.position, rng);
-                        if (!dSample.isInvalid()) {
-                            Ray shadowRay{ its.position, dSample.wi };
-                            float trans = m_scene->transmittance(
-                                shadowRay, dSample.distance, rng);
-                            if (trans > 0.f)
-                                c += trans * throughput * its.evaluateBsdf(dSample.wi).value * dSample.weight / lightSample.probability;
-                        }
-                    }
-                }
-
-                BsdfSample bsdfSample = its.sampleBsdf(rng);
-                if (bsdfSample.isInvalid()) break;
-                throughput *= bsdfSample.weight;
-                _ray = Ray(its.position, bsdfSample.wi);
+    /// @brief Estimates the light arriving at the intersection directly from
+    /// a randomly picked light source (next event estimation).
+    template <Strategy S>
+    Color sampleLight(const Intersection &its, Sampler &rng) const {
+        const LightSample lightSample =
+            m_scene->sampleLight(its.position, rng);
+        if (!lightSample)
+            return Color(0.f);
+
+        const Light *light = lightSample.light;
+        const DirectLightSample direct = light->sampleDirect(its.position, rng);
+        if (direct.isInvalid())
+            return Color(0.f);
+
+        const BsdfEval bsdf = its.evaluateBsdf(direct.wi);
+        float weight        = 1;
+        if constexpr (S == Strategy::Mis) {
+            if (light->canBeIntersected()) {
+                const float lightPdf = direct.pdf * lightSample.probability;
+                weight               = lightPdf / (lightPdf + bsdf.pdf);
             }
-            return c;
-        } else if (m_strategy == "bsdf") {
-            Ray _ray = ray;
-            Color throughput(1.f);
-            Color c(0.f);
-            for (int path_len = 0; path_len < m_depth; path_len++) {
-                Intersection its = m_scene->intersect(_ray, rng);
+        }
 
-                if (!its) {
-                    if (its.background) {
-                        c += throughput * its.evaluateEmission().value;
-                    }
-                    break;
-                }
+        const Ray shadowRay{ its.position, direct.wi };
+        const float trans =
+            m_scene->transmittance(shadowRay, direct.distance, rng);
+        if (trans <= 0.f)
+            return Color(0.f);
+        return weight * trans * bsdf.value * direct.weight /
+               lightSample.probability;
+    }
 
-                c += throughput * its.evaluateEmission().value;
+public:
+    pathTracerMISIntegrator(const Properties &properties)
+        : SamplingIntegrator(properties),
+          m_termination(properties, m_scene->getBoundingBox()) {
+        m_depth    = properties.get<int>("depth", 2);
+        m_strategy = properties.getEnum<Strategy>("strategy",
+                                                  Strategy::Mis,
+                                                  {
+                                                      { "mis", Strategy::Mis },
+                                                      { "nee", Strategy::Nee },
+                                                      { "bsdf", Strategy::Bsdf },
+                                                  });
+        switch (m_strategy) {
+        case Strategy::Mis:
+            m_trace = &pathTracerMISIntegrator::trace<Strategy::Mis>;
+            break;
+        case Strategy::Nee:
+            m_trace = &pathTracerMISIntegrator::trace<Strategy::Nee>;
+            break;
+        case Strategy::Bsdf:
+            m_trace = &pathTracerMISIntegrator::trace<Strategy::Bsdf>;
+            break;
+        }
+    }
 
-                if (path_len == m_depth - 1)
-                    break;
+    void execute() override {
+        SamplingIntegrator::execute();
+        m_termination.report();
+    }
 
-                BsdfSample bsdfSample = its.sampleBsdf(rng);
-                if (bsdfSample.isInvalid()) break;
-                throughput *= bsdfSample.weight;
-                _ray = Ray(its.position, bsdfSample.wi);
-            }
-            return c;
-        }
+    Color Li(const Ray &ray, Sampler &rng) override {
+        return (this->*m_trace)(ray, rng);
     }
 
     /// @brief An optional textual representation of this class, which can be
@@ -164,4 +196,4 @@ public:
 
 } // namespace lightwave
 
-REGISTER_INTEGRATOR(pathTracerMISIntegrator, "pathtracer_mis")
\ No newline at end of file
+REGISTER_INTEGRATOR(pathTracerMISIntegrator, "pathtracer_mis")
@@ -0,0 +1,311 @@
+#include <lightwave.hpp>
+
+namespace lightwave {
+
+/**
+ * @brief A path tracer that traces all paths of a block breadth-first: instead
+ * of following one path after another (as @ref Li does), every bounce is
+ * processed for all paths of the block in stages before moving on to the next
+ * bounce.
+ *
+ * 1. @b generate creates one camera ray per pixel of the block.
+ * 2. @b extend finds the closest intersection for all active rays.
+ * 3. @b shade adds emission, queues a shadow ray towards a sampled light, and
+ *    samples the Bsdf to continue each path.
+ * 4. @b connect traces all queued shadow rays.
+ *
+ * Each stage keeps the state of all paths in one array per attribute, except
+ * for the closest hits, which are stored as full @ref Intersection records
+ * since shading evaluates them through their methods. Rays can be sorted by
+ * material (before shading) and by direction (before extending), so that
+ * similar work is executed together. The estimator is the same as the
+ * "mis" strategy of the "pathtracer_mis" integrator.
+ */
+class WavefrontIntegrator : public SamplingIntegrator {
+    /// @brief The state of all paths of a block, with one array per attribute.
+    struct PathQueue {
+        std::vector<Point> origins;
+        std::vector<Vector> directions;
+        std::vector<Color> throughputs;
+        std::vector<Color> radiance;
+        /// @brief The pdf of the Bsdf sample that generated the current ray,
+        /// which is needed to weight emission that is hit (0 for camera rays).
+        std::vector<float> bsdfPdfs;
+        std::vector<Sampler *> samplers;
+        /// @brief The camera ray of each path, which (unlike the arrays of
+        /// origins and directions) keeps the ray differentials that textures
+        /// are filtered with.
+        std::vector<Ray> cameraRays;
+        /// @brief The closest hit of the current ray of each path, which is
+        /// kept whole since shading calls its methods.
+        std::vector<Intersection> hits;
+        /// @brief The indices of paths that have not terminated yet.
+        std::vector<int> active;
+
+        void resize(int size) {
+            origins.resize(size);
+            directions.resize(size);
+            throughputs.resize(size);
+            radiance.resize(size);
+            bsdfPdfs.resize(size);
+            samplers.resize(size);
+            cameraRays.resize(size);
+            hits.resize(size);
+            active.reserve(size);
+        }
+
+        /// @brief Starts a new path in the given slot.
+        void start(int path, const Ray &ray, const Color &weight,
+                   Sampler *sampler) {
+            origins[path]     = ray.origin;
+            directions[path]  = ray.direction;
+            throughputs[path] = weight;
+            radiance[path]    = Color(0);
+            bsdfPdfs[path]    = 0;
+            samplers[path]    = sampler;
+            cameraRays[path]  = ray;
+            active.push_back(path);
+        }
+    };
+
+    /// @brief Shadow rays towards sampled points on lights, stored as a
+    /// structure of arrays.
+    struct ShadowQueue {
+        std::vector<Point> origins;
+        std::vector<Vector> directions;
+        std::vector<float> distances;
+        /// @brief The radiance that reaches the path if the ray is unoccluded.
+        std::vector<Color> contributions;
+        /// @brief The path each shadow ray belongs to.
+        std::vector<int> paths;
+
+        int size() const { return int(paths.size()); }
+
+        void clear() {
+            origins.clear();
+            directions.clear();
+            distances.clear();
+            contributions.clear();
+            paths.clear();
+        }
+
+        void push(const Point &origin, const Vector &direction, float distance,
+                  const Color &contribution, int path) {
+            origins.push_back(origin);
+            directions.push_back(direction);
+            distances.push_back(distance);
+            contributions.push_back(contribution);
+            paths.push_back(path);
+        }
+    };
+
+    int m_depth;
+    bool m_sortRays;
+
+    /// @brief Reorders the active paths by the given key.
+    template <typename KeyFunction>
+    static void sortActive(PathQueue &paths, KeyFunction key) {
+        std::vector<std::pair<uint64_t, int>> keys;
+        keys.reserve(paths.active.size());
+        for (const int path : paths.active)
+            keys.emplace_back(key(path), path);
+        std::sort(keys.begin(), keys.end());
+        for (size_t i = 0; i < keys.size(); i++)
+            paths.active[i] = keys[i].second;
+    }
+
+    void extend(PathQueue &paths, int depth) const {
+        for (const int path : paths.active) {
+            // secondary rays carry no differentials, so only camera rays
+            // need to be traced with their full state
+            paths.hits[path] = m_scene->intersect(
+                depth == 0 ? paths.cameraRays[path]
+                           : Ray(paths.origins[path], paths.directions[path]),
+                *paths.samplers[path]);
+        }
+    }
+
+    void shade(PathQueue &paths, ShadowQueue &shadows, int depth) const {
+        int numActive = 0;
+        for (const int path : paths.active) {
+            const Intersection &its = paths.hits[path];
+            const Color &throughput = paths.throughputs[path];
+            const float bsdfPdf     = paths.bsdfPdfs[path];
+            Sampler &rng            = *paths.samplers[path];
+
+            if (!its) {
+                if (its.background) {
+                    const EmissionEval emission = its.evaluateEmission();
+                    float misWeight             = 1;
+                    if (depth > 0) {
+                        const float lightPdf =
+                            emission.pdf * its.lightProbability();
+                        misWeight = bsdfPdf / (bsdfPdf + lightPdf);
+                    }
+                    paths.radiance[path] +=
+                        misWeight * throughput * emission.value;
+                }
+                continue;
+            }
+
+            if (const EmissionEval emission = its.evaluateEmission()) {
+                float misWeight = 1;
+                if (depth > 0) {
+                    const float cosTheta =
+                        abs(its.shadingNormal.dot(paths.directions[path]));
+                    const float lightPdf = its.pdf * its.lightProbability() *
+                                           its.t * its.t /
+                                           std::max(cosTheta, Epsilon);
+                    misWeight = bsdfPdf / (bsdfPdf + lightPdf);
+                }
+                paths.radiance[path] += misWeight * throughput * emission.value;
+            }
+
+            if (depth == m_depth - 1)
+                continue;
+
+            if (m_scene->hasLights()) {
+                if (const LightSample lightSample =
+                        m_scene->sampleLight(its.position, rng)) {
+                    const Light *light = lightSample.light;
+                    const DirectLightSample direct =
+                        light->sampleDirect(its.position, rng);
+                    if (!direct.isInvalid()) {
+                        const BsdfEval bsdf   = its.evaluateBsdf(direct.wi);
+                        const float lightPdf  = direct.pdf *
+                                                lightSample.probability;
+                        const float misWeight =
+                            light->canBeIntersected()
+                                ? lightPdf / (lightPdf + bsdf.pdf)
+                                : 1.f;
+                        shadows.push(its.position,
+                                     direct.wi,
+                                     direct.distance,
+                                     misWeight * throughput * bsdf.value *
+                                         direct.weight /
+                                         lightSample.probability,
+                                     path);
+                    }
+                }
+            }
+
+            const BsdfSample bsdfSample = its.sampleBsdf(rng);
+            if (bsdfSample.isInvalid())
+                continue;
+            paths.throughputs[path] *= bsdfSample.weight;
+            paths.origins[path]    = its.position;
+            paths.directions[path] = bsdfSample.wi;
+            paths.bsdfPdfs[path]   = bsdfSample.pdf;
+            paths.active[numActive++] = path;
+        }
+        paths.active.resize(numActive);
+    }
+
+    void connect(const ShadowQueue &shadows, PathQueue &paths) const {
+        for (int i = 0; i < shadows.size(); i++) {
+            const int path    = shadows.paths[i];
+            const float trans = m_scene->transmittance(
+                Ray(shadows.origins[i], shadows.directions[i]),
+                shadows.distances[i],
+                *paths.samplers[path]);
+            if (trans > 0)
+                paths.radiance[path] += trans * shadows.contributions[i];
+        }
+    }
+
+    /// @brief Traces all active paths until they terminate.
+    void trace(PathQueue &paths, ShadowQueue &shadows) const {
+        for (int depth = 0; depth < m_depth && !paths.active.empty();
+             depth++) {
+            if (m_sortRays && depth > 0) {
+                // rays with the same direction signs traverse the scene
+                // similarly
+                sortActive(paths, [&](int path) {
+                    const Vector &d = paths.directions[path];
+                    return uint64_t((d.x() < 0) | (d.y() < 0) << 1 |
+                                    (d.z() < 0) << 2);
+                });
+            }
+            extend(paths, depth);
+
+            if (m_sortRays) {
+                sortActive(paths, [&](int path) {
+                    const Intersection &its = paths.hits[path];
+                    return uint64_t(reinterpret_cast<uintptr_t>(
+                        its.instance ? its.instance->bsdf() : nullptr));
+                });
+            }
+            shadows.clear();
+            shade(paths, shadows, depth);
+            connect(shadows, paths);
+        }
+    }
+
+public:
+    WavefrontIntegrator(const Properties &properties)
+        : SamplingIntegrator(properties) {
+        m_depth    = properties.get<int>("depth", 2);
+        m_sortRays = properties.get<bool>("sortRays", false);
+    }
+
+    void renderBlock(const Range &spps, Sampler &sampler,
+                     BlockSamples &samples) override {
+        const Bounds2i &block = samples.block();
+        const int numPixels   = block.diagonal().product();
+
+        // every path needs its own sampler, since its dimensions are consumed
+        // across all stages
+        std::vector<ref<Sampler>> samplers(numPixels);
+        for (auto &pathSampler : samplers)
+            pathSampler = sampler.clone();
+
+        PathQueue paths;
+        paths.resize(numPixels);
+        ShadowQueue shadows;
+
+        for (auto sample : spps) {
+            // generate
+            paths.active.clear();
+            int path = 0;
+            for (auto pixel : block) {
+                Sampler &rng = *samplers[path];
+                rng.seed(pixel, sample);
+                const CameraSample cameraSample =
+                    m_scene->camera()->sample(pixel, rng);
+                paths.start(path++, cameraSample.ray, cameraSample.weight, &rng);
+            }
+
+            trace(paths, shadows);
+            path = 0;
+            for (auto pixel : block)
+                samples.add(pixel, paths.radiance[path++]);
+        }
+    }
+
+    Color Li(const Ray &ray, Sampler &rng) override {
+        PathQueue paths;
+        paths.resize(1);
+        paths.start(0, ray, Color(1), &rng);
+        ShadowQueue shadows;
+        trace(paths, shadows);
+        return paths.radiance[0];
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "WavefrontIntegrator[\n"
+            "  sampler = %s,\n"
+            "  image = %s,\n"
+            "  depth = %d,\n"
+            "  sortRays = %s,\n"
+            "]",
+            indent(m_sampler),
+            indent(m_image),
+            m_depth,
+            m_sortRays);
+    }
+};
+
+} // namespace lightwave
+
+REGISTER_INTEGRATOR(WavefrontIntegrator, "wavefront")
@@ -42,6 +42,40 @@ public:
 
     bool canBeIntersected() const override { return m_instance->isVisible(); }
 
+    std::optional<LightBounds> bounds() const override {
+        const float area = m_instance->getSurfaceArea();
+        if (area == 0)
+            return std::nullopt;
+
+        // the average radiance, estimated from a grid of texture coordinates
+        constexpr int Resolution = 8;
+        float radiance           = 0;
+        for (int y = 0; y < Resolution; y++) {
+            for (int x = 0; x < Resolution; x++) {
+                const Point2 uv{ (x + 0.5f) / Resolution,
+                                 (y + 0.5f) / Resolution };
+                radiance += m_instance->emission()
+                                ->evaluate(uv, Vector(0, 0, 1))
+                                .value.luminance();
+            }
+        }
+        radiance /= Resolution * Resolution;
+
+        LightBounds result;
+        result.bounds = m_instance->getBoundingBox();
+        result.power  = samplingWeight() * Pi * area * radiance;
+        if (const auto normal = m_instance->getPlanarNormal()) {
+            result.axis      = *normal;
+            result.cosThetaO = 1;
+        } else {
+            result.axis      = Vector(0, 0, 1);
+            result.cosThetaO = -1;
+        }
+        // diffuse emission leaves in all directions of the hemisphere
+        result.cosThetaE = 0;
+        return result;
+    }
+
     std::string toString() const override {
         return tfm::format(
             "AreaLight[\n"
@@ -118,7 +118,7 @@ public:
 
         auto imageTex = std::dynamic_pointer_cast<ImageTexture>(m_texture);
         if (m_importanceSampling && imageTex) {
-            Point2i res = imageTex->getImage()->resolution();
+            Point2i res = imageTex->resolution();
             int width = res.x(), height = res.y();
             std::unique_ptr<float[]> img(new float[width * height]);
             for (int v = 0; v < height; ++v) {
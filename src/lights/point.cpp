@@ -25,6 +25,16 @@ public:
 
     bool canBeIntersected() const override { return false; }
 
+    std::optional<LightBounds> bounds() const override {
+        return LightBounds{
+            .bounds    = Bounds(m_position, m_position),
+            .power     = samplingWeight() * m_power.luminance(),
+            .axis      = Vector(0, 0, 1),
+            .cosThetaO = -1,
+            .cosThetaE = 0,
+        };
+    }
+
     std::string toString() const override {
         return tfm::format(
             "PointLight[\n"
@@ -41,6 +41,18 @@ public:
 
     bool canBeIntersected() const override { return false; }
 
+    std::optional<LightBounds> bounds() const override {
+        return LightBounds{
+            .bounds    = Bounds(m_position, m_position),
+            .power     = samplingWeight() * m_power.luminance(),
+            .axis      = m_direction,
+            // the only "normal" of the light is its axis, and light leaves at
+            // angles up to the opening angle of the cone
+            .cosThetaO = 1,
+            .cosThetaE = cos(m_angle * Pi / 180.f),
+        };
+    }
+
     std::string toString() const override {
         return tfm::format(
             "SpotLight[\n"
@@ -1,13 +1,93 @@
 #pragma once
 
 #include <lightwave/core.hpp>
+#include <lightwave/hash.hpp>
+#include <lightwave/mappedfile.hpp>
 #include <lightwave/math.hpp>
+#include <lightwave/parallel.hpp>
 #include <lightwave/shape.hpp>
 
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
 #include <numeric>
+#include <optional>
+
+#ifdef LW_CPU_X86
+#include <immintrin.h>
+#endif
 
 namespace lightwave {
 
+/**
+ * @brief The memory layout of the BVH that is used for traversal.
+ * Wide layouts are collapsed from the binary SAH tree and test the bounding
+ * boxes of 4 or 8 children with a single SIMD slab test.
+ */
+enum class BvhLayout {
+    Binary,
+    Wide4,
+    Wide8,
+};
+
+/// @brief Settings that control how a BVH is built.
+struct BvhSettings {
+    /// @brief The layout of the BVH that is used for traversal.
+    BvhLayout layout = BvhLayout::Binary;
+    /**
+     * @brief Whether nodes may also be split spatially (SBVH), which places
+     * primitives that straddle the split plane in both children. This greatly
+     * reduces the overlap of nodes for long, thin primitives, but is only
+     * sound for shapes whose transmittance is unaffected by testing the same
+     * primitive several times (e.g., triangle meshes).
+     */
+    bool spatialSplits = false;
+    /// @brief The maximum number of additional primitive references that
+    /// spatial splits may create, relative to the number of primitives.
+    float duplicationBudget = 0.3f;
+    /**
+     * @brief Spatial splits are only attempted if the children of the best
+     * object split overlap by more than this fraction of the surface area of
+     * the root node (see "Spatial Splits in Bounding Volume Hierarchies",
+     * Stich et al. 2009).
+     */
+    float spatialSplitAlpha = 1e-5f;
+    /**
+     * @brief The directory in which built BVHs are cached, or empty to always
+     * build BVHs from scratch. Cached BVHs are identified by the content of
+     * the shape (see @ref AccelerationStructure::contentHash ) and the build
+     * settings.
+     */
+    std::filesystem::path cacheDirectory;
+    /**
+     * @brief How much the SAH cost of a BVH may grow through refitting (see
+     * @ref AccelerationStructure::refit ), relative to its cost right after it
+     * has been built, before it is rebuilt from scratch.
+     */
+    float refitThreshold = 1.5f;
+    /**
+     * @brief Nodes with at most this many primitives become leaves. Larger
+     * leaves pay off for shapes that test several primitives at once.
+     */
+    int leafSize = 2;
+    /**
+     * @brief Pads the primitive indices so that the range of every leaf
+     * starts at a multiple of this, which lets shapes store per-leaf data in
+     * fixed size blocks (e.g., SIMD packets of triangles).
+     */
+    int leafAlignment = 1;
+    /**
+     * @brief Whether large subtrees are built by the thread pool. Serial
+     * builds produce the exact same BVH, which lets them serve as reference
+     * for the parallel build (e.g., to measure its speedup).
+     */
+    bool parallelBuild = true;
+};
+
 /**
  * @brief Parent class for shapes that combine many individual shapes (e.g.,
  * triangle meshes), and hence benefit from building an acceleration structure
@@ -23,6 +103,10 @@ namespace lightwave {
  * - getCentroid(primitiveIndex)    -- return the centroid of a single child
  * (used for building the BVH)
  *
+ * Shapes whose per-primitive methods are cheap (e.g., a triangle test) should
+ * derive from @ref InlineAccelerationStructure instead, which calls them
+ * without virtual dispatch.
+ *
  * @example For a simple example of how to use this class, look at @ref
  * shapes/group.cpp
  * @see Group
@@ -76,7 +160,210 @@ class AccelerationStructure : public Shape {
         int primitiveCount = 0;
     };
 
+    /// @brief The number of bins per axis used by binned SAH.
+    static constexpr int BinCount = 16;
+    /// @brief The bins of all three axes for a range of primitives.
+    typedef std::array<std::array<Bin, BinCount>, 3> AxisBins;
+
+    /**
+     * @brief Nodes with more primitives than this are processed by the thread
+     * pool: their binning sweep is split into chunks of this size, and their
+     * subtrees are built as separate tasks.
+     */
+    static constexpr NodeIndex ParallelBuildThreshold = 4096;
+
+    /// @brief A BVH node while the BVH is being built, before it is placed at
+    /// its final index in m_nodes.
+    struct BuildNode {
+        Node node;
+        /// @brief The slots of the left and right child in @ref
+        /// BuildContext::nodes , or -1 for leaf nodes.
+        NodeIndex children[2] = { -1, -1 };
+    };
+
+    /// @brief State shared by all tasks that participate in building the BVH.
+    struct BuildContext {
+        /**
+         * @brief Storage for all nodes created during the build. A subtree
+         * over @c n primitives owns @code 2n - 1 @endcode consecutive slots,
+         * which lets tasks create nodes without synchronization.
+         */
+        std::vector<BuildNode> nodes;
+        /**
+         * @brief The bounding boxes and centroids of all primitives, which are
+         * gathered once up front so that binning and partitioning neither pay
+         * a virtual call nor recompute them (e.g., from the vertices of a
+         * triangle) for every level of the tree.
+         */
+        std::vector<Bounds> primitiveBounds;
+        std::vector<Point> centroids;
+        /// @brief See @ref BvhSettings::leafSize .
+        NodeIndex leafSize = 2;
+        /// @brief Whether nodes larger than @ref ParallelBuildThreshold are
+        /// handed to the thread pool (pointless with a single thread).
+        bool parallel = ThreadPool::global().numThreads() > 1;
+        /// @brief The subtrees that are being built in parallel.
+        TaskGroup subtrees;
+        /// @brief The summed CPU time all threads spent building (in
+        /// nanoseconds). Divided by the wall time of the same phases, this
+        /// tells how many threads were busy on average, which only bounds the
+        /// speedup over a serial build (see @ref BvhSettings::parallelBuild ).
+        std::atomic<int64_t> workTime{ 0 };
+    };
+
+    /**
+     * @brief Adds the time spent within its scope to the work time of a
+     * BuildContext.
+     * @note Where available, CPU time of the calling thread is used, so that
+     * time during which the thread was preempted is not counted as work.
+     */
+    class WorkTimer {
+        std::atomic<int64_t> &m_workTime;
+        int64_t m_start;
+
+        static int64_t now() {
+#ifdef LW_OS_WINDOWS
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+#else
+            timespec time;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+            return int64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+#endif
+        }
+
+    public:
+        WorkTimer(BuildContext &ctx) : m_workTime(ctx.workTime), m_start(now()) {}
+        ~WorkTimer() { m_workTime += now() - m_start; }
+    };
+
+    /**
+     * @brief A reference to a primitive during builds with spatial splits.
+     * Primitives that straddle a spatial split are referenced by both
+     * children, with each reference only covering part of the primitive.
+     */
+    struct Reference {
+        /// @brief The part of the bounding box of the primitive that this
+        /// reference covers.
+        Bounds bounds;
+        int primitiveIndex;
+    };
+
+    /// @brief The best split of a node found by the object or spatial split
+    /// search.
+    struct SplitCandidate {
+        /// @brief The SAH cost of the split (without the constant cost of
+        /// traversing the node itself).
+        float cost = Infinity;
+        /// @brief The split axis, or -1 if no useful split exists.
+        int axis = -1;
+        float position;
+        /// @brief The bounds of the children.
+        Bounds left, right;
+        /// @brief The number of references in the children.
+        NodeIndex leftCount, rightCount;
+    };
+
+    /// @brief The number of bins per axis used by spatial splits.
+    static constexpr int SpatialBinCount = 32;
+
+    /// @brief State shared by all recursions of a build with spatial splits.
+    struct SpatialSplitContext {
+        BuildContext &build;
+        /**
+         * @brief Spatial splits are only attempted for nodes whose children
+         * overlap by more than this surface area under the best object split.
+         */
+        float minOverlap;
+        /// @brief The number of references that may exist at most.
+        size_t maxReferences;
+        /// @brief The number of references that currently exist.
+        size_t references;
+        /// @brief The number of spatial splits that have been performed.
+        int spatialSplits = 0;
+    };
+
+    /// @brief The header of a cached BVH file, which is followed by the nodes
+    /// and then the primitive indices.
+    struct CacheHeader {
+        char magic[8];
+        uint32_t version;
+        /// @brief The size of a node, which guards against files written by
+        /// builds with a different node layout.
+        uint32_t nodeSize;
+        uint64_t key;
+        uint64_t nodeCount;
+        uint64_t indexCount;
+    };
+
+    static constexpr char CacheMagic[8] = "lw-bvh";
+    /// @brief Increment this whenever the build or the file format changes,
+    /// which invalidates all existing cache files.
+    static constexpr uint32_t CacheVersion = 1;
+
+    /**
+     * @brief A node of a wide BVH, which stores the bounding boxes of up to
+     * @c Width children in SoA layout so that they can be tested for
+     * intersection at once.
+     */
+    template <int Width> struct alignas(32) WideNode {
+        /// @brief The bounding boxes of the children, indexed by
+        /// @code [isMax][axis][child] @endcode . Unused children have empty
+        /// bounds.
+        float bounds[2][3][Width];
+        /**
+         * @brief Either the index of the child node in the list of wide nodes
+         * (for internal children), or the first primitive in
+         * m_primitiveIndices (for leaf children).
+         */
+        NodeIndex leftFirst[Width];
+        /// @brief The number of primitives of leaf children, or 0 for internal
+        /// children.
+        NodeIndex primitiveCount[Width];
+        /// @brief The number of children that are used, which always occupy
+        /// the first lanes.
+        int childCount;
+    };
+
+    /**
+     * @brief Per-ray data that is shared by all slab tests of a traversal, so
+     * that each slab test only requires multiplications.
+     */
+    struct TraversalRay {
+        Point origin;
+        Vector invDirection;
+        /// @brief Whether the ray direction is negative along an axis, i.e.,
+        /// whether the maximum slab of that axis is hit first.
+        int negative[3];
+
+        TraversalRay(const Ray &ray) {
+            for (int axis = 0; axis < 3; axis++) {
+                origin[axis]       = ray.origin[axis];
+                invDirection[axis] = 1 / ray.direction[axis];
+                negative[axis]     = ray.direction[axis] < 0;
+            }
+        }
+    };
+
+    /**
+     * @brief The maximum depth of the binary BVH, nodes at this depth always
+     * become leaves. This bounds the size of the traversal stacks.
+     */
+    static constexpr int MaxDepth = 64;
+
+    /// @brief The layout of the BVH used for traversal.
+    BvhLayout m_layout = BvhLayout::Binary;
+    /// @brief The nodes of the 4-wide BVH (if used), the root is the first
+    /// element.
+    std::vector<WideNode<4>> m_wideNodes4;
+    /// @brief The nodes of the 8-wide BVH (if used), the root is the first
+    /// element.
+    std::vector<WideNode<8>> m_wideNodes8;
+
     /// @brief A list of all BVH nodes.
+    /// @note For wide layouts, only the root node is kept after the wide BVH
+    /// has been collapsed from the binary BVH.
     std::vector<Node> m_nodes;
     /**
      * @brief Mapping from internal @c NodeIndex to @c primitiveIndex as used by
@@ -86,9 +373,18 @@ class AccelerationStructure : public Shape {
      * list of indices (which starts of as @code 0, 1, 2, ..., primitiveCount -
      * 1 @endcode ), which allows us to translate from re-ordered (contiguous)
      * indices to the indices the user of this class expects.
+     * @note With spatial splits, primitives can be referenced by several
+     * leaves, and hence occur several times in this list.
      */
     std::vector<int> m_primitiveIndices;
 
+    /// @brief The settings the BVH has last been built with, which are reused
+    /// when @ref refit decides to rebuild the BVH.
+    BvhSettings m_settings;
+    /// @brief The SAH cost (see @ref sahCost ) right after the BVH has last
+    /// been built, which serves as reference for the quality of refitted BVHs.
+    float m_buildCost = 0;
+
     /// @brief Returns the root BVH node.
     const Node &rootNode() const {
         // by convention, this is always the first element of m_nodes
@@ -96,110 +392,323 @@ class AccelerationStructure : public Shape {
     }
 
     /**
-     * @brief Intersects a BVH node, recursing into children (for internal
-     * nodes), or intersecting all primitives (for leaf nodes).
+     * @brief Traverses the binary BVH front to back, using an explicit stack.
+     * @param tMax Only nodes hit before this distance are visited. It may
+     * shrink during traversal (e.g., once closer intersections are found).
+     * @param nodeCounter Incremented for every node that is visited.
+     * @param leaf Called with the first index in m_primitiveIndices and the
+     * number of primitives of every leaf that is visited. Traversal stops
+     * early when it returns @c true .
      */
-    bool intersectNode(const Node &node, const Ray &ray, Intersection &its,
-                       Sampler &rng) const {
-        // update the statistic tracking how many BVH nodes have been tested for
-        // intersection
-        its.stats.bvhCounter++;
+    template <typename LeafFunction>
+    void traverseBinary(const TraversalRay &ray, const float &tMax,
+                        int &nodeCounter, LeafFunction &&leaf) const {
+        /// @brief A child that still needs to be visited.
+        struct Entry {
+            const Node *node;
+            /// @brief The distance at which the bounding box is entered.
+            float t;
+        };
+        // only the far child is pushed per level, hence the depth bounds the
+        // stack size
+        Entry stack[MaxDepth];
+        int stackSize = 0;
 
-        bool wasIntersected = false;
-        if (node.isLeaf()) {
-            for (NodeIndex i = 0; i < node.primitiveCount; i++) {
-                // update the statistic tracking how many children have been
-                // tested for intersection
-                its.stats.primCounter++;
-                // test the child for intersection
-                wasIntersected |= intersect(
-                    m_primitiveIndices[node.leftFirst + i], ray, its, rng);
-            }
-        } else { // internal node
-            // test which bounding box is intersected first by the ray.
-            // this allows us to traverse the children in the order they are
+        // the current node is always an internal node. leaves are handled as
+        // soon as they are reached, which saves a round trip through the loop
+        const Node *node = &rootNode();
+        nodeCounter++;
+        if (node->isLeaf()) {
+            leaf(node->leftFirst, node->primitiveCount);
+            return;
+        }
+
+        while (true) {
+            // test which bounding box is intersected first by the ray. this
+            // allows us to traverse the children in the order they are
             // intersected in, which can help prune a lot of unnecessary
             // intersection tests.
-            const auto leftT =
-                intersectAABB(m_nodes[node.leftChildIndex()].aabb, ray);
-            const auto rightT =
-                intersectAABB(m_nodes[node.rightChildIndex()].aabb, ray);
-            if (leftT < rightT) { // left child is hit first; test left child
-                                  // first, then right child
-                if (leftT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.leftChildIndex()], ray, its, rng);
-                if (rightT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.rightChildIndex()], ray, its, rng);
-            } else { // right child is hit first; test right child first, then
-                     // left child
-                if (rightT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.rightChildIndex()], ray, its, rng);
-                if (leftT < its.t)
-                    wasIntersected |= intersectNode(
-                        m_nodes[node.leftChildIndex()], ray, its, rng);
+            const Node *near = &m_nodes[node->leftChildIndex()];
+            const Node *far  = &m_nodes[node->rightChildIndex()];
+            float nearT      = intersectAABB(near->aabb, ray);
+            float farT       = intersectAABB(far->aabb, ray);
+            if (farT < nearT) {
+                std::swap(near, far);
+                std::swap(nearT, farT);
+            }
+
+            node = nullptr;
+            // the far child can only be hit if the near child is hit
+            if (nearT < tMax) {
+                nodeCounter++;
+                if (!near->isLeaf()) {
+                    node = near;
+                    if (farT < tMax)
+                        stack[stackSize++] = { far, farT };
+                } else if (leaf(near->leftFirst, near->primitiveCount)) {
+                    return;
+                } else if (farT < tMax) {
+                    // a closer intersection might have been found in the
+                    // near leaf, hence tMax is tested again
+                    nodeCounter++;
+                    if (!far->isLeaf())
+                        node = far;
+                    else if (leaf(far->leftFirst, far->primitiveCount))
+                        return;
+                }
+            }
+
+            // continue with the next child that might still be hit before
+            // tMax (a closer intersection might have been found in the
+            // meantime)
+            while (!node) {
+                if (stackSize == 0)
+                    return;
+                const Entry &entry = stack[--stackSize];
+                if (!(entry.t < tMax))
+                    continue;
+                nodeCounter++;
+                if (!entry.node->isLeaf())
+                    node = entry.node;
+                else if (leaf(entry.node->leftFirst,
+                              entry.node->primitiveCount))
+                    return;
             }
         }
-        return wasIntersected;
+    }
+
+    template <int Width> std::vector<WideNode<Width>> &wideNodes() {
+        if constexpr (Width == 4)
+            return m_wideNodes4;
+        else
+            return m_wideNodes8;
+    }
+
+    template <int Width> const std::vector<WideNode<Width>> &wideNodes() const {
+        if constexpr (Width == 4)
+            return m_wideNodes4;
+        else
+            return m_wideNodes8;
     }
 
     /**
-     * @brief Computes transmittance for a BVH node, recursing into children
-     * (for internal nodes), or computing the product of all primitive
-     * transmittances (for leaf nodes).
+     * @brief Sorts the children of a wide node that are hit before tMax by
+     * their distance along the ray.
+     * @param out tNear The distances to all children of the node.
+     * @param out order The lanes of the children that are hit, front to back.
+     * @return The number of children that are hit.
      */
-    void transmittanceNode(const Node &node, const Ray &ray, float tMax,
-                           Sampler &rng, float &T) const {
-        if (node.isLeaf()) {
-            for (NodeIndex i = 0; i < node.primitiveCount && T; i++) {
-                // test the child for intersection
-                T *= transmittance(
-                    m_primitiveIndices[node.leftFirst + i], ray, tMax, rng);
+    template <int Width>
+    int orderWideChildren(const WideNode<Width> &node, const TraversalRay &ray,
+                          float tMax, float *tNear, int *order) const {
+        const int hits = intersectWideAABBs(node, ray, tMax, tNear);
+        int count      = 0;
+        for (int lane = 0; lane < node.childCount; lane++) {
+            if (!(hits & (1 << lane)))
+                continue;
+            // insertion sort, there are at most Width children
+            int i = count++;
+            while (i > 0 && tNear[order[i - 1]] > tNear[lane]) {
+                order[i] = order[i - 1];
+                i--;
             }
-        } else { // internal node
-            // test which bounding box is intersected first by the ray.
-            // this allows us to traverse the children in the order they are
-            // intersected in, which can help prune a lot of unnecessary
-            // intersection tests.
-            const auto leftT =
-                intersectAABB(m_nodes[node.leftChildIndex()].aabb, ray);
-            const auto rightT =
-                intersectAABB(m_nodes[node.rightChildIndex()].aabb, ray);
-            if (leftT < rightT) { // left child is hit first; test left child
-                                  // first, then right child
-                if (leftT < tMax)
-                    transmittanceNode(
-                        m_nodes[node.leftChildIndex()], ray, tMax, rng, T);
-                if (rightT < tMax && T)
-                    transmittanceNode(
-                        m_nodes[node.rightChildIndex()], ray, tMax, rng, T);
-            } else { // right child is hit first; test right child first, then
-                     // left child
-                if (rightT < tMax)
-                    transmittanceNode(
-                        m_nodes[node.rightChildIndex()], ray, tMax, rng, T);
-                if (leftT < tMax && T)
-                    transmittanceNode(
-                        m_nodes[node.leftChildIndex()], ray, tMax, rng, T);
-            }
-        }
-    }
-
-    /// @brief Performs a slab test to intersect a bounding box with a ray,
-    /// returning Infinity in case the ray misses.
-    float intersectAABB(const Bounds &bounds, const Ray &ray) const {
-        const auto t1 = (bounds.min() - ray.origin) / ray.direction;
-        // intersect all axes at once with the maximum slabs of the bounding box
-        const auto t2 = (bounds.max() - ray.origin) / ray.direction;
-
-        // the elementwiseMin picks the near slab for each axis, of which we
-        // then take the maximum
-        const auto tNear = elementwiseMin(t1, t2).maxComponent();
-        // the elementwiseMax picks the far slab for each axis, of which we then
-        // take the minimum
-        const auto tFar = elementwiseMax(t1, t2).minComponent();
+            order[i] = lane;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Traverses the wide BVH front to back, using an explicit stack.
+     * The parameters are the same as for traverseBinary.
+     */
+    template <int Width, typename LeafFunction>
+    void traverseWide(const TraversalRay &ray, const float &tMax,
+                      int &nodeCounter, LeafFunction &&leaf) const {
+        /// @brief A child that still needs to be visited.
+        struct Entry {
+            NodeIndex leftFirst;
+            NodeIndex primitiveCount;
+            /// @brief The distance at which the bounding box is entered.
+            float t;
+        };
+        // at most Width - 1 children remain on the stack per level
+        Entry stack[Width * MaxDepth];
+        int stackSize      = 0;
+        stack[stackSize++] = { 0, 0, -Infinity };
+
+        const auto &nodes = wideNodes<Width>();
+        while (stackSize > 0) {
+            const Entry entry = stack[--stackSize];
+            // a closer intersection might have been found in the meantime
+            if (!(entry.t < tMax))
+                continue;
+
+            if (entry.primitiveCount) {
+                if (leaf(entry.leftFirst, entry.primitiveCount))
+                    return;
+                continue;
+            }
+
+            nodeCounter++;
+            const WideNode<Width> &node = nodes[entry.leftFirst];
+            float tNear[Width];
+            int order[Width];
+            const int count = orderWideChildren(node, ray, tMax, tNear, order);
+            // push from back to front, so that the closest child comes next
+            for (int i = count - 1; i >= 0; i--) {
+                const int lane     = order[i];
+                stack[stackSize++] = { node.leftFirst[lane],
+                                       node.primitiveCount[lane],
+                                       tNear[lane] };
+            }
+        }
+    }
+
+    /**
+     * @brief Traverses the BVH in whichever layout it has been built with.
+     * The parameters are the same as for traverseBinary.
+     */
+    template <typename LeafFunction>
+    void traverse(const Ray &ray, const float &tMax, int &nodeCounter,
+                  LeafFunction &&leaf) const {
+        if (m_primitiveIndices.empty())
+            return; // exit early if no children exist
+
+        const TraversalRay traversalRay{ ray };
+        // test root bounding box for potential hit
+        if (!(intersectAABB(rootNode().aabb, traversalRay) < tMax))
+            return;
+
+        switch (m_layout) {
+        case BvhLayout::Wide4:
+            traverseWide<4>(traversalRay, tMax, nodeCounter, leaf);
+            break;
+        case BvhLayout::Wide8:
+            traverseWide<8>(traversalRay, tMax, nodeCounter, leaf);
+            break;
+        default:
+            traverseBinary(traversalRay, tMax, nodeCounter, leaf);
+            break;
+        }
+    }
+
+    /**
+     * @brief Performs a slab test against all children of a wide node at once.
+     * Slabs that are NaN (i.e., the ray lies within a slab it is parallel to)
+     * are ignored.
+     * @param out tNear The distance to the first intersection with each
+     * bounding box (may also be negative!).
+     * @return A bitmask of the children whose bounding box is hit before tMax.
+     */
+    template <int Width>
+    static int intersectWideAABBs(const WideNode<Width> &node,
+                                  const TraversalRay &ray, float tMax,
+                                  float *tNear) {
+        int hits = 0;
+#ifdef LW_CPU_X86
+#ifdef __AVX__
+        if constexpr (Width == 8) {
+            __m256 tMin = _mm256_set1_ps(-Infinity);
+            __m256 tFar = _mm256_set1_ps(Infinity);
+            for (int axis = 0; axis < 3; axis++) {
+                const __m256 origin = _mm256_set1_ps(ray.origin[axis]);
+                const __m256 invDir = _mm256_set1_ps(ray.invDirection[axis]);
+                const int near      = ray.negative[axis];
+                const __m256 t0     = _mm256_mul_ps(
+                    _mm256_sub_ps(_mm256_load_ps(node.bounds[near][axis]),
+                                  origin),
+                    invDir);
+                const __m256 t1 = _mm256_mul_ps(
+                    _mm256_sub_ps(_mm256_load_ps(node.bounds[1 - near][axis]),
+                                  origin),
+                    invDir);
+                // the slab comes first, so that NaN slabs are ignored
+                tMin = _mm256_max_ps(t0, tMin);
+                tFar = _mm256_min_ps(t1, tFar);
+            }
+            const __m256 hit = _mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(tMin, tFar, _CMP_LE_OQ),
+                              _mm256_cmp_ps(
+                                  tFar, _mm256_set1_ps(Epsilon), _CMP_GE_OQ)),
+                _mm256_cmp_ps(tMin, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+            _mm256_storeu_ps(tNear, tMin);
+            hits = _mm256_movemask_ps(hit);
+            return hits & ((1 << node.childCount) - 1);
+        }
+#endif
+        for (int lane = 0; lane < Width; lane += 4) {
+            __m128 tMin = _mm_set1_ps(-Infinity);
+            __m128 tFar = _mm_set1_ps(Infinity);
+            for (int axis = 0; axis < 3; axis++) {
+                const __m128 origin = _mm_set1_ps(ray.origin[axis]);
+                const __m128 invDir = _mm_set1_ps(ray.invDirection[axis]);
+                const int near      = ray.negative[axis];
+                const __m128 t0     = _mm_mul_ps(
+                    _mm_sub_ps(_mm_load_ps(&node.bounds[near][axis][lane]),
+                               origin),
+                    invDir);
+                const __m128 t1 = _mm_mul_ps(
+                    _mm_sub_ps(_mm_load_ps(&node.bounds[1 - near][axis][lane]),
+                               origin),
+                    invDir);
+                // the slab comes first, so that NaN slabs are ignored
+                tMin = _mm_max_ps(t0, tMin);
+                tFar = _mm_min_ps(t1, tFar);
+            }
+            const __m128 hit = _mm_and_ps(
+                _mm_and_ps(_mm_cmple_ps(tMin, tFar),
+                           _mm_cmpge_ps(tFar, _mm_set1_ps(Epsilon))),
+                _mm_cmplt_ps(tMin, _mm_set1_ps(tMax)));
+            _mm_storeu_ps(tNear + lane, tMin);
+            hits |= _mm_movemask_ps(hit) << lane;
+        }
+#else
+        for (int lane = 0; lane < Width; lane++) {
+            float tMin = -Infinity, tFar = Infinity;
+            for (int axis = 0; axis < 3; axis++) {
+                const int near = ray.negative[axis];
+                const float t0 =
+                    (node.bounds[near][axis][lane] - ray.origin[axis]) *
+                    ray.invDirection[axis];
+                const float t1 =
+                    (node.bounds[1 - near][axis][lane] - ray.origin[axis]) *
+                    ray.invDirection[axis];
+                if (t0 > tMin)
+                    tMin = t0;
+                if (t1 < tFar)
+                    tFar = t1;
+            }
+            tNear[lane] = tMin;
+            if (tMin <= tFar && tFar >= Epsilon && tMin < tMax)
+                hits |= 1 << lane;
+        }
+#endif
+        return hits & ((1 << node.childCount) - 1);
+    }
+
+    /**
+     * @brief Performs a slab test to intersect a bounding box with a ray,
+     * returning Infinity in case the ray misses.
+     * @note Slabs that are NaN (i.e., the ray lies within a slab it is
+     * parallel to) are ignored.
+     */
+    static float intersectAABB(const Bounds &bounds, const TraversalRay &ray) {
+        float tNear = -Infinity;
+        float tFar  = Infinity;
+        for (int axis = 0; axis < 3; axis++) {
+            // the sign of the direction determines which slab is hit first
+            const Point &nearCorner =
+                ray.negative[axis] ? bounds.max() : bounds.min();
+            const Point &farCorner =
+                ray.negative[axis] ? bounds.min() : bounds.max();
+            const float t0 =
+                (nearCorner[axis] - ray.origin[axis]) * ray.invDirection[axis];
+            const float t1 =
+                (farCorner[axis] - ray.origin[axis]) * ray.invDirection[axis];
+            // the slab comes first, so that NaN slabs are ignored
+            tNear = std::max(t0, tNear);
+            tFar  = std::min(t1, tFar);
+        }
 
         if (tFar < tNear)
             return Infinity; // the ray does not intersect the bounding box
@@ -211,15 +720,42 @@ class AccelerationStructure : public Shape {
     }
 
     /// @brief Computes the axis aligned bounding box for a leaf BVH node
-    void computeAABB(Node &node) {
+    void computeAABB(const BuildContext &ctx, Node &node) {
         node.aabb = Bounds::empty();
         for (NodeIndex i = 0; i < node.primitiveCount; i++) {
-            const Bounds childAABB =
-                getBoundingBox(m_primitiveIndices[node.leftFirst + i]);
+            const Bounds &childAABB =
+                ctx.primitiveBounds[m_primitiveIndices[node.leftFirst + i]];
             node.aabb.extend(childAABB);
         }
     }
 
+    /// @brief Fills @ref BuildContext::primitiveBounds and @ref
+    /// BuildContext::centroids .
+    void gatherPrimitives(BuildContext &ctx) const {
+        const NodeIndex primitiveCount = numberOfPrimitives();
+        ctx.primitiveBounds.resize(primitiveCount);
+        ctx.centroids.resize(primitiveCount);
+        const auto gather = [&](NodeIndex first, NodeIndex last) {
+            for (NodeIndex i = first; i < last; i++) {
+                ctx.primitiveBounds[i] = getBoundingBox(i);
+                ctx.centroids[i]       = getCentroid(i);
+            }
+        };
+
+        if (ctx.parallel && primitiveCount > ParallelBuildThreshold) {
+            const NodeIndex chunkSize = ParallelBuildThreshold;
+            const int numChunks = (primitiveCount + chunkSize - 1) / chunkSize;
+            parallel_for(numChunks, [&](int chunk) {
+                WorkTimer timer{ ctx };
+                gather(chunk * chunkSize,
+                       min(primitiveCount, (chunk + 1) * chunkSize));
+            });
+        } else {
+            WorkTimer timer{ ctx };
+            gather(0, primitiveCount);
+        }
+    }
+
     /// @brief Computes the surface area of a bounding box.
     float surfaceArea(const Bounds &bounds) const {
         const auto size = bounds.diagonal();
@@ -227,56 +763,129 @@ class AccelerationStructure : public Shape {
                     size.y() * size.z());
     }
 
+    /// @brief Computes the bounds of the centroids of the primitives
+    /// [first, first + count) in m_primitiveIndices.
+    Bounds computeCentroidBounds(const BuildContext &ctx, NodeIndex first,
+                                 NodeIndex count) const {
+        Bounds result;
+        for (NodeIndex i = first; i < first + count; i++)
+            result.extend(ctx.centroids[m_primitiveIndices[i]]);
+        return result;
+    }
+
+    /// @brief Sorts the primitives [first, first + count) in
+    /// m_primitiveIndices into the bins of all three axes, where the bins of
+    /// each axis evenly divide the given centroid bounds.
+    void populateBins(const BuildContext &ctx, NodeIndex first,
+                      NodeIndex count, const Bounds &centroidBounds,
+                      AxisBins &bins) const {
+        for (NodeIndex i = first; i < first + count; i++) {
+            const Point &centroid = ctx.centroids[m_primitiveIndices[i]];
+            const Bounds &bounds  = ctx.primitiveBounds[m_primitiveIndices[i]];
+            for (int axis = 0; axis < 3; axis++) {
+                const float boundsMin = centroidBounds.min()[axis];
+                const float boundsMax = centroidBounds.max()[axis];
+                if (boundsMin == boundsMax)
+                    continue;
+
+                const float scale = BinCount / (boundsMax - boundsMin);
+                const int binIdx  = min(
+                    BinCount - 1, (int) ((centroid[axis] - boundsMin) * scale));
+                bins[axis][binIdx].primitiveCount++;
+                bins[axis][binIdx].bounds.extend(bounds);
+            }
+        }
+    }
+
     /**
      * For a given node, computes split axis and split position that minimize
      * the surface area heuristic.
+     * @note For large nodes, the binning sweep is distributed across the
+     * thread pool. Since merging bins is exact, the result does not depend on
+     * the number of threads.
      * @param node The BVH node to compute the split for.
      * @param out bestSplitAxis The optimal split axis, or -1 if no useful split
      * exists
      * @param out bestSplitPosition The optimal split position, undefined if no
      * useful split exists
      */
-    void binning(const Node &node, int &bestSplitAxis,
+    void binning(BuildContext &ctx, const Node &node, int &bestSplitAxis,
                  float &bestSplitPosition) {
-        const int binning_size = 16;
+        Bounds centroidBounds;
+        AxisBins bins;
+        if (ctx.parallel && node.primitiveCount > ParallelBuildThreshold) {
+            const NodeIndex chunkSize = ParallelBuildThreshold;
+            const int numChunks =
+                (node.primitiveCount + chunkSize - 1) / chunkSize;
+            const auto chunkCount = [&](int chunk) {
+                return min(chunkSize, node.primitiveCount - chunk * chunkSize);
+            };
+
+            std::vector<Bounds> chunkCentroids(numChunks);
+            parallel_for(numChunks, [&](int chunk) {
+                WorkTimer timer{ ctx };
+                chunkCentroids[chunk] = computeCentroidBounds(
+                    ctx,
+                    node.leftFirst + chunk * chunkSize, chunkCount(chunk));
+            });
+            for (const auto &bounds : chunkCentroids)
+                centroidBounds.extend(bounds);
+
+            std::vector<AxisBins> chunkBins(numChunks);
+            parallel_for(numChunks, [&](int chunk) {
+                WorkTimer timer{ ctx };
+                populateBins(ctx,
+                             node.leftFirst + chunk * chunkSize,
+                             chunkCount(chunk),
+                             centroidBounds,
+                             chunkBins[chunk]);
+            });
+            for (const auto &chunk : chunkBins) {
+                for (int axis = 0; axis < 3; axis++) {
+                    for (int i = 0; i < BinCount; i++) {
+                        bins[axis][i].primitiveCount +=
+                            chunk[axis][i].primitiveCount;
+                        bins[axis][i].bounds.extend(chunk[axis][i].bounds);
+                    }
+                }
+            }
+        } else {
+            WorkTimer timer{ ctx };
+            centroidBounds =
+                computeCentroidBounds(ctx, node.leftFirst, node.primitiveCount);
+            populateBins(ctx,
+                         node.leftFirst,
+                         node.primitiveCount,
+                         centroidBounds,
+                         bins);
+        }
+
+        WorkTimer timer{ ctx };
         float bestCost = Infinity;
         for (int axis = 0; axis < 3; axis++) {
-            float boundsMin = Infinity, boundsMax = -Infinity;
-            for (int i = 0; i < node.primitiveCount; i++) {
-                Point centriod = getCentroid(m_primitiveIndices[node.leftFirst + i]);
-                boundsMin = min(boundsMin, centriod[axis]);
-                boundsMax = max(boundsMax, centriod[axis]);
-            }
+            const float boundsMin = centroidBounds.min()[axis];
+            const float boundsMax = centroidBounds.max()[axis];
             if (boundsMin == boundsMax) continue;
+            const Bin *bin = bins[axis].data();
 
-            // populate the bins
-            Bin bin[binning_size];
-            float scale = binning_size / (boundsMax - boundsMin);
-            for (int i = 0; i < node.primitiveCount; i++) {
-                Point centriod = getCentroid(m_primitiveIndices[node.leftFirst + i]);
-                int binIdx = min(binning_size - 1, (int) ((centriod[axis] - boundsMin) * scale));
-                bin[binIdx].primitiveCount++;
-                bin[binIdx].bounds.extend(getBoundingBox(m_primitiveIndices[node.leftFirst + i])); 
-            }
-
-            float leftArea[binning_size - 1], rightArea[binning_size - 1];
-            int leftCount[binning_size - 1], rightCount[binning_size - 1];
+            float leftArea[BinCount - 1], rightArea[BinCount - 1];
+            int leftCount[BinCount - 1], rightCount[BinCount - 1];
             Bounds leftBox, rightBox;
             int leftSum = 0, rightSum = 0;
-            for (int i = 0; i < binning_size - 1; i++) {
+            for (int i = 0; i < BinCount - 1; i++) {
                 leftSum += bin[i].primitiveCount;
                 leftCount[i] = leftSum;
                 leftBox.extend(bin[i].bounds);
                 leftArea[i] = surfaceArea(leftBox);
 
-                rightSum += bin[binning_size - 1 - i].primitiveCount;
-                rightCount[binning_size - 2 - i] = rightSum;
-                rightBox.extend(bin[binning_size - 1 - i].bounds);
-                rightArea[binning_size - 2 - i] = surfaceArea(rightBox);
+                rightSum += bin[BinCount - 1 - i].primitiveCount;
+                rightCount[BinCount - 2 - i] = rightSum;
+                rightBox.extend(bin[BinCount - 1 - i].bounds);
+                rightArea[BinCount - 2 - i] = surfaceArea(rightBox);
             }
 
-            scale = 1.f / scale;
-            for (int i = 0; i < binning_size - 1; i++) {
+            const float scale = 1.f / (BinCount / (boundsMax - boundsMin));
+            for (int i = 0; i < BinCount - 1; i++) {
                 if (leftCount[i] == 0 || rightCount[i] == 0) continue;
                 float curCost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
                 if (curCost < bestCost) {
@@ -288,10 +897,21 @@ class AccelerationStructure : public Shape {
         }
     }
 
-    /// @brief Attempts to subdivide a given BVH node.
-    void subdivide(Node &parent) {
-        // only subdivide if enough children are available.
-        if (parent.primitiveCount <= 2) {
+    /**
+     * @brief Attempts to subdivide a given BVH node.
+     * @param slot The slot of the node in @ref BuildContext::nodes .
+     * @param base The first slot owned by the subtree of the node. The node
+     * itself occupies the last slot of its range, the left subtree the slots
+     * at the beginning and the right subtree the slots after it.
+     * @param depth The depth of the node, which is 0 for the root.
+     */
+    void subdivide(BuildContext &ctx, NodeIndex slot, NodeIndex base,
+                   int depth) {
+        Node &parent = ctx.nodes[slot].node;
+
+        // only subdivide if enough children are available, and the traversal
+        // stack can hold all children.
+        if (parent.primitiveCount <= ctx.leafSize || depth >= MaxDepth) {
             return;
         }
 
@@ -302,7 +922,7 @@ class AccelerationStructure : public Shape {
         float splitPosition;
         if (UseSAH) {
             // pick split axis and position using binned SAH
-            binning(parent, splitAxis, splitPosition);
+            binning(ctx, parent, splitAxis, splitPosition);
         } else {
             // split in the middle of the longest axis
             splitAxis     = parent.aabb.diagonal().maxComponentIndex();
@@ -314,56 +934,798 @@ class AccelerationStructure : public Shape {
             return;
         }
 
-        // the point at which to split (note that primitives must be re-ordered
-        // so that all children of the left node will have a smaller index than
-        // firstRightIndex, and nodes on the right will have an index larger or
-        // equal to firstRightIndex)
-        NodeIndex firstRightIndex = parent.firstPrimitiveIndex();
-        NodeIndex lastLeftIndex   = parent.lastPrimitiveIndex();
+        NodeIndex leftSlot, rightSlot;
+        {
+            WorkTimer timer{ ctx };
 
-        // partition algorithm (you might remember this from quicksort)
-        while (firstRightIndex <= lastLeftIndex) {
-            if (getCentroid(m_primitiveIndices[firstRightIndex])[splitAxis] <
-                splitPosition) {
-                firstRightIndex++;
+            // the point at which to split (note that primitives must be
+            // re-ordered so that all children of the left node will have a
+            // smaller index than firstRightIndex, and nodes on the right will
+            // have an index larger or equal to firstRightIndex)
+            NodeIndex firstRightIndex = parent.firstPrimitiveIndex();
+            NodeIndex lastLeftIndex   = parent.lastPrimitiveIndex();
+
+            // partition algorithm (you might remember this from quicksort)
+            while (firstRightIndex <= lastLeftIndex) {
+                if (ctx.centroids[m_primitiveIndices[firstRightIndex]]
+                                 [splitAxis] <
+                    splitPosition) {
+                    firstRightIndex++;
+                } else {
+                    std::swap(m_primitiveIndices[firstRightIndex],
+                              m_primitiveIndices[lastLeftIndex--]);
+                }
+            }
+
+            const NodeIndex firstLeftIndex = parent.firstPrimitiveIndex();
+            const NodeIndex leftCount      = firstRightIndex - firstLeftIndex;
+            const NodeIndex rightCount     = parent.primitiveCount - leftCount;
+
+            if (leftCount == 0 || rightCount == 0) {
+                // if either child gets no primitives, we abort subdividing
+                return;
+            }
+
+            // the left subtree owns 2 * leftCount - 1 slots starting at base,
+            // the right subtree the 2 * rightCount - 1 slots that follow
+            leftSlot  = base + 2 * leftCount - 2;
+            rightSlot = leftSlot + 2 * rightCount - 1;
+            parent.primitiveCount = 0; // mark the parent node as internal node
+            ctx.nodes[slot].children[0] = leftSlot;
+            ctx.nodes[slot].children[1] = rightSlot;
+
+            Node &leftChild          = ctx.nodes[leftSlot].node;
+            leftChild.leftFirst      = firstLeftIndex;
+            leftChild.primitiveCount = leftCount;
+
+            Node &rightChild          = ctx.nodes[rightSlot].node;
+            rightChild.leftFirst      = firstRightIndex;
+            rightChild.primitiveCount = rightCount;
+        }
+
+        // process both children (and all of their children), handing large
+        // subtrees to the thread pool
+        for (int child = 0; child < 2; child++) {
+            const NodeIndex childSlot = ctx.nodes[slot].children[child];
+            const NodeIndex childBase =
+                child == 0 ? base : leftSlot + 1;
+            const auto process = [this, &ctx, childSlot, childBase, depth]() {
+                {
+                    WorkTimer timer{ ctx };
+                    computeAABB(ctx, ctx.nodes[childSlot].node);
+                }
+                subdivide(ctx, childSlot, childBase, depth + 1);
+            };
+
+            if (ctx.parallel && ctx.nodes[childSlot].node.primitiveCount >
+                                    ParallelBuildThreshold) {
+                ctx.subtrees.run(process);
             } else {
-                std::swap(m_primitiveIndices[firstRightIndex],
-                          m_primitiveIndices[lastLeftIndex--]);
+                process();
+            }
+        }
+    }
+
+    /**
+     * @brief Splits a reference at an axis aligned plane into the parts that
+     * lie on either side of it.
+     */
+    void splitReference(const Reference &reference, int axis, float position,
+                        Reference &left, Reference &right) const {
+        Bounds leftBounds, rightBounds;
+        splitBoundingBox(
+            reference.primitiveIndex, axis, position, leftBounds, rightBounds);
+
+        left.primitiveIndex  = reference.primitiveIndex;
+        left.bounds          = reference.bounds.clip(leftBounds);
+        left.bounds.max()[axis] = std::min(left.bounds.max()[axis], position);
+
+        right.primitiveIndex = reference.primitiveIndex;
+        right.bounds         = reference.bounds.clip(rightBounds);
+        right.bounds.min()[axis] =
+            std::max(right.bounds.min()[axis], position);
+    }
+
+    /**
+     * @brief Evaluates the SAH cost of the planes between adjacent bins, and
+     * updates the split candidate if a cheaper split is found.
+     * @param entries The number of references whose bounds start in each bin.
+     * @param exits The number of references whose bounds end in each bin.
+     * @param start The position at which the first bin starts.
+     * @param binWidth The width of each bin.
+     */
+    template <size_t Count>
+    void sweepBins(const std::array<Bounds, Count> &bounds,
+                   const std::array<NodeIndex, Count> &entries,
+                   const std::array<NodeIndex, Count> &exits, int axis,
+                   float start, float binWidth, SplitCandidate &best) const {
+        Bounds rightBounds[Count - 1];
+        NodeIndex rightCounts[Count - 1];
+        Bounds box;
+        NodeIndex sum = 0;
+        for (int i = int(Count) - 1; i > 0; i--) {
+            box.extend(bounds[i]);
+            sum += exits[i];
+            rightBounds[i - 1] = box;
+            rightCounts[i - 1] = sum;
+        }
+
+        box = Bounds::empty();
+        sum = 0;
+        for (int i = 0; i < int(Count) - 1; i++) {
+            box.extend(bounds[i]);
+            sum += entries[i];
+            if (sum == 0 || rightCounts[i] == 0)
+                continue;
+
+            const float cost = sum * surfaceArea(box) +
+                               rightCounts[i] * surfaceArea(rightBounds[i]);
+            if (cost < best.cost) {
+                best.cost       = cost;
+                best.axis       = axis;
+                best.position   = start + binWidth * (i + 1);
+                best.left       = box;
+                best.right      = rightBounds[i];
+                best.leftCount  = sum;
+                best.rightCount = rightCounts[i];
+            }
+        }
+    }
+
+    /// @brief Finds the best object split of a list of references using
+    /// binned SAH, where references are binned by the centers of their bounds.
+    SplitCandidate
+    findObjectSplit(const std::vector<Reference> &references) const {
+        Bounds centroidBounds;
+        for (const auto &reference : references)
+            centroidBounds.extend(reference.bounds.center());
+
+        SplitCandidate best;
+        for (int axis = 0; axis < 3; axis++) {
+            const float boundsMin = centroidBounds.min()[axis];
+            const float boundsMax = centroidBounds.max()[axis];
+            if (boundsMin == boundsMax)
+                continue;
+
+            std::array<Bounds, BinCount> bounds;
+            std::array<NodeIndex, BinCount> counts{};
+            const float scale = BinCount / (boundsMax - boundsMin);
+            for (const auto &reference : references) {
+                const int binIdx =
+                    min(BinCount - 1,
+                        (int) ((reference.bounds.center()[axis] - boundsMin) *
+                               scale));
+                counts[binIdx]++;
+                bounds[binIdx].extend(reference.bounds);
+            }
+            sweepBins(
+                bounds, counts, counts, axis, boundsMin, 1 / scale, best);
+        }
+        return best;
+    }
+
+    /**
+     * @brief Finds the best spatial split of a list of references, where
+     * references that straddle a split plane are clipped and placed in the
+     * bins on both sides of it.
+     * @param bounds The bounds of the node, which are evenly divided into bins.
+     */
+    SplitCandidate findSpatialSplit(const std::vector<Reference> &references,
+                                    const Bounds &bounds) const {
+        SplitCandidate best;
+        for (int axis = 0; axis < 3; axis++) {
+            const float start    = bounds.min()[axis];
+            const float binWidth = (bounds.max()[axis] - start) / SpatialBinCount;
+            if (!(binWidth > 0))
+                continue;
+
+            std::array<Bounds, SpatialBinCount> binBounds;
+            std::array<NodeIndex, SpatialBinCount> entries{}, exits{};
+            const auto binIndex = [&](float position) {
+                return clamp(
+                    int((position - start) / binWidth), 0, SpatialBinCount - 1);
+            };
+            for (const auto &reference : references) {
+                const int first = binIndex(reference.bounds.min()[axis]);
+                const int last  = binIndex(reference.bounds.max()[axis]);
+                entries[first]++;
+                exits[last]++;
+
+                // clip the reference to each of the bins it overlaps
+                Reference remainder = reference;
+                for (int bin = first; bin < last; bin++) {
+                    Reference left, right;
+                    splitReference(remainder,
+                                   axis,
+                                   start + binWidth * (bin + 1),
+                                   left,
+                                   right);
+                    binBounds[bin].extend(left.bounds);
+                    remainder = right;
+                }
+                binBounds[last].extend(remainder.bounds);
             }
+            sweepBins(binBounds, entries, exits, axis, start, binWidth, best);
         }
+        return best;
+    }
 
-        const NodeIndex firstLeftIndex = parent.firstPrimitiveIndex();
-        const NodeIndex leftCount      = firstRightIndex - firstLeftIndex;
-        const NodeIndex rightCount     = parent.primitiveCount - leftCount;
+    /**
+     * @brief Distributes references among the children of a spatial split.
+     * References that straddle the split plane are split, unless moving them
+     * entirely into one of the children yields a lower SAH cost ("reference
+     * unsplitting").
+     */
+    void partitionSpatial(const std::vector<Reference> &references,
+                          const SplitCandidate &split,
+                          std::vector<Reference> &left,
+                          std::vector<Reference> &right) const {
+        Bounds leftBounds    = split.left;
+        Bounds rightBounds   = split.right;
+        NodeIndex leftCount  = split.leftCount;
+        NodeIndex rightCount = split.rightCount;
+        for (const auto &reference : references) {
+            if (reference.bounds.max()[split.axis] <= split.position) {
+                left.push_back(reference);
+                continue;
+            }
+            if (reference.bounds.min()[split.axis] >= split.position) {
+                right.push_back(reference);
+                continue;
+            }
+
+            Bounds unsplitLeft = leftBounds;
+            unsplitLeft.extend(reference.bounds);
+            Bounds unsplitRight = rightBounds;
+            unsplitRight.extend(reference.bounds);
+            const float splitCost = surfaceArea(leftBounds) * leftCount +
+                                    surfaceArea(rightBounds) * rightCount;
+            const float leftCost = surfaceArea(unsplitLeft) * leftCount +
+                                   surfaceArea(rightBounds) * (rightCount - 1);
+            const float rightCost = surfaceArea(leftBounds) * (leftCount - 1) +
+                                    surfaceArea(unsplitRight) * rightCount;
 
-        if (leftCount == 0 || rightCount == 0) {
-            // if either child gets no primitives, we abort subdividing
+            if (leftCost < splitCost && leftCost <= rightCost) {
+                left.push_back(reference);
+                leftBounds = unsplitLeft;
+                rightCount--;
+            } else if (rightCost < splitCost) {
+                right.push_back(reference);
+                rightBounds = unsplitRight;
+                leftCount--;
+            } else {
+                Reference leftPart, rightPart;
+                splitReference(
+                    reference, split.axis, split.position, leftPart, rightPart);
+                left.push_back(leftPart);
+                right.push_back(rightPart);
+            }
+        }
+    }
+
+    /**
+     * @brief Builds the subtree over the given references with object and
+     * spatial splits, appending its nodes to the build context and the
+     * primitives of its leaves to m_primitiveIndices.
+     * @return The slot of the node in @ref BuildContext::nodes .
+     */
+    NodeIndex subdivideSpatial(SpatialSplitContext &ctx,
+                               std::vector<Reference> references, int depth) {
+        const NodeIndex slot = NodeIndex(ctx.build.nodes.size());
+        ctx.build.nodes.emplace_back();
+        Bounds bounds;
+        for (const auto &reference : references)
+            bounds.extend(reference.bounds);
+        ctx.build.nodes[slot].node.aabb = bounds;
+
+        const NodeIndex count = NodeIndex(references.size());
+        SplitCandidate split;
+        bool isSpatial = false;
+        if (count > ctx.build.leafSize && depth < MaxDepth) {
+            split = findObjectSplit(references);
+
+            // spatial splits only pay off if the children of the object split
+            // overlap significantly, and only while the budget allows for
+            // more references
+            const Bounds overlap = split.left.clip(split.right);
+            const bool overlaps  = split.axis < 0 ||
+                                  (!overlap.isEmpty() &&
+                                   surfaceArea(overlap) > ctx.minOverlap);
+            if (overlaps && ctx.references < ctx.maxReferences) {
+                const SplitCandidate spatial =
+                    findSpatialSplit(references, bounds);
+                const size_t duplicates =
+                    spatial.axis < 0
+                        ? 0
+                        : size_t(spatial.leftCount + spatial.rightCount - count);
+                if (spatial.cost < split.cost &&
+                    ctx.references + duplicates <= ctx.maxReferences) {
+                    split     = spatial;
+                    isSpatial = true;
+                }
+            }
+        }
+
+        std::vector<Reference> left, right;
+        if (isSpatial) {
+            partitionSpatial(references, split, left, right);
+        } else if (split.axis >= 0) {
+            for (const auto &reference : references) {
+                if (reference.bounds.center()[split.axis] < split.position)
+                    left.push_back(reference);
+                else
+                    right.push_back(reference);
+            }
+        }
+
+        if (left.empty() || right.empty()) {
+            // no useful split exists, hence this node becomes a leaf
+            Node &node          = ctx.build.nodes[slot].node;
+            node.leftFirst      = NodeIndex(m_primitiveIndices.size());
+            node.primitiveCount = count;
+            for (const auto &reference : references)
+                m_primitiveIndices.push_back(reference.primitiveIndex);
+            return slot;
+        }
+
+        ctx.references += left.size() + right.size() - count;
+        if (isSpatial)
+            ctx.spatialSplits++;
+        // release the references of this node before descending
+        references = {};
+
+        const NodeIndex leftSlot =
+            subdivideSpatial(ctx, std::move(left), depth + 1);
+        const NodeIndex rightSlot =
+            subdivideSpatial(ctx, std::move(right), depth + 1);
+        ctx.build.nodes[slot].node.primitiveCount = 0;
+        ctx.build.nodes[slot].children[0]         = leftSlot;
+        ctx.build.nodes[slot].children[1]         = rightSlot;
+        return slot;
+    }
+
+    /**
+     * @brief Builds the BVH with spatial splits (SBVH) into the build context,
+     * filling m_primitiveIndices with the primitives of all leaves (which may
+     * contain primitives several times).
+     * @note Since the number of references is not known in advance, this
+     * build runs on a single thread.
+     * @return The slot of the root node in @ref BuildContext::nodes .
+     */
+    NodeIndex buildSpatialSplits(BuildContext &ctx,
+                                 const BvhSettings &settings) {
+        const NodeIndex primitiveCount = numberOfPrimitives();
+        std::vector<Reference> references(primitiveCount);
+        Bounds rootBounds;
+        for (NodeIndex i = 0; i < primitiveCount; i++) {
+            references[i] = { getBoundingBox(i), i };
+            rootBounds.extend(references[i].bounds);
+        }
+
+        SpatialSplitContext spatial{
+            ctx,
+            settings.spatialSplitAlpha * surfaceArea(rootBounds),
+            size_t(primitiveCount * (1 + settings.duplicationBudget)),
+            size_t(primitiveCount),
+        };
+        m_primitiveIndices.clear();
+        m_primitiveIndices.reserve(spatial.maxReferences);
+        const NodeIndex rootSlot =
+            subdivideSpatial(spatial, std::move(references), 0);
+        m_primitiveIndices.shrink_to_fit();
+
+        logger(EInfo,
+               "performed %d spatial splits, which reference each primitive "
+               "%.2f times on average",
+               spatial.spatialSplits,
+               spatial.references / std::max(double(primitiveCount), 1.0));
+        return rootSlot;
+    }
+
+    /**
+     * @brief Computes the SAH cost of the binary BVH, i.e., the expected
+     * number of nodes visited and primitives tested by a ray that hits the
+     * root (assuming both are equally expensive).
+     */
+    float binarySahCost() const {
+        if (m_primitiveIndices.empty())
+            return 0;
+
+        float cost = 0;
+        for (const Node &node : m_nodes) {
+            cost += surfaceArea(node.aabb) *
+                    (node.isLeaf() ? node.primitiveCount : 1);
+        }
+        return cost / surfaceArea(rootNode().aabb);
+    }
+
+    /**
+     * @brief Pads m_primitiveIndices with -1 so that the range of every leaf
+     * of the binary BVH starts at a multiple of the given alignment (see @ref
+     * BvhSettings::leafAlignment ).
+     */
+    void alignLeaves(int alignment) {
+        if (alignment <= 1 || m_primitiveIndices.empty())
             return;
+
+        std::vector<int> indices;
+        indices.reserve(m_primitiveIndices.size() + alignment * m_nodes.size());
+        for (Node &node : m_nodes) {
+            if (!node.isLeaf())
+                continue;
+            const NodeIndex first = NodeIndex(indices.size());
+            indices.insert(indices.end(),
+                           m_primitiveIndices.begin() + node.leftFirst,
+                           m_primitiveIndices.begin() + node.leftFirst +
+                               node.primitiveCount);
+            indices.resize((indices.size() + alignment - 1) / alignment *
+                               alignment,
+                           -1);
+            node.leftFirst = first;
         }
+        indices.shrink_to_fit();
+        m_primitiveIndices = std::move(indices);
+    }
 
-        // the two children will always be contiguous in our m_nodes list
-        const NodeIndex leftChildIndex  = (NodeIndex) (m_nodes.size() + 0);
-        const NodeIndex rightChildIndex = (NodeIndex) (m_nodes.size() + 1);
-        parent.primitiveCount = 0; // mark the parent node as internal node
-        parent.leftFirst      = leftChildIndex;
+    /// @brief Computes the SAH cost of a wide BVH, which counts every child
+    /// bounding box that is tested (and hence is not comparable to the cost
+    /// of a binary BVH).
+    template <int Width> float wideSahCost() const {
+        if (m_primitiveIndices.empty())
+            return 0;
 
-        m_nodes.emplace_back();
-        m_nodes[leftChildIndex].leftFirst      = firstLeftIndex;
-        m_nodes[leftChildIndex].primitiveCount = leftCount;
+        float cost = 0;
+        for (const WideNode<Width> &node : wideNodes<Width>()) {
+            for (int lane = 0; lane < node.childCount; lane++) {
+                const Bounds bounds{
+                    { node.bounds[0][0][lane],
+                      node.bounds[0][1][lane],
+                      node.bounds[0][2][lane] },
+                    { node.bounds[1][0][lane],
+                      node.bounds[1][1][lane],
+                      node.bounds[1][2][lane] },
+                };
+                cost += surfaceArea(bounds) *
+                        (node.primitiveCount[lane] ? node.primitiveCount[lane]
+                                                   : 1);
+            }
+        }
+        return cost / surfaceArea(rootNode().aabb);
+    }
+
+    /// @brief Computes the SAH cost of the BVH in the layout it is traversed
+    /// in.
+    float sahCost() const {
+        switch (m_layout) {
+        case BvhLayout::Wide4:
+            return wideSahCost<4>();
+        case BvhLayout::Wide8:
+            return wideSahCost<8>();
+        default:
+            return binarySahCost();
+        }
+    }
+
+    /// @brief Recomputes the bounds of all nodes of the binary BVH.
+    void refitBinary() {
+        // children are always stored after their parents, hence iterating
+        // backwards updates children before their parents
+        for (NodeIndex i = NodeIndex(m_nodes.size()) - 1; i >= 0; i--) {
+            Node &node = m_nodes[i];
+            if (node.isLeaf()) {
+                node.aabb = Bounds::empty();
+                for (NodeIndex j = 0; j < node.primitiveCount; j++) {
+                    node.aabb.extend(getBoundingBox(
+                        m_primitiveIndices[node.firstPrimitiveIndex() + j]));
+                }
+            } else {
+                node.aabb = m_nodes[node.leftChildIndex()].aabb;
+                node.aabb.extend(m_nodes[node.rightChildIndex()].aabb);
+            }
+        }
+    }
+
+    /// @brief Recomputes the bounds of all children of the wide BVH, as well
+    /// as the bounds of the root node.
+    template <int Width> void refitWide() {
+        auto &nodes = wideNodes<Width>();
+        // the bounds of all wide nodes, i.e., the union of their children
+        std::vector<Bounds> nodeBounds(nodes.size());
+        // children are always stored after their parents, hence iterating
+        // backwards updates children before their parents
+        for (NodeIndex i = NodeIndex(nodes.size()) - 1; i >= 0; i--) {
+            WideNode<Width> &node = nodes[i];
+            for (int lane = 0; lane < node.childCount; lane++) {
+                Bounds bounds;
+                if (node.primitiveCount[lane]) {
+                    for (NodeIndex j = 0; j < node.primitiveCount[lane]; j++) {
+                        bounds.extend(getBoundingBox(
+                            m_primitiveIndices[node.leftFirst[lane] + j]));
+                    }
+                } else {
+                    bounds = nodeBounds[node.leftFirst[lane]];
+                }
+
+                for (int axis = 0; axis < 3; axis++) {
+                    node.bounds[0][axis][lane] = bounds.min()[axis];
+                    node.bounds[1][axis][lane] = bounds.max()[axis];
+                }
+                nodeBounds[i].extend(bounds);
+            }
+        }
+        m_nodes.front().aabb = nodeBounds.front();
+    }
+
+    /// @brief Computes the key under which a BVH is cached, which covers
+    /// the content of the shape and all settings that affect the binary BVH.
+    uint64_t computeCacheKey(uint64_t contentHash,
+                             const BvhSettings &settings) const {
+        hash::fnv1a key{ contentHash,
+                         CacheVersion,
+                         uint32_t(numberOfPrimitives()),
+                         uint32_t(MaxDepth),
+                         uint32_t(BinCount),
+                         uint32_t(settings.leafSize) };
+        if (settings.spatialSplits) {
+            key << uint32_t(SpatialBinCount)
+                << std::bit_cast<uint32_t>(settings.duplicationBudget)
+                << std::bit_cast<uint32_t>(settings.spatialSplitAlpha);
+        }
+        return key;
+    }
+
+    /**
+     * @brief Reads m_nodes and m_primitiveIndices from a cache file.
+     * @return Whether the file exists and holds a BVH for the given key.
+     */
+    bool loadFromCache(const std::filesystem::path &path, uint64_t key) {
+        static_assert(std::is_trivially_copyable_v<Node>);
+
+        const MappedFile file{ path };
+        if (!file.isValid() || file.size() < sizeof(CacheHeader))
+            return false;
+
+        CacheHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+            header.version != CacheVersion || header.nodeSize != sizeof(Node) ||
+            header.key != key || header.nodeCount == 0)
+            return false;
+
+        if (header.nodeCount > file.size() / sizeof(Node) ||
+            header.indexCount > file.size() / sizeof(int))
+            return false;
+        const size_t nodeBytes  = header.nodeCount * sizeof(Node);
+        const size_t indexBytes = header.indexCount * sizeof(int);
+        if (file.size() != sizeof(CacheHeader) + nodeBytes + indexBytes)
+            return false;
+
+        // the nodes are copied out of the mapping rather than used in place,
+        // since they are modified after loading (leaf alignment, refitting)
+        // and the file is unmapped once the BVH has been loaded
+        const uint8_t *data = file.data() + sizeof(CacheHeader);
+        m_nodes.resize(header.nodeCount);
+        std::memcpy(m_nodes.data(), data, nodeBytes);
+        m_primitiveIndices.resize(header.indexCount);
+        std::memcpy(m_primitiveIndices.data(), data + nodeBytes, indexBytes);
+
+        if (!isValidTree()) {
+            logger(EWarn, "ignoring corrupted BVH cache file %s", path.string());
+            m_nodes.clear();
+            m_primitiveIndices.clear();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Checks that m_nodes and m_primitiveIndices form a tree that can
+     * be traversed safely, i.e., that every index is in range and that the
+     * tree is no deeper than @ref MaxDepth (which bounds the traversal
+     * stacks). Children always follow their parents in m_nodes, which also
+     * rules out cycles.
+     */
+    bool isValidTree() const {
+        const int64_t nodeCount  = int64_t(m_nodes.size());
+        const int64_t indexCount = int64_t(m_primitiveIndices.size());
+        for (const int primitiveIndex : m_primitiveIndices) {
+            if (primitiveIndex < 0 || primitiveIndex >= numberOfPrimitives())
+                return false;
+        }
+        if (indexCount == 0) {
+            // BVHs without primitives consist of an empty root only
+            return nodeCount == 1;
+        }
+
+        std::vector<int> depths(m_nodes.size(), 0);
+        for (int64_t index = 0; index < nodeCount; index++) {
+            const Node &node = m_nodes[index];
+            if (node.primitiveCount < 0)
+                return false;
+            if (node.isLeaf()) {
+                if (node.leftFirst < 0 ||
+                    int64_t(node.leftFirst) + node.primitiveCount > indexCount)
+                    return false;
+                continue;
+            }
+            if (node.leftFirst <= index ||
+                int64_t(node.leftFirst) + 1 >= nodeCount ||
+                depths[index] >= MaxDepth)
+                return false;
+            for (const NodeIndex child :
+                 { node.leftChildIndex(), node.rightChildIndex() })
+                depths[child] = std::max(depths[child], depths[index] + 1);
+        }
+        return true;
+    }
+
+    /// @brief Writes m_nodes and m_primitiveIndices to a cache file.
+    void storeToCache(const std::filesystem::path &path, uint64_t key) const {
+        CacheHeader header;
+        std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+        header.version    = CacheVersion;
+        header.nodeSize   = sizeof(Node);
+        header.key        = key;
+        header.nodeCount  = m_nodes.size();
+        header.indexCount = m_primitiveIndices.size();
+
+        const bool written = writeFileAtomically(path, [&](std::ostream &file) {
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char *>(m_nodes.data()),
+                       m_nodes.size() * sizeof(Node));
+            file.write(
+                reinterpret_cast<const char *>(m_primitiveIndices.data()),
+                m_primitiveIndices.size() * sizeof(int));
+        });
+        if (!written)
+            logger(EWarn, "could not write BVH cache file %s", path.string());
+    }
+
+    /**
+     * @brief Copies the subtree of a built node into m_nodes at the given
+     * index, appending its descendants in the same (depth-first) order that a
+     * single-threaded build produces, i.e., the result does not depend on the
+     * order in which tasks have finished.
+     */
+    void flatten(const BuildContext &ctx, NodeIndex slot, NodeIndex index) {
+        const BuildNode &buildNode = ctx.nodes[slot];
+        m_nodes[index]             = buildNode.node;
+        if (buildNode.children[0] < 0)
+            return;
 
+        // the two children will always be contiguous in our m_nodes list
+        const NodeIndex leftChildIndex = (NodeIndex) m_nodes.size();
+        m_nodes[index].leftFirst       = leftChildIndex;
+        m_nodes.emplace_back();
         m_nodes.emplace_back();
-        m_nodes[rightChildIndex].leftFirst      = firstRightIndex;
-        m_nodes[rightChildIndex].primitiveCount = rightCount;
 
-        // first, process the left child node (and all of its children)
-        computeAABB(m_nodes[leftChildIndex]);
-        subdivide(m_nodes[leftChildIndex]);
-        // then, process the right child node (and all of its children)
-        computeAABB(m_nodes[rightChildIndex]);
-        subdivide(m_nodes[rightChildIndex]);
+        flatten(ctx, buildNode.children[0], leftChildIndex);
+        flatten(ctx, buildNode.children[1], leftChildIndex + 1);
+    }
+
+    /**
+     * @brief Fills a wide node with the children of a binary node. Internal
+     * children with the largest surface area are repeatedly replaced by their
+     * own children, until the wide node is full or only leaves remain.
+     */
+    template <int Width>
+    void collapseNode(NodeIndex binaryIndex, NodeIndex wideIndex) {
+        NodeIndex children[Width];
+        int count        = 0;
+        const Node &node = m_nodes[binaryIndex];
+        if (node.isLeaf()) {
+            // only happens for the root, which becomes a single leaf child
+            children[count++] = binaryIndex;
+        } else {
+            children[count++] = node.leftChildIndex();
+            children[count++] = node.rightChildIndex();
+            while (count < Width) {
+                int largest       = -1;
+                float largestArea = -Infinity;
+                for (int i = 0; i < count; i++) {
+                    const Node &child = m_nodes[children[i]];
+                    if (child.isLeaf())
+                        continue;
+                    const float area = surfaceArea(child.aabb);
+                    if (area > largestArea) {
+                        largest     = i;
+                        largestArea = area;
+                    }
+                }
+                if (largest < 0)
+                    break;
+
+                const Node &opened = m_nodes[children[largest]];
+                children[largest]  = opened.leftChildIndex();
+                children[count++]  = opened.rightChildIndex();
+            }
+        }
+
+        auto &nodes = wideNodes<Width>();
+        WideNode<Width> wideNode;
+        wideNode.childCount = count;
+        for (int lane = 0; lane < Width; lane++) {
+            const Bounds bounds =
+                lane < count ? m_nodes[children[lane]].aabb : Bounds::empty();
+            for (int axis = 0; axis < 3; axis++) {
+                wideNode.bounds[0][axis][lane] = bounds.min()[axis];
+                wideNode.bounds[1][axis][lane] = bounds.max()[axis];
+            }
+            wideNode.leftFirst[lane]      = -1;
+            wideNode.primitiveCount[lane] = 0;
+            if (lane >= count)
+                continue;
+
+            const Node &child = m_nodes[children[lane]];
+            if (child.isLeaf()) {
+                wideNode.leftFirst[lane]      = child.leftFirst;
+                wideNode.primitiveCount[lane] = child.primitiveCount;
+            } else {
+                wideNode.leftFirst[lane] = NodeIndex(nodes.size());
+                nodes.emplace_back();
+            }
+        }
+        nodes[wideIndex] = wideNode;
+
+        for (int lane = 0; lane < count; lane++) {
+            if (!wideNode.primitiveCount[lane])
+                collapseNode<Width>(children[lane], wideNode.leftFirst[lane]);
+        }
+    }
+
+    /// @brief Collapses the binary BVH into a wide BVH, after which only the
+    /// root of the binary BVH is kept.
+    template <int Width> void collapse() {
+        auto &nodes = wideNodes<Width>();
+        nodes.clear();
+        nodes.emplace_back();
+        collapseNode<Width>(0, 0);
+        nodes.shrink_to_fit();
+
+        m_nodes.resize(1);
+        m_nodes.shrink_to_fit();
     }
 
 protected:
+    /// @brief Reads the BVH layout requested by the @c bvh attribute of a
+    /// shape, which is either "binary" (default), "wide4" or "wide8".
+    static BvhLayout getBvhLayout(const Properties &properties) {
+        return properties.getEnum<BvhLayout>("bvh",
+                                             BvhLayout::Binary,
+                                             {
+                                                 { "binary", BvhLayout::Binary },
+                                                 { "wide4", BvhLayout::Wide4 },
+                                                 { "wide8", BvhLayout::Wide8 },
+                                             });
+    }
+
+    /**
+     * @brief Reads the BVH settings of a shape, i.e., the layout (see @ref
+     * getBvhLayout ), whether to use spatial splits (@c spatialSplits ,
+     * default false) along with their @c duplicationBudget and @c
+     * spatialSplitAlpha , the directory in which BVHs are cached (@c
+     * bvhCache , defaults to the LW_BVH_CACHE environment variable), the
+     * @c refitThreshold and the @c leafSize .
+     */
+    static BvhSettings getBvhSettings(const Properties &properties) {
+        BvhSettings settings;
+        settings.layout = getBvhLayout(properties);
+        settings.spatialSplits =
+            properties.get<bool>("spatialSplits", settings.spatialSplits);
+        settings.duplicationBudget = properties.get<float>(
+            "duplicationBudget", settings.duplicationBudget);
+        settings.spatialSplitAlpha = properties.get<float>(
+            "spatialSplitAlpha", settings.spatialSplitAlpha);
+        settings.refitThreshold =
+            properties.get<float>("refitThreshold", settings.refitThreshold);
+        settings.leafSize = properties.get<int>("leafSize", settings.leafSize);
+        // caching can be enabled for all shapes at once (e.g., on a render
+        // farm) through the LW_BVH_CACHE environment variable
+        settings.cacheDirectory = properties.get<std::filesystem::path>(
+            "bvhCache", defaultCacheDirectory());
+        return settings;
+    }
+
     /// @brief Returns the number of children (individual shapes) that are part
     /// of this acceleration structure.
     virtual int numberOfPrimitives() const = 0;
@@ -375,51 +1737,335 @@ protected:
     /// index) with the given ray.
     virtual float transmittance(int primitiveIndex, const Ray &ray, float tMax,
                                 Sampler &rng) const = 0;
+    /**
+     * @brief Tests whether a single child (identified by the index) blocks the
+     * ray before tMax. Override this if occlusion can be tested more cheaply
+     * than a full intersection.
+     */
+    virtual bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                          Sampler &rng) const {
+        Intersection its(-ray.direction, tMax);
+        return intersect(primitiveIndex, ray, its, rng);
+    }
     /// @brief Returns the axis aligned bounding box of the given child.
     virtual Bounds getBoundingBox(int primitiveIndex) const = 0;
     /// @brief Returns the centroid of the given child.
     virtual Point getCentroid(int primitiveIndex) const = 0;
+    /**
+     * @brief Computes the bounding boxes of the parts of the given child that
+     * lie below and above an axis aligned plane (used by spatial splits).
+     * The results are clipped to the respective side by the caller, hence
+     * returning the full bounding box for both sides is always valid, but
+     * overriding this with tighter bounds makes spatial splits more effective.
+     */
+    virtual void splitBoundingBox(int primitiveIndex, int axis, float position,
+                                  Bounds &left, Bounds &right) const {
+        left = right = getBoundingBox(primitiveIndex);
+    }
+    /**
+     * @brief Returns a hash of all data that the BVH build depends on (e.g.,
+     * the vertex positions and indices of a mesh), which identifies cached
+     * BVHs. Shapes that return nothing (the default) are never cached.
+     */
+    virtual std::optional<uint64_t> contentHash() const { return {}; }
+    /**
+     * @brief Called whenever the BVH has been built (or loaded), e.g., to lay
+     * out per-primitive data in the order of @ref primitiveIndices .
+     */
+    virtual void buildFinished() {}
 
-    /// @brief Builds the acceleration structure.
-    void buildAccelerationStructure() {
-        Timer buildTimer;
+    /**
+     * @brief The primitives of all leaves, where the leaf ranges passed to
+     * @ref intersectLeaves and @ref occludedLeaves index into. Entries that
+     * only pad leaves (see @ref BvhSettings::leafAlignment ) are -1.
+     */
+    const std::vector<int> &primitiveIndices() const {
+        return m_primitiveIndices;
+    }
 
-        // fill primitive indices with 0 to primitiveCount - 1
-        m_primitiveIndices.resize(numberOfPrimitives());
-        std::iota(m_primitiveIndices.begin(), m_primitiveIndices.end(), 0);
+    /// @brief Whether both binary BVHs consist of the exact same nodes and
+    /// primitive order (e.g., to check that builds are deterministic).
+    bool hasSameTree(const AccelerationStructure &other) const {
+        return m_primitiveIndices == other.m_primitiveIndices &&
+               std::equal(m_nodes.begin(),
+                          m_nodes.end(),
+                          other.m_nodes.begin(),
+                          other.m_nodes.end(),
+                          [](const Node &a, const Node &b) {
+                              return a.aabb == b.aabb &&
+                                     a.leftFirst == b.leftFirst &&
+                                     a.primitiveCount == b.primitiveCount;
+                          });
+    }
 
-        // create root node
-        auto &root          = m_nodes.emplace_back();
-        root.leftFirst      = 0;
-        root.primitiveCount = numberOfPrimitives();
-        computeAABB(root);
-        subdivide(root);
+    /**
+     * @brief Finds the closest intersection with any primitive, where @c
+     * intersectPrimitive tests a single primitive (identified by its index)
+     * and updates @c its if it is hit.
+     */
+    template <typename IntersectPrimitive>
+    bool intersectPrimitives(const Ray &ray, Intersection &its,
+                             IntersectPrimitive &&intersectPrimitive) const {
+        return intersectLeaves(ray, its, [&](int first, int count) {
+            bool wasIntersected = false;
+            for (int i = 0; i < count; i++) {
+                // test the child for intersection
+                wasIntersected |=
+                    intersectPrimitive(m_primitiveIndices[first + i]);
+            }
+            return wasIntersected;
+        });
+    }
 
-        logger(EInfo,
-               "built BVH with %ld nodes for %ld primitives in %.1f ms",
-               m_nodes.size(),
-               numberOfPrimitives(),
-               buildTimer.getElapsedTime() * 1000);
+    /**
+     * @brief Finds the closest intersection with any leaf, where @c
+     * intersectLeaf is called with the range [first, first + count) in @ref
+     * primitiveIndices of every leaf that is visited, and updates @c its if
+     * any of its primitives is hit.
+     */
+    template <typename IntersectLeaf>
+    bool intersectLeaves(const Ray &ray, Intersection &its,
+                         IntersectLeaf &&intersectLeaf) const {
+        bool wasIntersected = false;
+        traverse(ray,
+                 its.t,
+                 its.stats.bvhCounter,
+                 [&](NodeIndex first, NodeIndex count) {
+                     // update the statistic tracking how many children have
+                     // been tested for intersection
+                     its.stats.primCounter += count;
+                     wasIntersected |= intersectLeaf(first, count);
+                     return false;
+                 });
+        return wasIntersected;
+    }
+
+    /// @brief Tests whether any primitive blocks the ray before tMax, where @c
+    /// occludedPrimitive tests a single primitive.
+    template <typename OccludedPrimitive>
+    bool occludedPrimitives(const Ray &ray, float tMax,
+                            OccludedPrimitive &&occludedPrimitive) const {
+        return occludedLeaves(ray, tMax, [&](int first, int count) {
+            for (int i = 0; i < count; i++) {
+                if (occludedPrimitive(m_primitiveIndices[first + i]))
+                    return true;
+            }
+            return false;
+        });
+    }
+
+    /// @brief Tests whether any leaf blocks the ray before tMax, where @c
+    /// occludedLeaf tests the primitives of a single leaf (see @ref
+    /// intersectLeaves ).
+    template <typename OccludedLeaf>
+    bool occludedLeaves(const Ray &ray, float tMax,
+                        OccludedLeaf &&occludedLeaf) const {
+        bool isOccluded = false;
+        int nodeCounter = 0;
+        traverse(
+            ray, tMax, nodeCounter, [&](NodeIndex first, NodeIndex count) {
+                isOccluded = occludedLeaf(first, count);
+                return isOccluded;
+            });
+        return isOccluded;
+    }
+
+    /// @brief Computes the transmittance along the ray up to tMax, where @c
+    /// transmittancePrimitive computes it for a single primitive.
+    template <typename TransmittancePrimitive>
+    float transmittancePrimitives(
+        const Ray &ray, float tMax,
+        TransmittancePrimitive &&transmittancePrimitive) const {
+        float T{ 1 };
+        int nodeCounter = 0;
+        traverse(
+            ray, tMax, nodeCounter, [&](NodeIndex first, NodeIndex count) {
+                for (NodeIndex i = 0; i < count && T; i++)
+                    T *= transmittancePrimitive(m_primitiveIndices[first + i]);
+                return !T;
+            });
+        return T;
+    }
+
+    /// @brief Builds the acceleration structure, or loads it from the cache.
+    void buildAccelerationStructure(const BvhSettings &settings = {}) {
+        const auto buildStart = std::chrono::steady_clock::now();
+        const NodeIndex primitiveCount = numberOfPrimitives();
+
+        std::filesystem::path cachePath;
+        uint64_t cacheKey = 0;
+        if (!settings.cacheDirectory.empty()) {
+            if (const auto hash = contentHash()) {
+                cacheKey  = computeCacheKey(*hash, settings);
+                cachePath = settings.cacheDirectory /
+                            tfm::format("%016x.bvh", cacheKey);
+            }
+        }
+
+        BuildContext ctx;
+        // the wall time of the phases whose work is measured by WorkTimer
+        int64_t timedWallTime = 0;
+        ctx.leafSize = settings.leafSize;
+        ctx.parallel = ctx.parallel && settings.parallelBuild;
+        const bool isCached =
+            !cachePath.empty() && loadFromCache(cachePath, cacheKey);
+        if (isCached) {
+            logger(EInfo, "BVH cache hit, loaded %s", cachePath.string());
+        } else {
+            if (!cachePath.empty())
+                logger(EInfo, "BVH cache miss for %s", cachePath.string());
+
+            NodeIndex rootSlot;
+            if (settings.spatialSplits) {
+                ctx.parallel = false;
+                rootSlot     = buildSpatialSplits(ctx, settings);
+            } else {
+                // fill primitive indices with 0 to primitiveCount - 1
+                m_primitiveIndices.resize(primitiveCount);
+                std::iota(
+                    m_primitiveIndices.begin(), m_primitiveIndices.end(), 0);
+
+                // create root node, which occupies the last slot of the build
+                // buffer
+                ctx.nodes.resize(std::max(2 * primitiveCount - 1, 1));
+                rootSlot            = NodeIndex(ctx.nodes.size()) - 1;
+                auto &root          = ctx.nodes[rootSlot].node;
+                root.leftFirst      = 0;
+                root.primitiveCount = primitiveCount;
+                const auto timedStart = std::chrono::steady_clock::now();
+                gatherPrimitives(ctx);
+                {
+                    WorkTimer timer{ ctx };
+                    computeAABB(ctx, root);
+                }
+                subdivide(ctx, rootSlot, 0, 0);
+                ctx.subtrees.wait();
+                timedWallTime =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - timedStart)
+                        .count();
+            }
+
+            m_nodes.clear();
+            m_nodes.reserve(ctx.nodes.size());
+            m_nodes.emplace_back();
+            flatten(ctx, rootSlot, 0);
+            m_nodes.shrink_to_fit();
+
+            if (!cachePath.empty())
+                storeToCache(cachePath, cacheKey);
+        }
+        alignLeaves(settings.leafAlignment);
+        const size_t binaryNodeCount = m_nodes.size();
+        const float cost             = binarySahCost();
+
+        m_layout = primitiveCount ? settings.layout : BvhLayout::Binary;
+        switch (m_layout) {
+        case BvhLayout::Binary:
+            break;
+        case BvhLayout::Wide4:
+            collapse<4>();
+            logger(EInfo,
+                   "collapsed BVH into %ld nodes of width 4",
+                   m_wideNodes4.size());
+            break;
+        case BvhLayout::Wide8:
+            collapse<8>();
+            logger(EInfo,
+                   "collapsed BVH into %ld nodes of width 8",
+                   m_wideNodes8.size());
+            break;
+        }
+        m_settings  = settings;
+        m_buildCost = sahCost();
+        buildFinished();
+
+        const auto buildTime =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - buildStart)
+                .count();
+        if (!isCached && ctx.parallel &&
+            primitiveCount > ParallelBuildThreshold) {
+            logger(EInfo,
+                   "built BVH with %ld nodes for %ld primitives in %.1f ms "
+                   "(SAH cost %.2f, %.1f threads busy on average)",
+                   binaryNodeCount,
+                   numberOfPrimitives(),
+                   buildTime * 1e-6,
+                   cost,
+                   ctx.workTime / std::max(double(timedWallTime), 1.0));
+        } else {
+            logger(EInfo,
+                   "%s BVH with %ld nodes for %ld primitives in %.1f ms "
+                   "(SAH cost %.2f)",
+                   isCached ? "loaded" : "built",
+                   binaryNodeCount,
+                   numberOfPrimitives(),
+                   buildTime * 1e-6,
+                   cost);
+        }
     }
 
 public:
-    bool intersect(const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
+    /**
+     * @brief Updates the bounds of all nodes after primitives have moved (e.g.,
+     * when the transforms of instances have changed), without re-partitioning
+     * the primitives. This takes linear time, but the BVH degrades with large
+     * movements, hence it is rebuilt from scratch once its SAH cost exceeds
+     * that of the last build by more than @ref BvhSettings::refitThreshold .
+     * @note Leaves use the full bounds of their primitives, even if they were
+     * clipped by spatial splits. Nested acceleration structures need to be
+     * refitted first. Scenes are static for now, so this is only called by
+     * code that modifies primitives itself (e.g., the unit tests).
+     * @return Whether the BVH has been rebuilt.
+     */
+    bool refit() {
         if (m_primitiveIndices.empty())
-            return false; // exit early if no children exist
-        if (intersectAABB(rootNode().aabb, ray) <
-            its.t) // test root bounding box for potential hit
-            return intersectNode(rootNode(), ray, its, rng);
+            return false;
+
+        switch (m_layout) {
+        case BvhLayout::Binary:
+            refitBinary();
+            break;
+        case BvhLayout::Wide4:
+            refitWide<4>();
+            break;
+        case BvhLayout::Wide8:
+            refitWide<8>();
+            break;
+        }
+
+        const float cost = sahCost();
+        if (!(cost <= m_buildCost * m_settings.refitThreshold)) {
+            logger(EInfo,
+                   "SAH cost of refitted BVH degraded from %.2f to %.2f, "
+                   "rebuilding",
+                   m_buildCost,
+                   cost);
+            buildAccelerationStructure(m_settings);
+            return true;
+        }
         return false;
     }
 
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        return intersectPrimitives(ray, its, [&](int primitiveIndex) {
+            return intersect(primitiveIndex, ray, its, rng);
+        });
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        return occludedPrimitives(ray, tMax, [&](int primitiveIndex) {
+            return occluded(primitiveIndex, ray, tMax, rng);
+        });
+    }
+
     float transmittance(const Ray &ray, float tMax,
                         Sampler &rng) const override {
-        float T{ 1 };
-        if (!m_primitiveIndices.empty() &&
-            intersectAABB(rootNode().aabb, ray) < tMax)
-            transmittanceNode(rootNode(), ray, tMax, rng, T);
-        return T;
+        return transmittancePrimitives(ray, tMax, [&](int primitiveIndex) {
+            return transmittance(primitiveIndex, ray, tMax, rng);
+        });
     }
 
     Bounds getBoundingBox() const override { return rootNode().aabb; }
@@ -427,4 +2073,56 @@ public:
     Point getCentroid() const override { return rootNode().aabb.center(); }
 };
 
+/**
+ * @brief An @ref AccelerationStructure whose traversal calls the per-primitive
+ * methods of @c Derived directly instead of through the vtable, which allows
+ * the compiler to inline them into the leaf loops (curiously recurring template
+ * pattern).
+ *
+ * Derived classes implement the same per-primitive methods as for @ref
+ * AccelerationStructure , and need to befriend this class so that it can call
+ * them:
+ * @code
+ * class TriangleMesh final : public InlineAccelerationStructure<TriangleMesh> {
+ *     friend class InlineAccelerationStructure<TriangleMesh>;
+ *     ...
+ * };
+ * @endcode
+ */
+template <typename Derived>
+class InlineAccelerationStructure : public AccelerationStructure {
+    const Derived &derived() const {
+        return static_cast<const Derived &>(*this);
+    }
+
+protected:
+    // keep the per-primitive methods visible next to the overrides below
+    using AccelerationStructure::intersect;
+    using AccelerationStructure::occluded;
+    using AccelerationStructure::transmittance;
+
+public:
+    bool intersect(const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        // qualified calls bypass virtual dispatch
+        return intersectPrimitives(ray, its, [&](int primitiveIndex) {
+            return derived().Derived::intersect(primitiveIndex, ray, its, rng);
+        });
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        return occludedPrimitives(ray, tMax, [&](int primitiveIndex) {
+            return derived().Derived::occluded(primitiveIndex, ray, tMax, rng);
+        });
+    }
+
+    float transmittance(const Ray &ray, float tMax,
+                        Sampler &rng) const override {
+        return transmittancePrimitives(ray, tMax, [&](int primitiveIndex) {
+            return derived().Derived::transmittance(
+                primitiveIndex, ray, tMax, rng);
+        });
+    }
+};
+
 } // namespace lightwave
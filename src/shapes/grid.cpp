@@ -1,98 +1,548 @@
 #include <lightwave.hpp>
+#include <lightwave/mappedfile.hpp>
+
+#include <array>
+#include <cstring>
 #include <fstream>
 
 namespace lightwave {
 
+/**
+ * @brief A heterogeneous volume whose density is interpolated trilinearly from
+ * a voxel grid over the unit cube. Free-flight distances are sampled with
+ * delta tracking against a coarse grid of majorants, each of which bounds the
+ * density within a brick of voxels. Rays are traversed brick by brick (3D
+ * DDA), so that empty bricks are skipped entirely and sparse regions only
+ * produce few null collisions. The size of the bricks is set in voxels by
+ * @c majorantBrickSize , where 0 uses a single majorant for the whole grid.
+ *
+ * The voxels are stored sparsely in bricks of 8^3 voxels, of which only those
+ * with any density are kept. The raw volume file (three floats with the
+ * resolution, followed by the densities with x varying fastest) is converted
+ * to this format once, stored in a brick file with the extension ".bricks"
+ * (see @ref convertedFilePath for where it is placed), and memory mapped
+ * whenever the volume is loaded again. Setting @c cache to false keeps the
+ * converted bricks in memory instead.
+ *
+ * Transmittance is estimated with ratio tracking by default, or any other
+ * @ref TransmittanceEstimator . How many of the tentative collisions of
+ * free-flight sampling were null, and the statistics of the transmittance
+ * estimates, are reported when the volume is destroyed.
+ */
 class GridVolume : public Shape {
-    float m_multiplier;     
+    /// @brief The header of a brick file, which is followed by the index of
+    /// all bricks and then the voxels of all non-empty bricks.
+    struct BrickHeader {
+        char magic[8];
+        uint32_t version;
+        int32_t resolution[3];
+        /// @brief The size of the raw file that has been converted.
+        uint64_t sourceSize;
+        /// @brief The modification time of the raw file that has been
+        /// converted, which tells whether the brick file is outdated.
+        int64_t sourceTime;
+        uint64_t brickCount;
+    };
+
+    static constexpr char BrickMagic[8] = "lw-grid";
+    /// @brief Increment this whenever the file format changes, which
+    /// invalidates all existing brick files.
+    static constexpr uint32_t BrickVersion = 1;
+    static constexpr int BrickSize   = 8;
+    static constexpr int BrickVoxels = BrickSize * BrickSize * BrickSize;
+
+    float m_multiplier;
     float m_sigma_t;
     Vector3i m_resolution;
-    std::vector<float> m_density;
-    float m_maxDensity;
-    float invMaxDensity;
+
+    /// @brief The brick file, unless it could not be written.
+    std::unique_ptr<MappedFile> m_file;
+    /// @brief The converted brick file if it could not be written.
+    std::vector<uint8_t> m_buffer;
+    /// @brief The number of bricks along each axis.
+    Vector3i m_bricks;
+    /// @brief The slot in @c m_brickData of each brick, or -1 for bricks
+    /// without density.
+    const int32_t *m_index;
+    /// @brief The voxels of all non-empty bricks, with x varying fastest
+    /// within each brick.
+    const float *m_brickData;
+    size_t m_brickCount;
+    /// @brief The region of the unit cube in which the density can be
+    /// non-zero.
+    Bounds m_bounds;
+
+    /// @brief The number of voxels along each edge of a majorant brick.
+    int m_majorantBrickSize;
+    /// @brief The number of majorant bricks along each axis.
+    Vector3i m_majorantBricks;
+    /// @brief The largest density within each majorant brick.
+    std::vector<float> m_majorants;
+    /// @brief The smallest density within each majorant brick.
+    std::vector<float> m_minorants;
+
+    TransmittanceEstimator m_estimator;
+
+    struct CollisionCounts {
+        uint64_t collisions     = 0;
+        uint64_t nullCollisions = 0;
+    };
+    /// @brief The tentative collisions of free-flight sampling, counted per
+    /// thread.
+    PerThread<CollisionCounts> m_collisionCounts;
+
+    static Vector3i brickCounts(const Vector3i &resolution) {
+        Vector3i result;
+        for (int dim = 0; dim < 3; dim++)
+            result[dim] = (resolution[dim] + BrickSize - 1) / BrickSize;
+        return result;
+    }
+
+    /// @brief Converts a raw volume file to a brick file, reading one slab of
+    /// bricks at a time.
+    static std::vector<uint8_t> convert(const std::filesystem::path &path,
+                                        uint64_t sourceSize,
+                                        int64_t sourceTime) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input.is_open()) {
+            lightwave_throw("Error opening volume file: %s", path.string());
+        }
+
+        float size[3];
+        input.read(reinterpret_cast<char *>(size), sizeof(size));
+        BrickHeader header;
+        std::memcpy(header.magic, BrickMagic, sizeof(BrickMagic));
+        header.version    = BrickVersion;
+        header.sourceSize = sourceSize;
+        header.sourceTime = sourceTime;
+        for (int dim = 0; dim < 3; dim++)
+            header.resolution[dim] = int32_t(size[dim]);
+        const Vector3i resolution(
+            header.resolution[0], header.resolution[1], header.resolution[2]);
+        if (!input || resolution.x() <= 0 || resolution.y() <= 0 ||
+            resolution.z() <= 0) {
+            lightwave_throw("Invalid volume file: %s", path.string());
+        }
+
+        const Vector3i bricks = brickCounts(resolution);
+        std::vector<int32_t> index(bricks.product(), -1);
+        std::vector<float> data;
+        const size_t sliceSize = size_t(resolution.x()) * resolution.y();
+        std::vector<float> slab(sliceSize * BrickSize);
+        for (int bz = 0; bz < bricks.z(); bz++) {
+            const int depth = std::min(BrickSize, resolution.z() - bz * BrickSize);
+            input.read(reinterpret_cast<char *>(slab.data()),
+                       sliceSize * depth * sizeof(float));
+            if (!input) {
+                lightwave_throw("Truncated volume file: %s", path.string());
+            }
+
+            for (int by = 0; by < bricks.y(); by++) {
+                for (int bx = 0; bx < bricks.x(); bx++) {
+                    const int height =
+                        std::min(BrickSize, resolution.y() - by * BrickSize);
+                    const int width =
+                        std::min(BrickSize, resolution.x() - bx * BrickSize);
+                    // voxels beyond the border of the grid are padded with 0
+                    std::array<float, BrickVoxels> brick{};
+                    bool isEmpty = true;
+                    for (int z = 0; z < depth; z++) {
+                        for (int y = 0; y < height; y++) {
+                            for (int x = 0; x < width; x++) {
+                                const float v =
+                                    slab[(z * resolution.y() + by * BrickSize +
+                                          y) * size_t(resolution.x()) +
+                                         bx * BrickSize + x];
+                                brick[(z * BrickSize + y) * BrickSize + x] = v;
+                                isEmpty &= !(v > 0);
+                            }
+                        }
+                    }
+                    if (isEmpty)
+                        continue;
+                    index[(bz * bricks.y() + by) * bricks.x() + bx] =
+                        int32_t(data.size() / BrickVoxels);
+                    data.insert(data.end(), brick.begin(), brick.end());
+                }
+            }
+        }
+        header.brickCount = data.size() / BrickVoxels;
+
+        const size_t indexBytes = index.size() * sizeof(int32_t);
+        const size_t dataBytes  = data.size() * sizeof(float);
+        std::vector<uint8_t> result(sizeof(header) + indexBytes + dataBytes);
+        std::memcpy(result.data(), &header, sizeof(header));
+        std::memcpy(result.data() + sizeof(header), index.data(), indexBytes);
+        std::memcpy(result.data() + sizeof(header) + indexBytes,
+                    data.data(),
+                    dataBytes);
+        return result;
+    }
+
+    /**
+     * @brief Points the brick index and data into the contents of a brick
+     * file.
+     * @return Whether the contents are a valid brick file that has been
+     * converted from the given raw file.
+     */
+    bool open(const uint8_t *contents, size_t size, uint64_t sourceSize,
+              int64_t sourceTime) {
+        if (!contents || size < sizeof(BrickHeader))
+            return false;
+
+        BrickHeader header;
+        std::memcpy(&header, contents, sizeof(header));
+        if (std::memcmp(header.magic, BrickMagic, sizeof(BrickMagic)) != 0 ||
+            header.version != BrickVersion ||
+            header.sourceSize != sourceSize ||
+            header.sourceTime != sourceTime || header.resolution[0] <= 0 ||
+            header.resolution[1] <= 0 || header.resolution[2] <= 0)
+            return false;
+
+        m_resolution = Vector3i(
+            header.resolution[0], header.resolution[1], header.resolution[2]);
+        m_bricks                = brickCounts(m_resolution);
+        const size_t indexBytes = m_bricks.product() * sizeof(int32_t);
+        if (size != sizeof(BrickHeader) + indexBytes +
+                        header.brickCount * BrickVoxels * sizeof(float))
+            return false;
+
+        m_index = reinterpret_cast<const int32_t *>(contents + sizeof(header));
+        m_brickData = reinterpret_cast<const float *>(contents +
+                                                      sizeof(header) +
+                                                      indexBytes);
+        m_brickCount = header.brickCount;
+        // slots past the brick data would read beyond the end of the file
+        for (int i = 0; i < m_bricks.product(); i++) {
+            if (m_index[i] >= int64_t(m_brickCount))
+                return false;
+        }
+        return true;
+    }
+
+    /// @brief Calls @c visit with the index and slot of every non-empty
+    /// brick.
+    template <typename Visit> void forEachBrick(Visit &&visit) const {
+        for (int bz = 0; bz < m_bricks.z(); bz++) {
+            for (int by = 0; by < m_bricks.y(); by++) {
+                for (int bx = 0; bx < m_bricks.x(); bx++) {
+                    const int32_t slot =
+                        m_index[(bz * m_bricks.y() + by) * m_bricks.x() + bx];
+                    if (slot >= 0)
+                        visit(Pointi(bx, by, bz), slot);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Computes the region in which trilinear interpolation can yield
+     * non-zero density, which extends half a voxel beyond the non-empty
+     * bricks (clamped to the unit cube).
+     */
+    void computeBounds() {
+        m_bounds = Bounds::empty();
+        forEachBrick([&](const Pointi &brick, int32_t) {
+            for (int dim = 0; dim < 3; dim++) {
+                const float first = brick[dim] * BrickSize - 0.5f;
+                const float last =
+                    std::min(brick[dim] * BrickSize + BrickSize,
+                             m_resolution[dim]) +
+                    0.5f;
+                Point lower = m_bounds.min(), upper = m_bounds.max();
+                lower[dim] = std::min(lower[dim],
+                                      std::max(first / m_resolution[dim], 0.f));
+                upper[dim] = std::max(upper[dim],
+                                      std::min(last / m_resolution[dim], 1.f));
+                m_bounds = Bounds(lower, upper);
+            }
+        });
+    }
+
+    /**
+     * @brief Computes the majorant and minorant of every brick from the
+     * voxels that trilinear interpolation within the brick reads, which
+     * includes the voxels of the neighboring bricks that share a border with
+     * it.
+     */
+    void buildMajorants() {
+        for (int dim = 0; dim < 3; dim++) {
+            m_majorantBricks[dim] =
+                (m_resolution[dim] + m_majorantBrickSize - 1) /
+                m_majorantBrickSize;
+        }
+        m_majorants.assign(m_majorantBricks.product(), 0.f);
+
+        forEachBrick([&](const Pointi &brick, int32_t slot) {
+            const float *voxels = m_brickData + size_t(slot) * BrickVoxels;
+            for (int i = 0; i < BrickVoxels; i++) {
+                const float density = voxels[i] * m_multiplier;
+                if (density <= 0)
+                    continue;
+                const Pointi voxel(
+                    brick.x() * BrickSize + i % BrickSize,
+                    brick.y() * BrickSize + i / BrickSize % BrickSize,
+                    brick.z() * BrickSize + i / (BrickSize * BrickSize));
+                // a voxel is read in the brick it lies in, and in the
+                // adjacent bricks if it lies on their border
+                Pointi first, last;
+                for (int dim = 0; dim < 3; dim++) {
+                    first[dim] =
+                        std::max((voxel[dim] - 1) / m_majorantBrickSize, 0);
+                    last[dim] = std::min((voxel[dim] + 1) / m_majorantBrickSize,
+                                         m_majorantBricks[dim] - 1);
+                }
+                for (int bz = first.z(); bz <= last.z(); bz++) {
+                    for (int by = first.y(); by <= last.y(); by++) {
+                        for (int bx = first.x(); bx <= last.x(); bx++) {
+                            float &majorant = m_majorants[majorantIndex(
+                                Pointi(bx, by, bz))];
+                            majorant = std::max(majorant, density);
+                        }
+                    }
+                }
+            }
+        });
+
+        m_minorants.assign(m_majorantBricks.product(), 0.f);
+        for (int bz = 0; bz < m_majorantBricks.z(); bz++) {
+            for (int by = 0; by < m_majorantBricks.y(); by++) {
+                for (int bx = 0; bx < m_majorantBricks.x(); bx++) {
+                    const Pointi brick(bx, by, bz);
+                    if (m_majorants[majorantIndex(brick)] <= 0)
+                        continue;
+                    float minorant = Infinity;
+                    const Pointi first(bx * m_majorantBrickSize - 1,
+                                       by * m_majorantBrickSize - 1,
+                                       bz * m_majorantBrickSize - 1);
+                    const int size = m_majorantBrickSize + 2;
+                    for (int z = 0; z < size && minorant > 0; z++) {
+                        for (int y = 0; y < size; y++) {
+                            for (int x = 0; x < size; x++) {
+                                minorant = std::min(
+                                    minorant,
+                                    D(first + Vector3i(x, y, z)) *
+                                        m_multiplier);
+                            }
+                        }
+                    }
+                    m_minorants[majorantIndex(brick)] =
+                        std::max(minorant, 0.f);
+                }
+            }
+        }
+    }
+
+    int majorantIndex(const Pointi &brick) const {
+        return (brick.z() * m_majorantBricks.y() + brick.y()) *
+                   m_majorantBricks.x() +
+               brick.x();
+    }
+
+    /**
+     * @brief Walks along the ray through all bricks between @c tMin and
+     * @c tMax in order, and calls @c visit with the @ref VolumeSegment within
+     * each brick until it returns false.
+     */
+    template <typename Visit>
+    void traverse(const Ray &ray, float tMin, float tMax,
+                  Visit &&visit) const {
+        Pointi brick;
+        Vector tNext, tDelta;
+        Vector3i step;
+        const Point start = ray(tMin);
+        for (int dim = 0; dim < 3; dim++) {
+            // work in units of bricks, in which each brick has unit size
+            const float scale =
+                float(m_resolution[dim]) / m_majorantBrickSize;
+            const float position  = start[dim] * scale;
+            const float direction = ray.direction[dim] * scale;
+            brick[dim]            = clamp(
+                int(std::floor(position)), 0, m_majorantBricks[dim] - 1);
+            if (direction > 0) {
+                step[dim]   = 1;
+                tNext[dim]  = tMin + (brick[dim] + 1 - position) / direction;
+                tDelta[dim] = 1 / direction;
+            } else if (direction < 0) {
+                step[dim]   = -1;
+                tNext[dim]  = tMin + (brick[dim] - position) / direction;
+                tDelta[dim] = -1 / direction;
+            } else {
+                step[dim]   = 0;
+                tNext[dim]  = Infinity;
+                tDelta[dim] = Infinity;
+            }
+        }
+
+        float t = tMin;
+        while (true) {
+            const int axis = tNext.x() < tNext.y()
+                                 ? (tNext.x() < tNext.z() ? 0 : 2)
+                                 : (tNext.y() < tNext.z() ? 1 : 2);
+            const float tExit = std::min(tNext[axis], tMax);
+            const int index = majorantIndex(brick);
+            if (!visit(VolumeSegment{ t,
+                                      tExit,
+                                      m_majorants[index] * m_sigma_t,
+                                      m_minorants[index] * m_sigma_t }))
+                return;
+            if (tExit >= tMax)
+                return;
+            t = tExit;
+            brick[axis] += step[axis];
+            if (brick[axis] < 0 || brick[axis] >= m_majorantBricks[axis])
+                return;
+            tNext[axis] += tDelta[axis];
+        }
+    }
 
 public:
-    GridVolume(const Properties &properties) {
+    GridVolume(const Properties &properties)
+        : m_estimator(properties,
+                      TransmittanceEstimator::Mode::Ratio,
+                      properties.get<float>("sigma_t", 1.f)) {
         m_multiplier = properties.get<float>("multiplier", 1.0f);
         m_sigma_t = properties.get<float>("sigma_t", 1.f);
 
         auto path = properties.get<std::filesystem::path>("filename");
-        std::ifstream input(path, std::ios::binary);
-        if (!input.is_open()) {
+        std::error_code error;
+        const uint64_t sourceSize = std::filesystem::file_size(path, error);
+        if (error) {
             lightwave_throw("Error opening volume file: %s", path.string());
         }
+        const int64_t sourceTime = std::filesystem::last_write_time(path, error)
+                                       .time_since_epoch()
+                                       .count();
 
-        float fx, fy, fz;
-        input.read(reinterpret_cast<char*>(&fx), sizeof(float));
-        input.read(reinterpret_cast<char*>(&fy), sizeof(float));
-        input.read(reinterpret_cast<char*>(&fz), sizeof(float));
-        m_resolution = Vector3i((int)fx, (int)fy, (int)fz);
-
-        int voxelCount = m_resolution.product();
-        m_density.resize(voxelCount);
-        m_maxDensity = 0;
-        for (int i = 0; i < voxelCount; i++) {
-            float v;
-            input.read(reinterpret_cast<char*>(&v), sizeof(float));
-            m_density[i] = v * m_multiplier;
-            m_maxDensity = std::max(m_maxDensity, m_density[i]);
+        const bool storeBricks = properties.get<bool>("cache", true);
+        const std::filesystem::path brickPath =
+            convertedFilePath(path, ".bricks", defaultCacheDirectory());
+        if (storeBricks)
+            m_file = std::make_unique<MappedFile>(brickPath);
+        if (!m_file ||
+            !open(m_file->data(), m_file->size(), sourceSize, sourceTime)) {
+            logger(EInfo, "converting volume %s to bricks", path.string());
+            m_buffer = convert(path, sourceSize, sourceTime);
+            m_file.reset();
+            const auto write = [&](std::ostream &file) {
+                file.write(reinterpret_cast<const char *>(m_buffer.data()),
+                           m_buffer.size());
+            };
+            if (storeBricks && writeFileAtomically(brickPath, write)) {
+                m_file = std::make_unique<MappedFile>(brickPath);
+                if (open(m_file->data(), m_file->size(), sourceSize,
+                         sourceTime)) {
+                    m_buffer = {};
+                } else {
+                    m_file.reset();
+                }
+            } else if (storeBricks) {
+                logger(EWarn,
+                       "could not write brick file %s, keeping the volume in "
+                       "memory",
+                       brickPath.string());
+            }
+            if (!m_file)
+                open(m_buffer.data(), m_buffer.size(), sourceSize, sourceTime);
         }
-        invMaxDensity = 1.f / m_maxDensity;
+        logger(EInfo,
+               "volume %s: %d of %d bricks occupied (%.1f MiB)",
+               path.filename().string(),
+               m_brickCount,
+               m_bricks.product(),
+               (m_file ? m_file->size() : m_buffer.size()) / 1048576.0);
+
+        computeBounds();
+        // a brick size of 0 uses a single majorant for the whole grid
+        m_majorantBrickSize = properties.get<int>("majorantBrickSize", 8);
+        if (m_majorantBrickSize <= 0)
+            m_majorantBrickSize = std::max(m_resolution.maxComponent(), 1);
+        buildMajorants();
+    }
+
+    ~GridVolume() {
+        m_estimator.report("grid volume");
+        CollisionCounts total;
+        m_collisionCounts.forEach([&](const CollisionCounts &counts) {
+            total.collisions += counts.collisions;
+            total.nullCollisions += counts.nullCollisions;
+        });
+        if (total.collisions == 0)
+            return;
+        logger(EInfo,
+               "grid volume: %.1f%% of %d tentative collisions were null "
+               "(%dx%dx%d majorant bricks)",
+               100.0 * total.nullCollisions / total.collisions,
+               total.collisions,
+               m_majorantBricks.x(),
+               m_majorantBricks.y(),
+               m_majorantBricks.z());
     }
 
     bool intersect(const Ray &ray, Intersection &its,
                    Sampler &rng) const override {
-        const Bounds bound{Point{0.f}, Point{1.f}};
         float t_min, t_max;
-        if (!bound.intersectP(ray, its.t, &t_min, &t_max))
+        if (m_bounds.isEmpty() ||
+            !m_bounds.intersectP(ray, its.t, &t_min, &t_max))
             return false;
-        
-        float t = t_min;
-        while (true) {
-            t -= std::log(1.f - rng.next()) * invMaxDensity / m_sigma_t;
-            if (t >= t_max) break;
-            if (getDensity(ray(t)) * invMaxDensity > rng.next()) {
-                its.t = t;
-                its.position = ray(t);
-                its.shadingNormal = -ray.direction; 
-                its.geometryNormal = -ray.direction;
-                its.tangent = Frame(its.shadingNormal).tangent;
-
-                return true;
+
+        // the optical depth (with respect to the majorants) that remains until
+        // the next tentative collision
+        float tau = -std::log(1.f - rng.next());
+        float tHit = Infinity;
+        uint64_t collisions = 0, nullCollisions = 0;
+        traverse(ray, t_min, t_max, [&](const VolumeSegment &segment) {
+            const float sigma = segment.majorant;
+            float t           = segment.tMin;
+            while (sigma > 0) {
+                if (tau >= sigma * (segment.tMax - t)) {
+                    tau -= sigma * (segment.tMax - t);
+                    return true;
+                }
+                t += tau / sigma;
+                collisions++;
+                if (getDensity(ray(t)) * m_sigma_t > sigma * rng.next()) {
+                    tHit = t;
+                    return false;
+                }
+                nullCollisions++;
+                tau = -std::log(1.f - rng.next());
             }
-        }
-        return false;
+            return true;
+        });
+        CollisionCounts &counts = m_collisionCounts.local();
+        counts.collisions += collisions;
+        counts.nullCollisions += nullCollisions;
+
+        if (tHit == Infinity)
+            return false;
+        its.t = tHit;
+        its.position = ray(tHit);
+        its.shadingNormal = -ray.direction;
+        its.geometryNormal = -ray.direction;
+        its.tangent = Frame(its.shadingNormal).tangent;
+        return true;
     }
 
     float transmittance(const Ray &ray, float tMax,
                         Sampler &rng) const override {
-        const Bounds bound{Point{0.f}, Point{1.f}};
         float t_min, t_max;
-        if (!bound.intersectP(ray, tMax, &t_min, &t_max))
+        if (m_bounds.isEmpty() ||
+            !m_bounds.intersectP(ray, tMax, &t_min, &t_max))
             return 1.f;
-        
-        float Tr = 1.f, t = t_min;
-        while (true) {
-            t -= std::log(1.f - rng.next()) * invMaxDensity / m_sigma_t;
-            if (t >= t_max) break;
-            float density = getDensity(ray(t));
-            Tr *= 1.f - std::max(0.f, density * invMaxDensity);
-
-            if (Tr < 0.1f) {
-                float q = std::max(0.05f, 1.f - Tr);
-                if (rng.next() < q) return 0;
-                Tr /= 1 - q;
-            }
-        }
-        return std::clamp(Tr, 0.f, 1.f);
+
+        return m_estimator.estimate(
+            [&](auto &&visit) { traverse(ray, t_min, t_max, visit); },
+            [&](float t) { return getDensity(ray(t)) * m_sigma_t; },
+            rng);
     }
-    
+
     Bounds getBoundingBox() const override {
-        return Bounds::full();
+        return m_bounds;
     }
 
     Point getCentroid() const override {
-        return Point{ 0.f };
+        return m_bounds.isEmpty() ? Point{ 0.5f } : m_bounds.center();
     }
 
     std::string toString() const override { return "GridVolume[]"; }
@@ -102,16 +552,32 @@ private:
         return (1 - t) * v1 + t * v2;
     }
 
-    bool insideExclusive(const Pointi &p, const Boundsi &b) const {
-        return (p.x() >= b.min().x() && p.x() < b.max().x() &&
-                p.y() >= b.min().y() && p.y() < b.max().y() &&
-                p.z() >= b.min().z() && p.z() < b.max().z());
+    /// @brief Returns the voxels of the brick that contains a voxel, or
+    /// nullptr if the voxel lies outside of the grid or in an empty brick.
+    const float *brickOf(const Pointi &p) const {
+        if (p.x() < 0 || p.y() < 0 || p.z() < 0)
+            return nullptr;
+        const Pointi brick(
+            p.x() / BrickSize, p.y() / BrickSize, p.z() / BrickSize);
+        if (brick.x() >= m_bricks.x() || brick.y() >= m_bricks.y() ||
+            brick.z() >= m_bricks.z())
+            return nullptr;
+        const int32_t slot =
+            m_index[(brick.z() * m_bricks.y() + brick.y()) * m_bricks.x() +
+                    brick.x()];
+        return slot < 0 ? nullptr : m_brickData + size_t(slot) * BrickVoxels;
+    }
+
+    /// @brief The offset of a voxel within its brick.
+    static int voxelOffset(const Pointi &p) {
+        return ((p.z() % BrickSize) * BrickSize + p.y() % BrickSize) *
+                   BrickSize +
+               p.x() % BrickSize;
     }
 
     float D(const Pointi &p) const {
-        Boundsi sampleBounds(Pointi{0}, Pointi(m_resolution));
-        if (!insideExclusive(p, sampleBounds)) return 0;
-        return m_density[(p.z() * m_resolution.y() + p.y()) * m_resolution.x() + p.x()];
+        const float *voxels = brickOf(p);
+        return voxels ? voxels[voxelOffset(p)] : 0;
     }
 
     float getDensity(const Point &p) const {
@@ -119,17 +585,36 @@ private:
         Pointi pi((int)floor(pSamples.x()), (int)floor(pSamples.y()), (int)floor(pSamples.z()));
         Vector d = pSamples - Point((float)pi.x(), (float)pi.y(), (float)pi.z());
 
-        float d00 = lerp(d.x(), D(pi), D(pi + Vector3i(1, 0, 0)));
-        float d10 = lerp(d.x(), D(pi + Vector3i(0, 1, 0)), D(pi + Vector3i(1, 1, 0)));
-        float d01 = lerp(d.x(), D(pi + Vector3i(0, 0, 1)), D(pi + Vector3i(1, 0, 1)));
-        float d11 = lerp(d.x(), D(pi + Vector3i(0, 1, 1)), D(pi + Vector3i(1, 1, 1)));
+        std::array<float, 8> c;
+        const float *voxels = brickOf(pi);
+        const bool isInterior = pi.x() >= 0 && pi.y() >= 0 && pi.z() >= 0 &&
+                                pi.x() % BrickSize < BrickSize - 1 &&
+                                pi.y() % BrickSize < BrickSize - 1 &&
+                                pi.z() % BrickSize < BrickSize - 1;
+        if (isInterior) {
+            // all eight voxels lie in the same brick, which is the common case
+            if (!voxels)
+                return 0;
+            const float *v = voxels + voxelOffset(pi);
+            constexpr int Y = BrickSize, Z = BrickSize * BrickSize;
+            c = { v[0], v[1], v[Y], v[Y + 1],
+                  v[Z], v[Z + 1], v[Z + Y], v[Z + Y + 1] };
+        } else {
+            for (int i = 0; i < 8; i++)
+                c[i] = D(pi + Vector3i(i & 1, (i >> 1) & 1, i >> 2));
+        }
+
+        float d00 = lerp(d.x(), c[0], c[1]);
+        float d10 = lerp(d.x(), c[2], c[3]);
+        float d01 = lerp(d.x(), c[4], c[5]);
+        float d11 = lerp(d.x(), c[6], c[7]);
         float d0 = lerp(d.y(), d00, d10);
         float d1 = lerp(d.y(), d01, d11);
 
-        return lerp(d.z(), d0, d1);
+        return lerp(d.z(), d0, d1) * m_multiplier;
     }
 };
 
 } // namespace lightwave
 
-REGISTER_SHAPE(GridVolume, "grid")
\ No newline at end of file
+REGISTER_SHAPE(GridVolume, "grid")
@@ -11,7 +11,9 @@ namespace lightwave {
  * provides noticeable speed-up by using an acceleration structure under the
  * hood.
  */
-class Group final : public AccelerationStructure {
+class Group final : public InlineAccelerationStructure<Group> {
+    friend class InlineAccelerationStructure<Group>;
+
     std::vector<ref<Shape>> m_children;
 
 protected:
@@ -19,7 +21,14 @@ protected:
 
     bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
                    Sampler &rng) const override {
-        return m_children[primitiveIndex]->intersect(ray, its, rng);
+        // children that compute their surface information right away must not
+        // leave a hit deferred by a previous child behind
+        const auto previousDeferred = its.deferred;
+        its.deferred.shape          = nullptr;
+        if (m_children[primitiveIndex]->intersect(ray, its, rng))
+            return true;
+        its.deferred = previousDeferred;
+        return false;
     }
 
     float transmittance(int primitiveIndex, const Ray &ray, float tMax,
@@ -27,6 +36,11 @@ protected:
         return m_children[primitiveIndex]->transmittance(ray, tMax, rng);
     }
 
+    bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                  Sampler &rng) const override {
+        return m_children[primitiveIndex]->occluded(ray, tMax, rng);
+    }
+
     Bounds getBoundingBox(int primitiveIndex) const override {
         return m_children[primitiveIndex]->getBoundingBox();
     }
@@ -38,7 +52,11 @@ protected:
 public:
     Group(const Properties &properties) {
         m_children = properties.getChildren<Shape>();
-        buildAccelerationStructure();
+        BvhSettings settings;
+        settings.layout = getBvhLayout(properties);
+        settings.refitThreshold =
+            properties.get<float>("refitThreshold", settings.refitThreshold);
+        buildAccelerationStructure(settings);
     }
 
     void markAsVisible() override {
@@ -11,7 +11,9 @@ namespace lightwave {
  * needed (and would pose an excessive amount of overhead), collections of
  * triangles are combined in a single shape.
  */
-class TriangleMesh : public AccelerationStructure {
+class TriangleMesh final : public InlineAccelerationStructure<TriangleMesh> {
+    friend class InlineAccelerationStructure<TriangleMesh>;
+
     /**
      * @brief The index buffer of the triangles.
      * The n-th element corresponds to the n-th triangle, and each component of
@@ -33,30 +35,58 @@ class TriangleMesh : public AccelerationStructure {
     /// geometric normal instead.
     bool m_smoothNormals;
 
-protected:
-    int numberOfPrimitives() const override { return int(m_triangles.size()); }
+    /// @brief The number of triangles that are tested for intersection at
+    /// once.
+    static constexpr int PacketWidth = 4;
 
-    bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
-                   Sampler &rng) const override {
-        // hints:
-        // * use m_triangles[primitiveIndex] to get the vertex indices of the
-        // triangle that should be intersected
-        // * if m_smoothNormals is true, interpolate the vertex normals from
-        // m_vertices
-        //   * make sure that your shading frame stays orthonormal!
-        // * if m_smoothNormals is false, use the geometrical normal (can be
-        // computed from the vertex positions)
+    /**
+     * @brief The data needed to intersect up to @c PacketWidth triangles at
+     * once, in SoA layout. Unlike m_vertices, this holds no normals or texture
+     * coordinates, which are only read for the closest hit of each leaf.
+     * Unused lanes have degenerate edges, and hence are never hit.
+     */
+    struct alignas(16) TrianglePacket {
+        /// @brief The first vertex of each triangle, indexed by
+        /// @code [axis][lane] @endcode .
+        float v0[3][PacketWidth];
+        /// @brief The edge from the first to the second vertex.
+        float e1[3][PacketWidth];
+        /// @brief The edge from the first to the third vertex.
+        float e2[3][PacketWidth];
+        /// @brief The index of each triangle in m_triangles.
+        int primitiveIndex[PacketWidth];
+    };
+
+    /**
+     * @brief The triangles of all BVH leaves. Leaves start at multiples of
+     * @c PacketWidth in the primitive indices of the BVH, hence the packets of
+     * a leaf starting at index @c first begin at @code first / PacketWidth
+     * @endcode .
+     */
+    std::vector<TrianglePacket> m_packets;
+
+    /**
+     * @brief Intersects a single triangle with a ray, without computing any
+     * surface information.
+     * @param out t The intersection distance, if the triangle is hit.
+     * @param out uv The barycentric coordinates of the hit point with respect
+     * to the second and third vertex, if the triangle is hit.
+     * @return Whether the triangle is hit at a distance between Epsilon and
+     * tMax.
+     */
+    bool intersectTriangle(int primitiveIndex, const Ray &ray, float tMax,
+                           float &t, Vector2 &uv) const {
         Vector d = ray.direction;
         Point o = ray.origin;
         Vector3i vert_indices = m_triangles[primitiveIndex];
 
-        Vertex v0 = m_vertices[vert_indices[0]];
-        Vertex v1 = m_vertices[vert_indices[1]];
-        Vertex v2 = m_vertices[vert_indices[2]];
+        const Point &p0 = m_vertices[vert_indices[0]].position;
+        const Point &p1 = m_vertices[vert_indices[1]].position;
+        const Point &p2 = m_vertices[vert_indices[2]].position;
 
         // (1 - u - v)* v0 + u * v1+ v * v2 = o + td
-        Vector e1 = v1.position - v0.position;
-        Vector e2 = v2.position - v0.position;
+        Vector e1 = p1 - p0;
+        Vector e2 = p2 - p0;
 
         float detM = e1.dot(d.cross(e2));
 
@@ -64,7 +94,7 @@ protected:
             return false;
         float invDetM = 1.f / detM;
 
-        Vector e_ori = o - v0.position;
+        Vector e_ori = o - p0;
         float detMu  = e_ori.dot(d.cross(e2));
         float u = detMu * invDetM;
         if (u < 0 || u > 1)
@@ -75,32 +105,197 @@ protected:
         if (v < 0 || u + v > 1)
             return false;
 
-        float t = e2.dot(e_ori.cross(e1)) * invDetM;
+        t = e2.dot(e_ori.cross(e1)) * invDetM;
 
-        if (t < Epsilon || t > its.t)
+        if (t < Epsilon || t > tMax)
             return false;
 
-        its.t = t;
-        its.position = ray(t);
+        uv = Vector2(u, v);
+        return true;
+    }
 
-        Vertex v_interp = Vertex::interpolate(Vector2(u, v), v0, v1, v2);
-        its.uv = v_interp.uv;
-        its.geometryNormal = e1.cross(e2).normalized();
-        if (m_smoothNormals) {
-            its.shadingNormal = v_interp.normal.normalized();
-        } else {
-            its.shadingNormal = its.geometryNormal;
+    /**
+     * @brief Intersects all triangles of a packet with a ray at once, without
+     * computing any surface information. The math is identical to
+     * intersectTriangle.
+     * @param out t The intersection distance of each lane.
+     * @param out u The first barycentric coordinate of each lane.
+     * @param out v The second barycentric coordinate of each lane.
+     * @return A bitmask of the lanes that are hit at a distance between
+     * Epsilon and tMax.
+     */
+    static int intersectPacket(const TrianglePacket &packet, const Ray &ray,
+                               float tMax, float *t, float *u, float *v) {
+#ifdef LW_CPU_X86
+        const __m128 dx = _mm_set1_ps(ray.direction.x());
+        const __m128 dy = _mm_set1_ps(ray.direction.y());
+        const __m128 dz = _mm_set1_ps(ray.direction.z());
+        const __m128 e1x = _mm_load_ps(packet.e1[0]);
+        const __m128 e1y = _mm_load_ps(packet.e1[1]);
+        const __m128 e1z = _mm_load_ps(packet.e1[2]);
+        const __m128 e2x = _mm_load_ps(packet.e2[0]);
+        const __m128 e2y = _mm_load_ps(packet.e2[1]);
+        const __m128 e2z = _mm_load_ps(packet.e2[2]);
+
+        // p = d x e2
+        const __m128 px =
+            _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        const __m128 py =
+            _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        const __m128 pz =
+            _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        const __m128 det = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+            _mm_mul_ps(e1z, pz));
+        const __m128 invDet = _mm_div_ps(_mm_set1_ps(1), det);
+
+        // s = o - v0
+        const __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x()),
+                                     _mm_load_ps(packet.v0[0]));
+        const __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y()),
+                                     _mm_load_ps(packet.v0[1]));
+        const __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z()),
+                                     _mm_load_ps(packet.v0[2]));
+        const __m128 lanesU = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)),
+                       _mm_mul_ps(sz, pz)),
+            invDet);
+
+        // q = s x e1
+        const __m128 qx =
+            _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        const __m128 qy =
+            _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        const __m128 qz =
+            _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        const __m128 lanesV = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+                       _mm_mul_ps(dz, qz)),
+            invDet);
+        const __m128 lanesT = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                       _mm_mul_ps(e2z, qz)),
+            invDet);
+
+        // all comparisons are false for NaN lanes (e.g., degenerate ones)
+        const __m128 zero  = _mm_setzero_ps();
+        const __m128 one   = _mm_set1_ps(1);
+        const __m128 absDet =
+            _mm_andnot_ps(_mm_set1_ps(-0.f), det);
+        __m128 hit = _mm_cmpge_ps(absDet, _mm_set1_ps(1e-8f));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(lanesU, zero));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(lanesU, one));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(lanesV, zero));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(lanesU, lanesV), one));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(lanesT, _mm_set1_ps(Epsilon)));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(lanesT, _mm_set1_ps(tMax)));
+
+        _mm_storeu_ps(t, lanesT);
+        _mm_storeu_ps(u, lanesU);
+        _mm_storeu_ps(v, lanesV);
+        return _mm_movemask_ps(hit);
+#else
+        int hits = 0;
+        for (int lane = 0; lane < PacketWidth; lane++) {
+            const Vector d = ray.direction;
+            const Vector e1{ packet.e1[0][lane],
+                             packet.e1[1][lane],
+                             packet.e1[2][lane] };
+            const Vector e2{ packet.e2[0][lane],
+                             packet.e2[1][lane],
+                             packet.e2[2][lane] };
+            const Vector s = ray.origin - Point{ packet.v0[0][lane],
+                                                 packet.v0[1][lane],
+                                                 packet.v0[2][lane] };
+            const Vector p     = d.cross(e2);
+            const float det    = e1.dot(p);
+            const float invDet = 1.f / det;
+            const Vector q     = s.cross(e1);
+            u[lane]            = s.dot(p) * invDet;
+            v[lane]            = d.dot(q) * invDet;
+            t[lane]            = e2.dot(q) * invDet;
+            if (abs(det) >= 1e-8f && u[lane] >= 0 && u[lane] <= 1 &&
+                v[lane] >= 0 && u[lane] + v[lane] <= 1 &&
+                t[lane] >= Epsilon && t[lane] <= tMax)
+                hits |= 1 << lane;
         }
-        its.tangent = Frame(its.shadingNormal).tangent;
-        its.pdf = 2.f / (e1.cross(e2)).length();
-        
+        return hits;
+#endif
+    }
+
+    /**
+     * @brief Finds the closest triangle of a BVH leaf that is hit by a ray,
+     * testing @c PacketWidth triangles at once.
+     * @param first The first index of the leaf in the primitive indices of
+     * the BVH, which is a multiple of @c PacketWidth .
+     * @param out primitiveIndex The index of the closest triangle that is hit.
+     * @param out t The intersection distance of that triangle.
+     * @param out uv The barycentric coordinates of the hit point.
+     * @return Whether any triangle is hit at a distance between Epsilon and
+     * tMax.
+     */
+    bool intersectLeaf(int first, int count, const Ray &ray, float tMax,
+                       int &primitiveIndex, float &t, Vector2 &uv) const {
+        bool wasIntersected = false;
+        const int begin     = first / PacketWidth;
+        const int end       = (first + count + PacketWidth - 1) / PacketWidth;
+        for (int i = begin; i < end; i++) {
+            const TrianglePacket &packet = m_packets[i];
+            float laneT[PacketWidth], laneU[PacketWidth], laneV[PacketWidth];
+            int hits =
+                intersectPacket(packet, ray, tMax, laneT, laneU, laneV);
+            while (hits) {
+                const int lane = std::countr_zero(unsigned(hits));
+                hits &= hits - 1;
+                if (laneT[lane] > tMax)
+                    continue;
+                tMax           = laneT[lane];
+                t              = laneT[lane];
+                uv             = Vector2(laneU[lane], laneV[lane]);
+                primitiveIndex = packet.primitiveIndex[lane];
+                wasIntersected = true;
+            }
+        }
+        return wasIntersected;
+    }
+
+    /**
+     * @brief Records a hit of the given triangle, whose surface information
+     * is only computed once traversal has found the closest hit (see @ref
+     * computeSurface ).
+     */
+    void recordHit(int primitiveIndex, float t, const Vector2 &uv,
+                   Intersection &its) const {
+        its.t                       = t;
+        its.deferred.shape          = this;
+        its.deferred.primitiveIndex = primitiveIndex;
+        its.deferred.barycentrics   = uv;
+        its.deferred.t              = t;
+    }
+
+protected:
+    int numberOfPrimitives() const override { return int(m_triangles.size()); }
+
+    bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        float t;
+        Vector2 uv;
+        if (!intersectTriangle(primitiveIndex, ray, its.t, t, uv))
+            return false;
+        recordHit(primitiveIndex, t, uv, its);
         return true;
     }
 
+    bool occluded(int primitiveIndex, const Ray &ray, float tMax,
+                  Sampler &rng) const override {
+        float t;
+        Vector2 uv;
+        return intersectTriangle(primitiveIndex, ray, tMax, t, uv);
+    }
+
     float transmittance(int primitiveIndex, const Ray &ray, float tMax,
                         Sampler &rng) const override {
-        Intersection its(-ray.direction, tMax);
-        return intersect(ray, its, rng) ? 0.f : 1.f;
+        return occluded(primitiveIndex, ray, tMax, rng) ? 0.f : 1.f;
     }
 
     Bounds getBoundingBox(int primitiveIndex) const override {
@@ -113,12 +308,70 @@ protected:
         return bounds;
     }
 
+    void splitBoundingBox(int primitiveIndex, int axis, float position,
+                          Bounds &left, Bounds &right) const override {
+        left  = Bounds::empty();
+        right = Bounds::empty();
+        const Vector3i &tri = m_triangles[primitiveIndex];
+        for (int i = 0; i < 3; i++) {
+            const Point &a = m_vertices[tri[i]].position;
+            const Point &b = m_vertices[tri[(i + 1) % 3]].position;
+            if (a[axis] <= position)
+                left.extend(a);
+            if (a[axis] >= position)
+                right.extend(a);
+
+            // edges that cross the plane contribute their intersection point
+            // to both sides
+            if ((a[axis] < position && b[axis] > position) ||
+                (a[axis] > position && b[axis] < position)) {
+                const float t = (position - a[axis]) / (b[axis] - a[axis]);
+                Point p       = a + t * (b - a);
+                p[axis]       = position;
+                left.extend(p);
+                right.extend(p);
+            }
+        }
+    }
+
     Point getCentroid(int primitiveIndex) const override {
         Vector psum(0.f);
         for (int i = 0; i < 3; i++) psum = psum + (Vector)m_vertices[m_triangles[primitiveIndex][i]].position;
         return (1.f / 3.f) * psum;
     }
 
+    std::optional<uint64_t> contentHash() const override {
+        hash::fnv1a hash;
+        hash.update(m_triangles.data(), m_triangles.size() * sizeof(Vector3i));
+        // the BVH does not depend on normals or texture coordinates
+        for (const Vertex &vertex : m_vertices)
+            hash.update(&vertex.position, sizeof(vertex.position));
+        return hash;
+    }
+
+    /// @brief Lays out the triangles of all BVH leaves in packets.
+    void buildFinished() override {
+        const std::vector<int> &indices = primitiveIndices();
+        m_packets.assign(indices.size() / PacketWidth, TrianglePacket{});
+        for (size_t i = 0; i < indices.size(); i++) {
+            TrianglePacket &packet = m_packets[i / PacketWidth];
+            const int lane         = int(i % PacketWidth);
+            packet.primitiveIndex[lane] = indices[i];
+            if (indices[i] < 0)
+                continue; // padding, whose edges stay degenerate
+
+            const Vector3i &tri = m_triangles[indices[i]];
+            const Point &p0     = m_vertices[tri[0]].position;
+            const Vector e1     = m_vertices[tri[1]].position - p0;
+            const Vector e2     = m_vertices[tri[2]].position - p0;
+            for (int axis = 0; axis < 3; axis++) {
+                packet.v0[axis][lane] = p0[axis];
+                packet.e1[axis][lane] = e1[axis];
+                packet.e2[axis][lane] = e2[axis];
+            }
+        }
+    }
+
 public:
     TriangleMesh(const Properties &properties) {
         m_originalPath  = properties.get<std::filesystem::path>("filename");
@@ -128,13 +381,84 @@ public:
                "loaded ply with %d triangles, %d vertices",
                m_triangles.size(),
                m_vertices.size());
-        buildAccelerationStructure();
+        BvhSettings settings   = getBvhSettings(properties);
+        settings.leafAlignment = PacketWidth;
+        buildAccelerationStructure(settings);
     }
 
     bool intersect(const Ray &ray, Intersection &its,
                    Sampler &rng) const override {
         PROFILE("Triangle mesh")
-        return AccelerationStructure::intersect(ray, its, rng);
+        return intersectLeaves(ray, its, [&](int first, int count) {
+            int primitiveIndex;
+            float t;
+            Vector2 uv;
+            if (!intersectLeaf(first, count, ray, its.t, primitiveIndex, t, uv))
+                return false;
+            recordHit(primitiveIndex, t, uv, its);
+            return true;
+        });
+    }
+
+    bool occluded(const Ray &ray, float tMax, Sampler &rng) const override {
+        PROFILE("Triangle mesh occlusion")
+        return occludedLeaves(ray, tMax, [&](int first, int count) {
+            int primitiveIndex;
+            float t;
+            Vector2 uv;
+            return intersectLeaf(first, count, ray, tMax, primitiveIndex, t, uv);
+        });
+    }
+
+    float transmittance(const Ray &ray, float tMax,
+                        Sampler &rng) const override {
+        return occluded(ray, tMax, rng) ? 0.f : 1.f;
+    }
+
+    void computeSurface(const Ray &ray, Intersection &its) const override {
+        // hints:
+        // * use m_triangles[primitiveIndex] to get the vertex indices of the
+        // triangle that should be intersected
+        // * if m_smoothNormals is true, interpolate the vertex normals from
+        // m_vertices
+        //   * make sure that your shading frame stays orthonormal!
+        // * if m_smoothNormals is false, use the geometrical normal (can be
+        // computed from the vertex positions)
+        const Vector2 &uv     = its.deferred.barycentrics;
+        Vector3i vert_indices = m_triangles[its.deferred.primitiveIndex];
+
+        Vertex v0 = m_vertices[vert_indices[0]];
+        Vertex v1 = m_vertices[vert_indices[1]];
+        Vertex v2 = m_vertices[vert_indices[2]];
+
+        Vector e1 = v1.position - v0.position;
+        Vector e2 = v2.position - v0.position;
+
+        its.position = ray(its.deferred.t);
+
+        Vertex v_interp = Vertex::interpolate(uv, v0, v1, v2);
+        its.uv = v_interp.uv;
+        its.geometryNormal = e1.cross(e2).normalized();
+        if (m_smoothNormals) {
+            its.shadingNormal = v_interp.normal.normalized();
+        } else {
+            its.shadingNormal = its.geometryNormal;
+        }
+        its.tangent = Frame(its.shadingNormal).tangent;
+        its.pdf = 2.f / (e1.cross(e2)).length();
+
+        // derivatives of the position with respect to the texture
+        // coordinates, which are constant across the triangle
+        const Vector2 duv1 = v1.uv - v0.uv;
+        const Vector2 duv2 = v2.uv - v0.uv;
+        const float det    = duv1.x() * duv2.y() - duv1.y() * duv2.x();
+        if (abs(det) > 1e-9f) {
+            const float invDet = 1 / det;
+            its.dpdu = (duv2.y() * e1 - duv1.y() * e2) * invDet;
+            its.dpdv = (duv1.x() * e2 - duv2.x() * e1) * invDet;
+        } else {
+            its.dpdu = its.dpdv = Vector(0);
+        }
     }
 
     AreaSample sampleArea(Sampler &rng) const override{
@@ -172,6 +496,45 @@ public:
         return sample;
     }
 
+    float getSurfaceArea() const override {
+        float area = 0;
+        for (const Vector3i &tri : m_triangles) {
+            const Point &p0 = m_vertices[tri[0]].position;
+            area += (m_vertices[tri[1]].position - p0)
+                        .cross(m_vertices[tri[2]].position - p0)
+                        .length() /
+                    2;
+        }
+        return area;
+    }
+
+    std::optional<Vector> getPlanarNormal() const override {
+        // all triangles, and with smooth normals also all of their vertex
+        // normals, need to agree on the same direction
+        std::optional<Vector> normal;
+        const auto agrees = [&](const Vector &n) {
+            if (!normal)
+                normal = n;
+            return normal->dot(n) >= 1 - 1e-5f;
+        };
+        for (const Vector3i &tri : m_triangles) {
+            const Point &p0 = m_vertices[tri[0]].position;
+            const Vector n  = (m_vertices[tri[1]].position - p0)
+                                 .cross(m_vertices[tri[2]].position - p0);
+            if (n.isZero())
+                continue;
+            if (!agrees(n.normalized()))
+                return std::nullopt;
+            if (!m_smoothNormals)
+                continue;
+            for (int i = 0; i < 3; i++) {
+                if (!agrees(m_vertices[tri[i]].normal.normalized()))
+                    return std::nullopt;
+            }
+        }
+        return normal;
+    }
+
     std::string toString() const override {
         return tfm::format(
             "Mesh[\n"
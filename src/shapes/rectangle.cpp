@@ -23,6 +23,8 @@ class Rectangle : public Shape {
 
         // the tangent always points in positive x direction
         surf.tangent = Vector(1, 0, 0);
+        surf.dpdu    = Vector(2, 0, 0);
+        surf.dpdv    = Vector(0, 2, 0);
         // and accordingly, the normal always points in the positive z direction
         surf.shadingNormal  = Vector(0, 0, 1);
         surf.geometryNormal = Vector(0, 0, 1);
@@ -77,6 +79,12 @@ public:
 
     Point getCentroid() const override { return Point(0); }
 
+    float getSurfaceArea() const override { return 4; }
+
+    std::optional<Vector> getPlanarNormal() const override {
+        return Vector(0, 0, 1);
+    }
+
     AreaSample sampleArea(Sampler &rng) const override {
         Point2 rnd = rng.next2D(); // sample a random point in [0,0]..[1,1]
         Point position{
@@ -19,6 +19,17 @@ class Sphere : public Shape {
         surf.shadingNormal = surf.geometryNormal = n;
 
         surf.uv = sphericalCoordinates(n);
+        // derivatives of the spherical coordinates, which are undefined at
+        // the poles
+        const float sinTheta = sqrt(sqr(n.x()) + sqr(n.z()));
+        if (sinTheta > 1e-6f) {
+            surf.dpdu = 2 * Pi * Vector(n.z(), 0, -n.x());
+            surf.dpdv = Pi * Vector(n.y() * n.x() / sinTheta,
+                                    -sinTheta,
+                                    n.y() * n.z() / sinTheta);
+        } else {
+            surf.dpdu = surf.dpdv = Vector(0);
+        }
 
         surf.pdf = Inv4Pi;
     }
@@ -75,6 +86,8 @@ public:
 
     Point getCentroid() const override { return Point(0.f); }
 
+    float getSurfaceArea() const override { return 4 * Pi; }
+
     AreaSample sampleArea(Sampler &rng) const override{
         // area sampling
         float u = rng.next();
@@ -2,103 +2,95 @@
 
 namespace lightwave {
 
+/**
+ * @brief A homogeneous volume, either within the boundary of another shape or
+ * filling all of space. Transmittance is computed analytically by default
+ * (residual ratio tracking with the density as control), or estimated by any
+ * other @ref TransmittanceEstimator , whose statistics are reported when the
+ * volume is destroyed.
+ */
 class Volume : public Shape {
     float m_density;
     ref<Shape> m_boundary;
+    TransmittanceEstimator m_estimator;
+
+    /**
+     * @brief Finds the segment of the ray within the boundary, but does not
+     * search for where the ray leaves the boundary if it only enters it
+     * beyond @c tMax .
+     * @return Whether the ray enters the volume before @c tMax .
+     */
+    bool clip(const Ray &ray, float tMax, Sampler &rng, float &t_entry,
+              float &t_exit) const {
+        if (!m_boundary) {
+            t_entry = 0;
+            t_exit  = Infinity;
+            return true;
+        }
+
+        Intersection its_entry;
+        if (!m_boundary->intersect(ray, its_entry, rng))
+            return false;
+        its_entry.computeSurface(ray);
+
+        bool is_outside = ray.direction.dot(its_entry.shadingNormal) < 0.f;
+        if (!is_outside) {
+            t_entry = 0;
+            t_exit  = its_entry.t;
+            return true;
+        }
+
+        t_entry = its_entry.t;
+        if (t_entry >= tMax)
+            return false;
+        Ray ray_inside(ray(t_entry), ray.direction);
+        Intersection its_exit;
+        if (!m_boundary->intersect(ray_inside, its_exit, rng))
+            return false;
+        t_exit = t_entry + its_exit.t;
+        return true;
+    }
 
 public:
-    Volume(const Properties &properties) {
+    Volume(const Properties &properties)
+        : m_estimator(properties,
+                      TransmittanceEstimator::Mode::ResidualRatio, 1) {
         m_density  = properties.get<float>("density");
         m_boundary = properties.getOptionalChild<Shape>();
     }
 
+    ~Volume() { m_estimator.report("homogeneous volume"); }
+
     bool intersect(const Ray &ray, Intersection &its,
                    Sampler &rng) const override {
-        if (m_boundary) {
-            Intersection its_entry;
-            if (!m_boundary->intersect(ray, its_entry, rng))
-                return false;
-
-            bool is_outside = ray.direction.dot(its_entry.shadingNormal) < 0.f;
-            float t_entry, t_exit;
-
-            if (is_outside) {
-                t_entry = its_entry.t;
-
-                Ray ray_inside(ray(t_entry), ray.direction);
-                Intersection its_exit;
-                if (m_boundary->intersect(ray_inside, its_exit, rng)) {
-                    t_exit = t_entry + its_exit.t;
-                } else {
-                    return false;
-                }
-            } else {
-                t_entry = 0;
-                t_exit  = its_entry.t;
-            }
-            float t        = Epsilon - log(1.f - rng.next()) / m_density;
-            float t_target = t_entry + t;
-            if (t_target >= t_exit) {
-                return false;
-            }
-            if (t_target < its.t) {
-                its.t              = t_target;
-                its.position       = ray(t_target);
-                its.shadingNormal  = -ray.direction;
-                its.geometryNormal = -ray.direction;
-                its.tangent        = Frame(its.shadingNormal).tangent;
-                return true;
-            }
-
-        } else {
-            float t = Epsilon - log(1.f - rng.next()) / m_density;
-            if (t < its.t) {
-                its.t              = t;
-                its.position       = ray(t);
-                its.shadingNormal  = -ray.direction;
-                its.geometryNormal = -ray.direction;
-                its.tangent        = Frame(its.shadingNormal).tangent;
-                return true;
-            }
-        }
-        return false;
+        float t_entry, t_exit;
+        if (!clip(ray, its.t, rng, t_entry, t_exit))
+            return false;
+
+        float t_target = t_entry + Epsilon - log(1.f - rng.next()) / m_density;
+        if (t_target >= t_exit || t_target >= its.t)
+            return false;
+        its.t              = t_target;
+        its.position       = ray(t_target);
+        its.shadingNormal  = -ray.direction;
+        its.geometryNormal = -ray.direction;
+        its.tangent        = Frame(its.shadingNormal).tangent;
+        return true;
     }
 
     float transmittance(const Ray &ray, float tMax,
                         Sampler &rng) const override {
-        if (m_boundary) {
-            Intersection its_entry;
-            if (!m_boundary->intersect(ray, its_entry, rng))
-                return 1.f;
-
-            bool is_outside = ray.direction.dot(its_entry.shadingNormal) < 0.f;
-            float t_entry, t_exit;
-
-            if (is_outside) {
-                t_entry = its_entry.t;
-
-                Ray ray_inside(ray(t_entry), ray.direction);
-                Intersection its_exit;
-                if (m_boundary->intersect(ray_inside, its_exit, rng)) {
-                    t_exit = t_entry + its_exit.t;
-                } else {
-                    return 1.f;
-                }
-            } else {
-                t_entry = 0.f;
-                t_exit  = its_entry.t;
-            }
-            if (tMax <= t_entry)
-                return 1.f;
-
-            if (t_exit >= tMax)
-                t_exit = tMax;
-
-            return exp(-m_density * (t_exit - t_entry));
-
-        } else {
-            return exp(-m_density * tMax);
-        }
+        float t_entry, t_exit;
+        if (!clip(ray, tMax, rng, t_entry, t_exit))
+            return 1.f;
+
+        const VolumeSegment segment{
+            t_entry, std::min(t_exit, tMax), m_density, m_density
+        };
+        return m_estimator.estimate(
+            [&](auto &&visit) { visit(segment); },
+            [&](float) { return m_density; },
+            rng);
     }
 
     Bounds getBoundingBox() const override {
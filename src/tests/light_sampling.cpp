@@ -0,0 +1,159 @@
+#include <lightwave.hpp>
+
+namespace lightwave {
+
+/**
+ * @brief Measures how fast lights are picked, reporting nanoseconds per call
+ * to @ref Scene::sampleLight and per lookup of the probability of a light
+ * through @ref Scene::lightProbability . Query points are distributed
+ * uniformly within the bounding box of the scene and generated up front.
+ *
+ * To show what light selection costs ray tracing, camera rays are also traced
+ * with @ref Scene::intersect , separately for rays that hit light sources and
+ * rays that hit other surfaces. Each group is timed with and without asking
+ * the intersection for @ref Intersection::lightProbability afterwards, which
+ * integrators only do when they weight light hits with multiple importance
+ * sampling.
+ */
+class LightSamplingBenchmark : public Test {
+    /// @brief The scene whose lights are picked.
+    ref<Scene> m_scene;
+    /// @brief The sampler used to generate query points and to pick lights,
+    /// which also determines how many camera rays per pixel are traced.
+    ref<Sampler> m_sampler;
+    /// @brief How many query points are generated.
+    int m_count;
+    /// @brief How often all queries are run.
+    int m_repetitions;
+
+    /// @brief Times @ref Scene::intersect for camera rays, grouped by whether
+    /// they hit a light source.
+    void measureIntersections() const {
+        const Vector2i resolution = m_scene->camera()->resolution();
+        std::vector<Ray> emissive, nonEmissive;
+        for (auto pixel : Bounds2i(Point2i(0), Point2i(resolution))) {
+            for (int sample = 0; sample < m_sampler->samplesPerPixel();
+                 sample++) {
+                m_sampler->seed(pixel, sample);
+                const Ray ray =
+                    m_scene->camera()->sample(pixel, *m_sampler).ray;
+                const Intersection its = m_scene->intersect(ray, *m_sampler);
+                if (its)
+                    (its.light() ? emissive : nonEmissive).push_back(ray);
+            }
+        }
+
+        float sum = 0;
+        for (const auto &[name, rays] :
+             { std::pair{ "light hits", &emissive },
+               std::pair{ "other hits", &nonEmissive } }) {
+            if (rays->empty())
+                continue;
+
+            const double intersectTime =
+                measureFastest(m_repetitions, rays->size(), [&]() {
+                    for (const Ray &ray : *rays)
+                        sum += m_scene->intersect(ray, *m_sampler).t;
+                });
+            const double probabilityTime =
+                measureFastest(m_repetitions, rays->size(), [&]() {
+                    for (const Ray &ray : *rays) {
+                        sum += m_scene->intersect(ray, *m_sampler)
+                                   .lightProbability();
+                    }
+                });
+            logger(EInfo,
+                   "intersect, %s (%d rays): %.1f ns/ray, %.1f ns/ray with "
+                   "light probability",
+                   name,
+                   rays->size(),
+                   intersectTime,
+                   probabilityTime);
+        }
+        // keeps the compiler from discarding the intersections
+        if (std::isnan(sum))
+            logger(EWarn, "intersections produced NaN");
+    }
+
+public:
+    LightSamplingBenchmark(const Properties &properties) {
+        m_scene       = properties.getChild<Scene>();
+        m_sampler     = properties.getChild<Sampler>();
+        m_count       = properties.get<int>("count", 1 << 20);
+        m_repetitions = properties.get<int>("repetitions", 3);
+    }
+
+    void execute() override {
+        if (!m_scene->hasLights())
+            lightwave_throw("the scene needs to contain lights");
+
+        const Bounds bounds = m_scene->getBoundingBox();
+        std::vector<Point> origins(m_count);
+        m_sampler->seed(0);
+        for (auto &origin : origins) {
+            const Point2 u = m_sampler->next2D();
+            const float v  = m_sampler->next();
+            origin         = bounds.min() + bounds.diagonal() *
+                                        Vector(u.x(), u.y(), v);
+        }
+
+        std::vector<LightSample> samples(m_count);
+        const double sampleTime =
+            measureFastest(m_repetitions, size_t(m_count), [&]() {
+                for (int i = 0; i < m_count; i++)
+                    samples[i] = m_scene->sampleLight(origins[i], *m_sampler);
+            });
+
+        float sum = 0;
+        const double lookupTime =
+            measureFastest(m_repetitions, size_t(m_count), [&]() {
+                sum = 0;
+                for (int i = 0; i < m_count; i++) {
+                    sum += m_scene->lightProbability(origins[i],
+                                                     samples[i].light);
+                }
+            });
+
+        // the lookup needs to agree with the probability reported by sampling
+        int mismatches = 0;
+        for (int i = 0; i < m_count; i++) {
+            const float expected = samples[i].probability;
+            const float actual =
+                m_scene->lightProbability(origins[i], samples[i].light);
+            if (abs(actual - expected) > 1e-4f * expected)
+                mismatches++;
+        }
+        if (mismatches > 0) {
+            logger(EWarn,
+                   "%d probability lookups disagree with sampling",
+                   mismatches);
+        }
+
+        logger(EInfo,
+               "picked lights for %d points (average probability %.4g)",
+               m_count,
+               sum / std::max(m_count, 1));
+        logger(EInfo, "sample: %.1f ns/query", sampleTime);
+        logger(EInfo, "lookup: %.1f ns/query", lookupTime);
+
+        measureIntersections();
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "LightSamplingBenchmark[\n"
+            "  scene = %s,\n"
+            "  sampler = %s,\n"
+            "  count = %d,\n"
+            "  repetitions = %d,\n"
+            "]",
+            indent(m_scene),
+            indent(m_sampler),
+            m_count,
+            m_repetitions);
+    }
+};
+
+} // namespace lightwave
+
+REGISTER_TEST(LightSamplingBenchmark, "light_sampling");
@@ -0,0 +1,84 @@
+#include <lightwave.hpp>
+
+namespace lightwave {
+
+/**
+ * @brief Measures how long sampling integrators take per sample, reporting
+ * nanoseconds per call to @ref SamplingIntegrator::Li for each integrator.
+ *
+ * Camera rays are generated up front from the camera and sampler of each
+ * integrator, so that only the integrators themselves are measured.
+ */
+class SampleCostBenchmark : public Test {
+    /// @brief The integrators to compare.
+    std::vector<ref<SamplingIntegrator>> m_integrators;
+    /// @brief How often all samples are computed.
+    int m_repetitions;
+
+public:
+    SampleCostBenchmark(const Properties &properties) {
+        m_integrators = properties.getChildren<SamplingIntegrator>();
+        m_repetitions = properties.get<int>("repetitions", 3);
+    }
+
+    void execute() override {
+        for (const auto &integrator : m_integrators) {
+            const Scene &scene = *integrator->scene();
+            Sampler &sampler   = *integrator->sampler();
+            const Vector2i resolution = scene.camera()->resolution();
+
+            // the sampler state of each sample is captured along with its ray,
+            // so that every repetition computes exactly the same samples
+            std::vector<std::pair<Ray, ref<Sampler>>> samples;
+            samples.reserve(size_t(resolution.product()) *
+                            sampler.samplesPerPixel());
+            for (auto pixel : Bounds2i(Point2i(0), Point2i(resolution))) {
+                for (int sample = 0; sample < sampler.samplesPerPixel();
+                     sample++) {
+                    auto rng = sampler.clone();
+                    rng->seed(pixel, sample);
+                    const Ray ray = scene.camera()->sample(pixel, *rng).ray;
+                    samples.emplace_back(ray, rng);
+                }
+            }
+
+            // every repetition starts from fresh copies of the sampler states
+            std::vector<ref<Sampler>> rngs;
+            Color sum;
+            const double time = measureFastest(
+                m_repetitions,
+                samples.size(),
+                [&]() {
+                    sum = Color(0);
+                    for (size_t i = 0; i < samples.size(); i++)
+                        sum += integrator->Li(samples[i].first, *rngs[i]);
+                },
+                [&]() {
+                    rngs.clear();
+                    rngs.reserve(samples.size());
+                    for (const auto &sample : samples)
+                        rngs.push_back(sample.second->clone());
+                });
+
+            logger(EInfo,
+                   "%s: %.1f ns/sample (mean luminance %.4f)",
+                   integrator->id().empty() ? "integrator" : integrator->id(),
+                   time,
+                   sum.luminance() / std::max(samples.size(), size_t(1)));
+        }
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "SampleCostBenchmark[\n"
+            "  integrators = %d,\n"
+            "  repetitions = %d,\n"
+            "]",
+            m_integrators.size(),
+            m_repetitions);
+    }
+};
+
+} // namespace lightwave
+
+REGISTER_TEST(SampleCostBenchmark, "sample_cost");
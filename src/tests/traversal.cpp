@@ -0,0 +1,97 @@
+#include <lightwave.hpp>
+
+namespace lightwave {
+
+/**
+ * @brief Measures how fast camera rays are traced through a scene, reporting
+ * nanoseconds per ray for closest hit queries (@ref Scene::intersect ) and for
+ * occlusion queries (@ref Scene::occluded ).
+ *
+ * All rays are generated up front, so that only traversal and intersection
+ * are measured. Rays are traced on a single thread to keep timings comparable
+ * across machines, and timed with @ref measureFastest .
+ */
+class TraversalBenchmark : public Test {
+    /// @brief The scene whose camera generates the rays.
+    ref<Scene> m_scene;
+    /// @brief The sampler that determines how many rays per pixel are traced.
+    ref<Sampler> m_sampler;
+    /// @brief How often all rays are traced.
+    int m_repetitions;
+
+public:
+    TraversalBenchmark(const Properties &properties) {
+        m_scene       = properties.getChild<Scene>();
+        m_sampler     = properties.getChild<Sampler>();
+        m_repetitions = properties.get<int>("repetitions", 3);
+    }
+
+    void execute() override {
+        const Vector2i resolution = m_scene->camera()->resolution();
+        std::vector<Ray> rays;
+        rays.reserve(size_t(resolution.product()) *
+                     m_sampler->samplesPerPixel());
+        for (int y = 0; y < resolution.y(); y++) {
+            for (int x = 0; x < resolution.x(); x++) {
+                const Point2i pixel{ x, y };
+                for (int sample = 0; sample < m_sampler->samplesPerPixel();
+                     sample++) {
+                    m_sampler->seed(pixel, sample);
+                    rays.push_back(
+                        m_scene->camera()->sample(pixel, *m_sampler).ray);
+                }
+            }
+        }
+
+        size_t hits = 0;
+        const double closestHitTime =
+            measureFastest(m_repetitions, rays.size(), [&]() {
+                hits = 0;
+                for (const Ray &ray : rays) {
+                    if (m_scene->intersect(ray, *m_sampler))
+                        hits++;
+                }
+            });
+        size_t occluded = 0;
+        const double occlusionTime =
+            measureFastest(m_repetitions, rays.size(), [&]() {
+                occluded = 0;
+                for (const Ray &ray : rays) {
+                    if (m_scene->occluded(ray, Infinity, *m_sampler))
+                        occluded++;
+                }
+            });
+
+        if (hits != occluded) {
+            // can happen legitimately for stochastic shapes (e.g., volumes)
+            logger(EWarn,
+                   "closest hit and occlusion queries disagree (%d hits, but "
+                   "%d rays occluded)",
+                   hits,
+                   occluded);
+        }
+
+        logger(EInfo,
+               "traced %d rays (%.1f%% hit the scene)",
+               rays.size(),
+               100.0 * hits / std::max(rays.size(), size_t(1)));
+        logger(EInfo, "closest hit: %.1f ns/ray", closestHitTime);
+        logger(EInfo, "occlusion:   %.1f ns/ray", occlusionTime);
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "TraversalBenchmark[\n"
+            "  scene = %s,\n"
+            "  sampler = %s,\n"
+            "  repetitions = %d,\n"
+            "]",
+            indent(m_scene),
+            indent(m_sampler),
+            m_repetitions);
+    }
+};
+
+} // namespace lightwave
+
+REGISTER_TEST(TraversalBenchmark, "traversal");
@@ -14,7 +14,7 @@ public:
         m_color1 = properties.get<Color>("color1", Color(1));
     }
 
-    Color evaluate(const Point2 &uv) const override { 
+    Color evaluate(const TextureCoordinates &uv) const override { 
         int u = int(floor(uv.x() * m_scale.x()));
         int v = int(floor(uv.y() * m_scale.y()));
         if (u % 2 == v % 2)
@@ -10,7 +10,9 @@ public:
         m_value = properties.get<Color>("value");
     }
 
-    Color evaluate(const Point2 &uv) const override { return m_value; }
+    Color evaluate(const TextureCoordinates &uv) const override {
+        return m_value;
+    }
 
     std::string toString() const override {
         return tfm::format(
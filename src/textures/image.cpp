@@ -3,11 +3,6 @@
 namespace lightwave {
 
 ImageTexture::ImageTexture(const Properties &properties) {
-    if (properties.has("filename")) {
-        m_image = std::make_shared<Image>(properties);
-    } else {
-        m_image = properties.getChild<Image>();
-    }
     m_exposure = properties.get<float>("exposure", 1);
 
     // clang-format off
@@ -19,44 +14,173 @@ ImageTexture::ImageTexture(const Properties &properties) {
     m_filter = properties.getEnum<FilterMode>("filter", FilterMode::Bilinear, {
         { "nearest", FilterMode::Nearest },
         { "bilinear", FilterMode::Bilinear },
+        { "trilinear", FilterMode::Trilinear },
+        { "ewa", FilterMode::EWA },
     });
     // clang-format on
+    m_maxAnisotropy = properties.get<float>("maxAnisotropy", 8);
+
+    if (properties.has("filename")) {
+        m_tiles = std::make_unique<TiledImage>(
+            properties.get<std::filesystem::path>("filename"),
+            properties.get<bool>("linear", false),
+            properties.get<bool>("cache", true));
+    } else {
+        m_levels = { properties.getChild<Image>() };
+        if (m_filter == FilterMode::Trilinear || m_filter == FilterMode::EWA)
+            buildPyramid();
+    }
 }
 
-Color ImageTexture::evaluate(const Point2 &uv) const {
-    int w = m_image->resolution().x();
-    int h = m_image->resolution().y();
-    float x = uv.x() * w - 0.5f;
-    float y = (1.f - uv.y()) * h - 0.5f;
-    Color c(0.f);
+void ImageTexture::buildPyramid() {
+    while (m_levels.back()->resolution() != Point2i(1))
+        m_levels.push_back(m_levels.back()->downsample());
+}
+
+Point2i ImageTexture::resolution(int level) const {
+    return m_tiles ? m_tiles->resolution(level)
+                   : m_levels[level]->resolution();
+}
+
+Color ImageTexture::texel(int level, Point2i pixel) const {
+    const Point2i res = resolution(level);
+    const int w       = res.x();
+    const int h       = res.y();
+    if (m_border == BorderMode::Clamp) {
+        pixel.x() = min(max(pixel.x(), 0), w - 1);
+        pixel.y() = min(max(pixel.y(), 0), h - 1);
+    } else if (m_border == BorderMode::Repeat) {
+        pixel.x() = (pixel.x() % w + w) % w; // avoid negative
+        pixel.y() = (pixel.y() % h + h) % h;
+    }
+    return m_tiles ? m_tiles->texel(level, pixel) : (*m_levels[level])(pixel);
+}
 
-    // border handling
-    auto getPixelWithBorder = [&](int x, int y) {
-        if (m_border == BorderMode::Clamp) {
-            x = min(max(x, 0), w - 1);
-            y = min(max(y, 0), h - 1);
-        } else if (m_border == BorderMode::Repeat) {
-            x = (x % w + w) % w; // avoid negative
-            y = (y % h + h) % h;
+Color ImageTexture::bilinear(int level, const Point2 &uv) const {
+    const Point2i res = resolution(level);
+    const float x     = uv.x() * res.x() - 0.5f;
+    const float y     = (1.f - uv.y()) * res.y() - 0.5f;
+    const int x0      = int(floor(x));
+    const int y0      = int(floor(y));
+    const float tx    = x - x0;
+    const float ty    = y - y0;
+
+    const Color t00 = texel(level, Point2i(x0, y0));
+    const Color t10 = texel(level, Point2i(x0 + 1, y0));
+    const Color t01 = texel(level, Point2i(x0, y0 + 1));
+    const Color t11 = texel(level, Point2i(x0 + 1, y0 + 1));
+    const Color t0  = tx * t10 + (1.f - tx) * t00;
+    const Color t1  = tx * t11 + (1.f - tx) * t01;
+    return ty * t1 + (1.f - ty) * t0;
+}
+
+Color ImageTexture::trilinear(const TextureCoordinates &uv) const {
+    // the level at which the larger axis of the footprint spans one pixel
+    const Vector2 res(resolution().cast<float>());
+    const float width = std::max(Vector2(uv.dx * res).length(),
+                                 Vector2(uv.dy * res).length());
+    const float level = std::clamp(
+        std::log2(std::max(width, 1.f)), 0.f, float(levels() - 1));
+    const int lower = std::min(int(level), levels() - 2);
+    if (lower < 0)
+        return bilinear(0, uv);
+    const float t = level - lower;
+    return (1 - t) * bilinear(lower, uv) +
+           t * bilinear(lower + 1, uv);
+}
+
+Color ImageTexture::ewa(const TextureCoordinates &uv) const {
+    const Vector2 res(resolution().cast<float>());
+    Vector2 axis0 = uv.dx;
+    Vector2 axis1 = uv.dy;
+    float majorLength = Vector2(axis0 * res).length();
+    float minorLength = Vector2(axis1 * res).length();
+    if (majorLength < minorLength) {
+        std::swap(axis0, axis1);
+        std::swap(majorLength, minorLength);
+    }
+
+    // widen overly eccentric ellipses, which would otherwise need to filter
+    // too many pixels
+    if (minorLength * m_maxAnisotropy < majorLength && minorLength > 0) {
+        const float scale = majorLength / (minorLength * m_maxAnisotropy);
+        axis1 *= scale;
+        minorLength *= scale;
+    }
+    if (minorLength == 0)
+        return bilinear(0, uv);
+
+    // the level at which the minor axis spans one pixel
+    const float level = std::max(0.f, std::log2(minorLength));
+    const int lower   = int(level);
+    const float t     = level - lower;
+    return (1 - t) * ewa(lower, uv, axis0, axis1) +
+           t * ewa(lower + 1, uv, axis0, axis1);
+}
+
+Color ImageTexture::ewa(int level, const Point2 &uv, const Vector2 &axis0,
+                        const Vector2 &axis1) const {
+    if (level >= levels())
+        return texel(levels() - 1, Point2i(0));
+
+    // the ellipse in pixel coordinates of the level
+    const Vector2 res(resolution(level).cast<float>());
+    const float x     = uv.x() * res.x() - 0.5f;
+    const float y     = (1.f - uv.y()) * res.y() - 0.5f;
+    const Vector2 d0  = Vector2(axis0.x() * res.x(), -axis0.y() * res.y());
+    const Vector2 d1  = Vector2(axis1.x() * res.x(), -axis1.y() * res.y());
+    float A           = sqr(d0.y()) + sqr(d1.y()) + 1;
+    float B           = -2 * (d0.x() * d0.y() + d1.x() * d1.y());
+    float C           = sqr(d0.x()) + sqr(d1.x()) + 1;
+    const float invF  = 1 / (A * C - B * B * 0.25f);
+    A *= invF;
+    B *= invF;
+    C *= invF;
+
+    // the bounding box of the ellipse
+    const float det    = -B * B + 4 * A * C;
+    const float invDet = 1 / det;
+    const float uSqrt  = safe_sqrt(det * C);
+    const float vSqrt  = safe_sqrt(A * det);
+    const int x0       = int(ceil(x - 2 * invDet * uSqrt));
+    const int x1       = int(floor(x + 2 * invDet * uSqrt));
+    const int y0       = int(ceil(y - 2 * invDet * vSqrt));
+    const int y1       = int(floor(y + 2 * invDet * vSqrt));
+
+    // Gaussian weights that fall off to zero at the boundary of the ellipse
+    constexpr float Alpha = 2;
+    const float offset    = std::exp(-Alpha);
+    Color sum(0.f);
+    float sumOfWeights = 0;
+    for (int py = y0; py <= y1; py++) {
+        const float ty = py - y;
+        for (int px = x0; px <= x1; px++) {
+            const float tx = px - x;
+            const float r2 = A * tx * tx + B * tx * ty + C * ty * ty;
+            if (r2 < 1) {
+                const float weight = std::exp(-Alpha * r2) - offset;
+                sum += weight * texel(level, Point2i(px, py));
+                sumOfWeights += weight;
+            }
         }
-        return Point2i(x, y);
-    };
+    }
+    if (sumOfWeights <= 0)
+        return bilinear(level, uv);
+    return sum / sumOfWeights;
+}
 
-    // filtering
+Color ImageTexture::evaluate(const TextureCoordinates &uv) const {
+    Color c(0.f);
     if (m_filter == FilterMode::Nearest) {
-        int x0 = floor(x + 0.5f);
-        int y0 = floor(y + 0.5f);
-        c = m_image->get(getPixelWithBorder(x0, y0));
-    } else if (m_filter == FilterMode::Bilinear) {
-        Color t00 = m_image->get(getPixelWithBorder(floor(x), floor(y)));
-        Color t10 = m_image->get(getPixelWithBorder(ceil(x), floor(y)));
-        Color t01 = m_image->get(getPixelWithBorder(floor(x), ceil(y)));
-        Color t11 = m_image->get(getPixelWithBorder(ceil(x), ceil(y)));
-        float tx = x - floor(x);
-        float ty = y - floor(y);
-        Color t0 = tx * t10 + (1.f - tx) * t00;
-        Color t1 = tx * t11 + (1.f - tx) * t01;
-        c = ty * t1 + (1.f - ty) * t0;
+        const float x = uv.x() * resolution().x() - 0.5f;
+        const float y = (1.f - uv.y()) * resolution().y() - 0.5f;
+        c = texel(0, Point2i(floor(x + 0.5f), floor(y + 0.5f)));
+    } else if (m_filter == FilterMode::Bilinear || !uv.hasFootprint()) {
+        c = bilinear(0, uv);
+    } else if (m_filter == FilterMode::Trilinear) {
+        c = trilinear(uv);
+    } else if (m_filter == FilterMode::EWA) {
+        c = ewa(uv);
     }
 
     return c * m_exposure;
@@ -67,9 +191,11 @@ std::string ImageTexture::toString() const {
         "ImageTexture[\n"
         "  image = %s,\n"
         "  exposure = %f,\n"
+        "  levels = %d,\n"
         "]",
-        indent(m_image),
-        m_exposure);
+        m_tiles ? m_tiles->path().string() : indent(m_levels[0]),
+        m_exposure,
+        levels());
 }
 
 
@@ -0,0 +1,107 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave/camera.hpp>
+#include <lightwave/integrator.hpp>
+#include <lightwave/registry.hpp>
+#include <lightwave/transform.hpp>
+
+#include <atomic>
+#include <filesystem>
+
+namespace lightwave {
+
+/**
+ * @brief Counts the samples that each pixel receives instead of tracing rays.
+ * The left half of the image is noisy while the right half is constant, so
+ * that adaptive sampling gives its tiles different sample counts.
+ */
+class SampleCounter : public SamplingIntegrator {
+    std::vector<std::atomic<int>> m_counts;
+
+public:
+    SampleCounter(const Properties &properties)
+        : SamplingIntegrator(properties),
+          m_counts(m_scene->camera()->resolution().product()) {}
+
+    int count(const Point2i &pixel) const {
+        return m_counts[pixel.y() * m_scene->camera()->resolution().x() +
+                        pixel.x()];
+    }
+
+    void renderBlock(const Range &spps, Sampler &sampler,
+                     BlockSamples &samples) override {
+        const int width = m_scene->camera()->resolution().x();
+        for (auto pixel : samples.block()) {
+            m_counts[pixel.y() * width + pixel.x()] += spps.count();
+            for (auto sample : spps) {
+                sampler.seed(pixel, sample);
+                samples.add(pixel,
+                            Color(pixel.x() < width / 2 ? 2 * sampler.next()
+                                                        : 1.f));
+            }
+        }
+    }
+
+    Color Li(const Ray &ray, Sampler &rng) override { return Color(0); }
+    std::string toString() const override { return "SampleCounter[]"; }
+};
+
+TEST_CASE("Adaptive sampling renders every pixel as often as it reports",
+          "[adaptive]") {
+    constexpr int SamplesPerPixel = 64;
+
+    // 64 pixel blocks that are centered in the image only line up with the
+    // 8 pixel tiles for some of these resolutions
+    const Vector2i resolution =
+        GENERATE(Vector2i(96, 40), Vector2i(100, 36), Vector2i(132, 70));
+    CAPTURE(resolution);
+
+    const auto basePath =
+        std::filesystem::temp_directory_path() / "lightwave-adaptive-test";
+    std::filesystem::create_directories(basePath);
+
+    Properties cameraProperties;
+    cameraProperties.set("width", resolution.x());
+    cameraProperties.set("height", resolution.y());
+    cameraProperties.set("fov", 40.f);
+    cameraProperties.set("fovAxis", std::string("x"));
+    cameraProperties.addChild(std::make_shared<Transform>());
+    Properties sceneProperties;
+    sceneProperties.addChild(
+        Registry::create("camera", "perspective", cameraProperties));
+
+    Properties samplerProperties;
+    samplerProperties.set("count", SamplesPerPixel);
+
+    const auto image        = std::make_shared<Image>();
+    const auto samplesImage = std::make_shared<Image>();
+    image->setId("image");
+    samplesImage->setId("samples");
+    image->setBasePath(basePath);
+    samplesImage->setBasePath(basePath);
+
+    Properties properties;
+    properties.addChild(
+        Registry::create("sampler", "independent", samplerProperties));
+    properties.addChild(image);
+    properties.addChild(Registry::create("scene", "default", sceneProperties));
+    properties.set("adaptive", true);
+    properties.set("samples", samplesImage);
+
+    SampleCounter integrator{ properties };
+    integrator.execute();
+
+    long total = 0;
+    float noisy = 0, constant = 0;
+    for (auto pixel : Bounds2i(Point2i(0), resolution)) {
+        const int count = integrator.count(pixel);
+        REQUIRE(count == int(samplesImage->get(pixel).r()));
+        total += count;
+        (pixel.x() < resolution.x() / 2 ? noisy : constant) += count;
+    }
+    CHECK(total <= resolution.product() * long(SamplesPerPixel));
+    CHECK(noisy > 2 * constant);
+
+    std::filesystem::remove_all(basePath);
+}
+
+} // namespace lightwave
@@ -0,0 +1,35 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave/distribution.hpp>
+
+namespace lightwave {
+
+TEST_CASE("Alias table tests", "[distribution]") {
+    const std::vector<float> weights{ 1, 0, 3, 0.5f, 10, 2.5f, 0, 7 };
+    const AliasTable table{ weights };
+    const float total = 24;
+
+    SECTION("Alias table reports the normalized weights") {
+        for (int i = 0; i < table.size(); i++)
+            REQUIRE(table.probability(i) == Catch::Approx(weights[i] / total));
+    }
+
+    SECTION("Alias table samples indices proportional to their weights") {
+        // a fine grid of random numbers hits every index as often as it would
+        // be sampled
+        constexpr int Resolution = 1 << 16;
+        std::vector<int> counts(weights.size());
+        for (int i = 0; i < Resolution; i++)
+            counts[table.sample((i + 0.5f) / Resolution)]++;
+        for (size_t i = 0; i < weights.size(); i++) {
+            REQUIRE(float(counts[i]) / Resolution ==
+                    Catch::Approx(weights[i] / total).margin(1e-3));
+        }
+    }
+
+    SECTION("Alias tables without weights are empty") {
+        REQUIRE(AliasTable{}.empty());
+        REQUIRE(AliasTable{ std::vector<float>(4, 0.f) }.empty());
+    }
+}
+
+} // namespace lightwave
@@ -0,0 +1,84 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave/guiding.hpp>
+
+#include <random>
+
+namespace lightwave {
+
+TEST_CASE("Directional tree tests", "[guiding]") {
+    std::mt19937 gen(1337);
+    std::uniform_real_distribution<float> dist(0, 1);
+    const auto randomDirection = [&]() {
+        return DirectionalTree::fromSquare(Point2(dist(gen), dist(gen)));
+    };
+    // most energy arrives from a small cone around a direction
+    const Vector peak = Vector(0.3f, -0.5f, 0.8f).normalized();
+    const auto recordAll = [&](DirectionalTree &tree) {
+        for (int i = 0; i < 20000; i++) {
+            const Vector direction = randomDirection();
+            tree.record(direction, direction.dot(peak) > 0.95f ? 100 : 1);
+        }
+        tree.finalize();
+    };
+
+    DirectionalTree coarse;
+    recordAll(coarse);
+    DirectionalTree tree = coarse.refined(0.01f, 512);
+    recordAll(tree);
+    REQUIRE(tree.numNodes() > coarse.numNodes());
+    REQUIRE(tree.numNodes() <= 512);
+
+    // integrate over a grid on the unit square, which the sphere of
+    // directions is mapped to with constant Jacobian 4 pi
+    constexpr int Resolution = 1024;
+    const auto forEachCell = [&](auto &&callback) {
+        for (int y = 0; y < Resolution; y++) {
+            for (int x = 0; x < Resolution; x++)
+                callback(Point2((x + 0.5f) / Resolution,
+                                (y + 0.5f) / Resolution));
+        }
+    };
+
+    SECTION("Mapping to the unit square can be inverted") {
+        for (int i = 0; i < 1000; i++) {
+            const Vector direction = randomDirection();
+            const Vector mapped    = DirectionalTree::fromSquare(
+                DirectionalTree::toSquare(direction));
+            REQUIRE((mapped - direction).length() < 1e-4f);
+        }
+    }
+
+    SECTION("Density integrates to one") {
+        double integral = 0;
+        forEachCell([&](const Point2 &p) {
+            integral += tree.pdf(DirectionalTree::fromSquare(p));
+        });
+        REQUIRE(integral * 4 * Pi / sqr(Resolution) ==
+                Catch::Approx(1).margin(1e-3));
+    }
+
+    SECTION("Samples are distributed according to the density") {
+        double expected = 0;
+        forEachCell([&](const Point2 &p) {
+            const Vector direction = DirectionalTree::fromSquare(p);
+            if (direction.dot(peak) > 0.9f)
+                expected += tree.pdf(direction);
+        });
+        expected *= 4 * Pi / sqr(Resolution);
+        REQUIRE(expected > 0.5);
+
+        int hits            = 0;
+        bool allHaveDensity = true;
+        forEachCell([&](const Point2 &u) {
+            const Vector direction = tree.sample(u);
+            allHaveDensity &= tree.pdf(direction) > 0;
+            if (direction.dot(peak) > 0.9f)
+                hits++;
+        });
+        REQUIRE(allHaveDensity);
+        REQUIRE(double(hits) / sqr(Resolution) ==
+                Catch::Approx(expected).margin(2e-3));
+    }
+}
+
+} // namespace lightwave
@@ -0,0 +1,143 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave/core.hpp>
+#include <lightwave/properties.hpp>
+#include <lightwave/light.hpp>
+#include <lights/point.cpp>
+#include <lights/spot.cpp>
+
+#include <random>
+
+namespace lightwave {
+
+/// @brief A one-sided square light, given by its corners and normal.
+struct SquareLight {
+    std::array<Point, 4> corners;
+    Vector normal;
+
+    LightBounds bounds() const {
+        Bounds box;
+        for (const auto &corner : corners)
+            box.extend(corner);
+        return { box, 1, normal, 1, 0 };
+    }
+
+    /// @brief Whether any point of the light could illuminate the given point.
+    bool reaches(const Point &point) const {
+        for (const auto &corner : corners) {
+            if ((point - corner).dot(normal) > 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+static Vector randomDirection(std::mt19937 &gen) {
+    std::normal_distribution<float> dist;
+    return Vector(dist(gen), dist(gen), dist(gen)).normalized();
+}
+
+TEST_CASE("Light bounds tests", "[light]") {
+    std::mt19937 gen(1337);
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    std::vector<SquareLight> lights(64);
+    for (auto &light : lights) {
+        const Point center{ dist(gen), dist(gen), dist(gen) };
+        light.normal = randomDirection(gen);
+        const Frame frame(light.normal);
+        const float size = 0.1f;
+        light.corners    = {
+            center + size * (frame.tangent + frame.bitangent),
+            center + size * (frame.tangent - frame.bitangent),
+            center - size * (frame.tangent + frame.bitangent),
+            center - size * (frame.tangent - frame.bitangent),
+        };
+    }
+
+    std::vector<Point> points(500);
+    for (auto &point : points)
+        point = Point(2 * dist(gen), 2 * dist(gen), 2 * dist(gen));
+
+    SECTION("Importance is only zero if the light cannot reach a point") {
+        for (const auto &light : lights) {
+            for (const auto &point : points) {
+                if (light.reaches(point))
+                    REQUIRE(light.bounds().importance(point) > 0);
+            }
+        }
+    }
+
+    SECTION("United bounds cover all of their lights") {
+        for (size_t group = 0; group + 4 <= lights.size(); group += 4) {
+            LightBounds united = lights[group].bounds();
+            for (size_t i = group + 1; i < group + 4; i++)
+                united = LightBounds::unite(united, lights[i].bounds());
+            REQUIRE(united.power == 4);
+
+            for (size_t i = group; i < group + 4; i++) {
+                REQUIRE(united.axis.dot(lights[i].normal) >=
+                        united.cosThetaO - 1e-4f);
+                for (const auto &point : points) {
+                    if (lights[i].reaches(point))
+                        REQUIRE(united.importance(point) > 0);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Light bounds of point and spot lights", "[light]") {
+    std::mt19937 gen(1337);
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    std::vector<Point> points(500);
+    for (auto &point : points)
+        point = Point(2 * dist(gen), 2 * dist(gen), 2 * dist(gen));
+
+    Properties props;
+    props.set("position", std::string("0.1, -0.2, 0.3"));
+    props.set("power", Color(1.f));
+
+    SECTION("Point lights reach every point") {
+        const PointLight light{ props };
+        const LightBounds bounds = *light.bounds();
+        for (const auto &point : points)
+            REQUIRE(bounds.importance(point) > 0);
+    }
+
+    SECTION("Spot lights only reach points within their cone") {
+        const Vector direction = randomDirection(gen);
+        const float angle      = 30;
+        props.set("direction", direction);
+        props.set("angle", angle);
+        const SpotLight light{ props };
+        const LightBounds bounds = *light.bounds();
+
+        const float cosAngle = cos(angle * Pi / 180.f);
+        int inside           = 0;
+        for (const auto &point : points) {
+            const Vector w = (point - Point(0.1f, -0.2f, 0.3f)).normalized();
+            const float cosTheta = w.dot(direction);
+            // skip points on the border of the cone, where rounding decides
+            if (std::abs(cosTheta - cosAngle) < 1e-3f)
+                continue;
+            if (cosTheta > cosAngle) {
+                REQUIRE(bounds.importance(point) > 0);
+                inside++;
+            } else {
+                REQUIRE(bounds.importance(point) == 0);
+            }
+        }
+        REQUIRE(inside > 0);
+
+        SECTION("United with a point light, the spot light is still reached") {
+            const PointLight point{ props };
+            const LightBounds united =
+                LightBounds::unite(bounds, *point.bounds());
+            for (const auto &p : points)
+                REQUIRE(united.importance(p) > 0);
+        }
+    }
+}
+
+} // namespace lightwave
@@ -0,0 +1,145 @@
+#include <catch_amalgamated.hpp>
+#include <lightwave/core.hpp>
+#include <lightwave/hash.hpp>
+#include <lightwave/properties.hpp>
+#include <lightwave/termination.hpp>
+
+#include <random>
+
+namespace lightwave {
+
+/// @brief Generates random numbers with the standard library.
+class TestSampler : public Sampler {
+    std::mt19937 m_gen;
+    std::uniform_real_distribution<float> m_dist{ 0, 1 };
+
+public:
+    void seed(int index) override { m_gen.seed(index); }
+    void seed(const Point2i &pixel, int sampleIndex) override {
+        m_gen.seed(
+            uint64_t(hash::fnv1a(pixel.x(), pixel.y(), sampleIndex)));
+    }
+    float next() override { return m_dist(m_gen); }
+    ref<Sampler> clone() const override {
+        return std::make_shared<TestSampler>(*this);
+    }
+    std::string toString() const override { return "TestSampler[]"; }
+};
+
+/**
+ * A random walk in the unit cube, whose upper half (x >= 0.5) is bright and
+ * reflective, while its lower half is dark and absorbs most light. Walks
+ * mostly stay within the half they are in, so the radiance reflected at a
+ * vertex depends strongly on where it lies, which makes ADRRS both terminate
+ * and split paths. Walks start in the dark half, such that most of their
+ * radiance is found by paths that have been split when entering the bright
+ * half.
+ */
+TEST_CASE("Russian roulette and splitting are unbiased", "[termination]") {
+    constexpr int MaxDepth          = 10;
+    constexpr int NumSamples        = 200000;
+    constexpr float StayProbability = 0.8f;
+
+    const auto isBright = [](const Point &p) { return p.x() >= 0.5f; };
+    const auto emission = [&](const Point &p) {
+        return isBright(p) ? 1.f : 0.f;
+    };
+    const auto reflectance = [&](const Point &p) {
+        return isBright(p) ? 0.9f : 0.3f;
+    };
+    const auto nextPosition = [&](const Point &p, Sampler &rng) {
+        Point next{ rng.next(), rng.next(), rng.next() };
+        if (rng.next() < StayProbability)
+            next.x() = 0.5f * next.x() + (isBright(p) ? 0.5f : 0.f);
+        return next;
+    };
+
+    // the expected radiance of a walk, found by iterating over the halves the
+    // vertices can lie in
+    const float stay = StayProbability + (1 - StayProbability) / 2;
+    std::array<double, 2> value{ 0, 1 }; // {dark, bright} at the last vertex
+    for (int depth = MaxDepth - 2; depth >= 0; depth--) {
+        value = {
+            0.3 * (stay * value[0] + (1 - stay) * value[1]),
+            1 + 0.9 * (stay * value[1] + (1 - stay) * value[0]),
+        };
+    }
+    const double expected = value[0]; // walks start in the dark half
+
+    const auto estimate = [&](const std::string &mode) {
+        Properties properties;
+        properties.set("roulette", mode);
+        properties.set("rouletteDepth", 1);
+        properties.set("radianceCacheResolution", 4);
+        const PathTermination termination(
+            properties, Bounds(Point(0.f), Point(1.f)));
+
+        TestSampler rng;
+        rng.seed(1337);
+        double sum = 0, sumOfSquares = 0;
+        int terminated = 0, resumed = 0;
+        for (int sample = 0; sample < NumSamples; sample++) {
+            PathTermination::Path path = termination.start();
+            Intersection its;
+            its.position = Point(0.5f * rng.next(), rng.next(), rng.next());
+            Color throughput(1.f);
+            Color result(0.f);
+            int depth = 0;
+            const auto scatter = [&](const Intersection &from) {
+                throughput *= reflectance(from.position);
+                its.position = nextPosition(from.position, rng);
+                return true;
+            };
+            for (;;) {
+                for (; depth < MaxDepth; depth++) {
+                    result += throughput * emission(its.position);
+                    termination.visit(path, its.position, throughput, result);
+                    if (depth == MaxDepth - 1)
+                        break;
+                    if (!termination.decide(
+                            path, its, depth, throughput, rng)) {
+                        terminated++;
+                        break;
+                    }
+                    scatter(its);
+                }
+                termination.terminate(path, result);
+                if (!termination.resume(path, throughput, depth, scatter))
+                    break;
+                resumed++;
+            }
+            termination.finish(path);
+
+            sum += result.r();
+            sumOfSquares += sqr(result.r());
+        }
+
+        const double mean     = sum / NumSamples;
+        const double variance = sumOfSquares / NumSamples - sqr(mean);
+        const double error    = sqrt(variance / NumSamples);
+        return std::make_tuple(mean, error, terminated, resumed);
+    };
+
+    SECTION("without roulette") {
+        const auto [mean, error, terminated, resumed] = estimate("none");
+        REQUIRE(terminated == 0);
+        REQUIRE(resumed == 0);
+        REQUIRE(abs(mean - expected) < 4 * error);
+    }
+
+    SECTION("with throughput based roulette") {
+        const auto [mean, error, terminated, resumed] = estimate("throughput");
+        REQUIRE(terminated > 0);
+        REQUIRE(resumed == 0);
+        REQUIRE(abs(mean - expected) < 4 * error);
+    }
+
+    SECTION("with adjoint-driven roulette and splitting") {
+        const auto [mean, error, terminated, resumed] = estimate("adrrs");
+        REQUIRE(terminated > 0);
+        REQUIRE(resumed > 0);
+        REQUIRE(abs(mean - expected) < 4 * error);
+    }
+}
+
+} // namespace lightwave
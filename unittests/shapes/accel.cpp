@@ -0,0 +1,281 @@
+#include <catch_amalgamated.hpp>
+#include <samplers/independent.cpp>
+#include <shapes/accel.hpp>
+
+#include <fstream>
+#include <random>
+
+namespace lightwave {
+
+/// @brief A minimal acceleration structure over a list of triangles, which only
+/// reports intersection distances.
+class TriangleSoup : public AccelerationStructure {
+    std::vector<std::array<Point, 3>> m_triangles;
+
+protected:
+    int numberOfPrimitives() const override { return int(m_triangles.size()); }
+
+    bool intersect(int primitiveIndex, const Ray &ray, Intersection &its,
+                   Sampler &rng) const override {
+        const auto &tri = m_triangles[primitiveIndex];
+        const Vector e1 = tri[1] - tri[0];
+        const Vector e2 = tri[2] - tri[0];
+        const Vector p  = ray.direction.cross(e2);
+        const float det = e1.dot(p);
+        if (abs(det) < 1e-8f)
+            return false;
+        const float invDet = 1 / det;
+        const Vector s     = ray.origin - tri[0];
+        const float u      = s.dot(p) * invDet;
+        if (u < 0 || u > 1)
+            return false;
+        const Vector q = s.cross(e1);
+        const float v  = ray.direction.dot(q) * invDet;
+        if (v < 0 || u + v > 1)
+            return false;
+        const float t = e2.dot(q) * invDet;
+        if (t < Epsilon || t > its.t)
+            return false;
+        its.t = t;
+        return true;
+    }
+
+    float transmittance(int primitiveIndex, const Ray &ray, float tMax,
+                        Sampler &rng) const override {
+        Intersection its(-ray.direction, tMax);
+        return intersect(primitiveIndex, ray, its, rng) ? 0.f : 1.f;
+    }
+
+    Bounds getBoundingBox(int primitiveIndex) const override {
+        Bounds bounds;
+        for (const auto &vertex : m_triangles[primitiveIndex])
+            bounds.extend(vertex);
+        return bounds;
+    }
+
+    Point getCentroid(int primitiveIndex) const override {
+        const auto &tri = m_triangles[primitiveIndex];
+        return Point((Vector(tri[0]) + Vector(tri[1]) + Vector(tri[2])) / 3);
+    }
+
+    std::optional<uint64_t> contentHash() const override {
+        return hash::fnv1a().update(
+            m_triangles.data(), m_triangles.size() * sizeof(m_triangles[0]));
+    }
+
+public:
+    using AccelerationStructure::hasSameTree;
+    using AccelerationStructure::intersect;
+    using AccelerationStructure::transmittance;
+
+    TriangleSoup(const std::vector<std::array<Point, 3>> &triangles,
+                 const BvhSettings &settings = {})
+        : m_triangles(triangles) {
+        buildAccelerationStructure(settings);
+    }
+
+    /// @brief Gives access to the triangles, e.g., to move them before calling
+    /// @ref refit .
+    std::vector<std::array<Point, 3>> &triangles() { return m_triangles; }
+
+    /// @brief Intersects all triangles without using the BVH.
+    bool intersectBruteForce(const Ray &ray, Intersection &its,
+                             Sampler &rng) const {
+        bool wasIntersected = false;
+        for (int i = 0; i < numberOfPrimitives(); i++)
+            wasIntersected |= intersect(i, ray, its, rng);
+        return wasIntersected;
+    }
+
+    std::string toString() const override { return "TriangleSoup[]"; }
+};
+
+/// @brief Generates random triangles of the given size in the unit cube.
+static std::vector<std::array<Point, 3>> randomTriangles(int count,
+                                                         float size = 0.02f) {
+    std::mt19937 gen(1337);
+    std::uniform_real_distribution<float> dist(0, 1);
+    std::vector<std::array<Point, 3>> triangles(count);
+    for (auto &tri : triangles) {
+        const Point center{ dist(gen), dist(gen), dist(gen) };
+        for (auto &vertex : tri)
+            vertex = center + size * Vector(dist(gen) - 0.5f,
+                                            dist(gen) - 0.5f,
+                                            dist(gen) - 0.5f);
+    }
+    return triangles;
+}
+
+/// @brief Generates random rays that start outside the unit cube and point
+/// towards it.
+static std::vector<Ray> randomRays(int count) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dist(0, 1);
+    std::vector<Ray> rays(count);
+    for (auto &ray : rays) {
+        const Point origin{ 3 * dist(gen) - 1, 3 * dist(gen) - 1, -1 };
+        const Point target{ dist(gen), dist(gen), dist(gen) };
+        ray = Ray(origin, (target - origin).normalized());
+    }
+    return rays;
+}
+
+TEST_CASE("BVH tests", "[accel]") {
+    // enough triangles for the build to use the thread pool
+    const auto triangles = randomTriangles(20000);
+    const auto rays      = randomRays(500);
+    const TriangleSoup soup{ triangles };
+    const Properties props;
+    Independent sampler{ props };
+
+    SECTION("BVH reports the same intersections as brute force") {
+        for (const auto &ray : rays) {
+            Intersection bvhIts, bruteForceIts;
+            const bool bvhHit = soup.intersect(ray, bvhIts, sampler);
+            const bool bruteForceHit =
+                soup.intersectBruteForce(ray, bruteForceIts, sampler);
+            REQUIRE(bvhHit == bruteForceHit);
+            REQUIRE(bvhIts.t == bruteForceIts.t);
+            REQUIRE(soup.occluded(ray, Infinity, sampler) == bruteForceHit);
+        }
+    }
+
+    SECTION("Wide BVHs report the same intersections as brute force") {
+        for (const auto layout : { BvhLayout::Wide4, BvhLayout::Wide8 }) {
+            BvhSettings settings;
+            settings.layout = layout;
+            const TriangleSoup wide{ triangles, settings };
+            for (const auto &ray : rays) {
+                Intersection wideIts, bruteForceIts;
+                const bool wideHit = wide.intersect(ray, wideIts, sampler);
+                const bool bruteForceHit =
+                    wide.intersectBruteForce(ray, bruteForceIts, sampler);
+                REQUIRE(wideHit == bruteForceHit);
+                REQUIRE(wideIts.t == bruteForceIts.t);
+                REQUIRE(wide.transmittance(ray, Infinity, sampler) ==
+                        (bruteForceHit ? 0 : 1));
+                REQUIRE(wide.occluded(ray, Infinity, sampler) ==
+                        bruteForceHit);
+            }
+        }
+    }
+
+    SECTION("BVHs with spatial splits report the same intersections as "
+            "brute force") {
+        // large triangles overlap a lot, which makes spatial splits pay off
+        BvhSettings settings;
+        settings.spatialSplits = true;
+        const TriangleSoup sbvh{ randomTriangles(2000, 0.5f), settings };
+        for (const auto &ray : rays) {
+            Intersection sbvhIts, bruteForceIts;
+            const bool sbvhHit = sbvh.intersect(ray, sbvhIts, sampler);
+            const bool bruteForceHit =
+                sbvh.intersectBruteForce(ray, bruteForceIts, sampler);
+            REQUIRE(sbvhHit == bruteForceHit);
+            REQUIRE(sbvhIts.t == bruteForceIts.t);
+            REQUIRE(sbvh.occluded(ray, Infinity, sampler) == bruteForceHit);
+        }
+    }
+
+    SECTION("BVHs loaded from the cache match built BVHs") {
+        BvhSettings settings;
+        settings.cacheDirectory =
+            std::filesystem::temp_directory_path() / "lightwave-bvh-test";
+        std::filesystem::remove_all(settings.cacheDirectory);
+
+        const TriangleSoup built{ triangles, settings };
+        REQUIRE(!std::filesystem::is_empty(settings.cacheDirectory));
+        const TriangleSoup loaded{ triangles, settings };
+        for (const auto &ray : rays) {
+            Intersection builtIts, loadedIts;
+            built.intersect(ray, builtIts, sampler);
+            loaded.intersect(ray, loadedIts, sampler);
+            REQUIRE(builtIts.t == loadedIts.t);
+            REQUIRE(builtIts.stats.bvhCounter == loadedIts.stats.bvhCounter);
+        }
+
+        // corrupt the child index of the last node, which directly precedes
+        // the primitive indices
+        const auto path =
+            std::filesystem::directory_iterator(settings.cacheDirectory)
+                ->path();
+        {
+            std::fstream file(path,
+                              std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(-std::streamoff(triangles.size() * sizeof(int) +
+                                       sizeof(int32_t) * 2),
+                       std::ios::end);
+            const int32_t garbage = 0x7fffffff;
+            file.write(reinterpret_cast<const char *>(&garbage),
+                       sizeof(garbage));
+        }
+        const TriangleSoup rebuilt{ triangles, settings };
+        for (const auto &ray : rays) {
+            Intersection rebuiltIts, bruteForceIts;
+            REQUIRE(rebuilt.intersect(ray, rebuiltIts, sampler) ==
+                    rebuilt.intersectBruteForce(ray, bruteForceIts, sampler));
+            REQUIRE(rebuiltIts.t == bruteForceIts.t);
+        }
+        std::filesystem::remove_all(settings.cacheDirectory);
+    }
+
+    SECTION("Refitted BVHs report the same intersections as brute force") {
+        const auto check = [&](const TriangleSoup &refitted) {
+            for (const auto &ray : rays) {
+                Intersection refitIts, bruteForceIts;
+                const bool refitHit =
+                    refitted.intersect(ray, refitIts, sampler);
+                const bool bruteForceHit =
+                    refitted.intersectBruteForce(ray, bruteForceIts, sampler);
+                REQUIRE(refitHit == bruteForceHit);
+                REQUIRE(refitIts.t == bruteForceIts.t);
+                REQUIRE(refitted.occluded(ray, Infinity, sampler) ==
+                        bruteForceHit);
+            }
+        };
+
+        for (const auto layout :
+             { BvhLayout::Binary, BvhLayout::Wide4, BvhLayout::Wide8 }) {
+            // small movements only refit the BVH
+            BvhSettings settings;
+            settings.layout         = layout;
+            settings.refitThreshold = Infinity;
+            TriangleSoup moved{ triangles, settings };
+            for (size_t i = 0; i < moved.triangles().size(); i += 2) {
+                for (auto &vertex : moved.triangles()[i])
+                    vertex += Vector(0.05f, -0.02f, 0.03f);
+            }
+            REQUIRE(!moved.refit());
+            check(moved);
+
+            // shuffling all triangles degrades the BVH and forces a rebuild
+            settings.refitThreshold = BvhSettings().refitThreshold;
+            TriangleSoup shuffled{ triangles, settings };
+            std::reverse(shuffled.triangles().begin(),
+                         shuffled.triangles().end());
+            REQUIRE(shuffled.refit());
+            check(shuffled);
+        }
+    }
+
+    SECTION("BVH construction is deterministic") {
+        // parallel builds match the serial build exactly
+        BvhSettings settings;
+        settings.parallelBuild = false;
+        const TriangleSoup serial{ triangles, settings };
+        REQUIRE(soup.hasSameTree(serial));
+
+        const TriangleSoup other{ triangles };
+        REQUIRE(soup.hasSameTree(other));
+        for (const auto &ray : rays) {
+            Intersection its, otherIts;
+            soup.intersect(ray, its, sampler);
+            other.intersect(ray, otherIts, sampler);
+            REQUIRE(its.t == otherIts.t);
+            REQUIRE(its.stats.bvhCounter == otherIts.stats.bvhCounter);
+            REQUIRE(its.stats.primCounter == otherIts.stats.primCounter);
+        }
+    }
+}
+
+} // namespace lightwave
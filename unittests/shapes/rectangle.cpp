@@ -24,6 +24,20 @@ TEST_CASE("Rectangle tests", "[rectangle]") {
             REQUIRE(its.t == sqrt(2.0f));
         }
 
+        SECTION("Rectangle reports the footprint of ray differentials") {
+            Ray ray{ Point(0, 0, -1), Vector(0, 0, 1) };
+            ray.hasDifferentials = true;
+            ray.dxOrigin = ray.dyOrigin = ray.origin;
+            ray.dxDirection = Vector(0.1f, 0, 1);
+            ray.dyDirection = Vector(0, 0.1f, 1);
+            REQUIRE(rectangle.intersect(ray, its, sampler));
+            its.computeDifferentials(ray);
+            REQUIRE(its.uv.dx.x() == Catch::Approx(0.05f));
+            REQUIRE(its.uv.dx.y() == Catch::Approx(0).margin(1e-6f));
+            REQUIRE(its.uv.dy.x() == Catch::Approx(0).margin(1e-6f));
+            REQUIRE(its.uv.dy.y() == Catch::Approx(0.05f));
+        }
+
         SECTION("Rectangle can be missed") {
             const Ray ray{ Point(-1, 2, -1), Vector(1, 0, 1).normalized() };
             REQUIRE(!rectangle.intersect(ray, its, sampler));